@@ -1,12 +1,21 @@
 #include <Bus.hpp>
 #include <fstream>
 #include <cstring>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* The bus owning the fastmem arena, faults are routed to it */
+static Bus* fastmem_bus = nullptr;
+static struct sigaction old_segv_action;
 
 Bus::Bus(std::string biosFilePath, gs::GraphicsSynthesizer *_gs)
 : gs(_gs),
 sif(new SIF(this)),
 ipu(new IPU(this))
 {
+    allocate_memory();
+
     std::ifstream file(biosFilePath, std::fstream::in | std::fstream::binary);
 
     if (!file)
@@ -19,73 +28,325 @@ ipu(new IPU(this))
     console.clear();
 
     std::memset(iopRam, 0x00, sizeof(iopRam));
-    std::memset(eeRam, 0, sizeof(eeRam));
+    std::memset(iopScratchpad, 0, sizeof(iopScratchpad));
+    std::memset(eeRam, 0, BIOS_OFFSET - RAM_OFFSET);
 
     printf("[BUS]: BIOS loaded successfully\n");
+
+    map_pages();
+    map_registers();
+    map_iop_pages();
+    map_iop_registers();
+    sif->register_mmio(this);
+    ipu->register_mmio(this);
 }
 
-uint8_t Bus::Read8(uint32_t addr, bool ee)
+Bus::~Bus()
 {
-    addr = TranslateAddr(addr);
-    if (addr >= 0x1FC00000 && addr < 0x20000000)
-        return bios[addr - 0x1FC00000];
-    if (ee)
+    if (fastmem_base)
     {
-        if (addr >= 0x1FC00000 && addr < 0x20000000)
-            return bios[addr - 0x1FC00000];
-        if (addr < 0x2000000)
-            return eeRam[addr];
-        if (addr == 0x1F803204)
-            return 0;
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
-            return eeScratchpad[addr - 0x70000000];
+        munmap(fastmem_base, 0x100000000);
+        sigaction(SIGSEGV, &old_segv_action, nullptr);
+        fastmem_bus = nullptr;
     }
-    printf("[BUS]: Read8 from unknown addr 0x%08X\n", addr);
-    exit(1);
+
+    munmap(memory, MEMORY_SIZE);
+    if (memory_fd >= 0)
+        close(memory_fd);
 }
 
-uint16_t Bus::Read16(uint32_t addr, bool ee)
+void Bus::allocate_memory()
 {
-    addr = TranslateAddr(addr);
-    if (ee)
+    memory_fd = memfd_create("ps2-ee-memory", MFD_CLOEXEC);
+    if (memory_fd >= 0 && ftruncate(memory_fd, MEMORY_SIZE) < 0)
     {
-        if (addr >= 0x1FC00000 && addr < 0x20000000)
-            return *(uint16_t*)&bios[addr - 0x1FC00000];
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
-            return *(uint16_t*)&eeScratchpad[addr - 0x70000000];
-        if (addr < 0x2000000)
-            return *(uint16_t*)&eeRam[addr];
-        switch (addr)
+        close(memory_fd);
+        memory_fd = -1;
+    }
+
+    /* Without a memfd everything still works, just without fastmem */
+    if (memory_fd >= 0)
+        memory = (uint8_t*)mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    else
+        memory = (uint8_t*)mmap(nullptr, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED)
+    {
+        printf("[BUS]: Failed to allocate EE memory\n");
+        exit(1);
+    }
+
+    eeRam = memory + RAM_OFFSET;
+    bios = memory + BIOS_OFFSET;
+    eeScratchpad = memory + SCRATCHPAD_OFFSET;
+}
+
+/* Host memory behind a physical address, if it is plain memory at all */
+uint8_t* Bus::backing_memory(uint32_t paddr, bool& writable)
+{
+    writable = true;
+    if (paddr < 0x2000000)
+        return &eeRam[paddr];
+    if (paddr >= 0x70000000 && paddr < 0x70004000)
+        return &eeScratchpad[paddr - 0x70000000];
+
+    writable = false;
+    if (paddr >= 0x1FC00000 && paddr < 0x20000000)
+        return &bios[paddr - 0x1FC00000];
+
+    return nullptr;
+}
+
+void Bus::map_pages()
+{
+    for (int i = 0; i < 1024; i++)
+    {
+        read_table[i] = empty_table;
+        write_table[i] = empty_table;
+    }
+
+    /* Walk every virtual page once and record where it lands, which
+       takes care of all the KSEG and uncached mirrors in one go */
+    for (uint32_t vpage = 0; vpage < 0x100000; vpage++)
+    {
+        uint32_t vaddr = vpage << 12;
+        uint32_t paddr = TranslateAddr(vaddr);
+
+        bool writable;
+        uint8_t* read = backing_memory(paddr, writable);
+        uint8_t* write = writable ? read : nullptr;
+
+        if (!read)
+            continue;
+
+        uint32_t dir = vaddr >> 22;
+        if (read_table[dir] == empty_table)
         {
-        case 0x1F803800:
-            return 0xFFFF;
+            tables.push_back(std::make_unique<uint8_t*[]>(1024));
+            read_table[dir] = tables.back().get();
+            tables.push_back(std::make_unique<uint8_t*[]>(1024));
+            write_table[dir] = tables.back().get();
+
+            if (paddr < 0x2000000)
+                ram_aliases[paddr >> 22].push_back(dir);
         }
+
+        read_table[dir][vpage & 0x3FF] = read;
+        write_table[dir][vpage & 0x3FF] = write;
     }
-    else
+}
+
+/* Maps or unmaps a physical RAM page in every mirror of the write table */
+void Bus::set_page_writable(uint32_t page, bool writable)
+{
+    uint32_t paddr = page << 12;
+    if (paddr >= 0x2000000)
+        return;
+
+    for (auto dir : ram_aliases[paddr >> 22])
     {
-        if (addr >= 0x1FC00000 && addr < 0x20000000)
-            return *(uint16_t*)&bios[addr - 0x1FC00000];
+        uint32_t vaddr = (dir << 22) | (paddr & 0x3FF000);
+        if (TranslateAddr(vaddr) != paddr)
+            continue;
+
+        write_table[dir][(vaddr >> 12) & 0x3FF] = writable ? &eeRam[paddr] : nullptr;
+        if (fastmem_base)
+            mprotect(fastmem_base + vaddr, 0x1000, writable ? PROT_READ | PROT_WRITE : PROT_READ);
     }
-    printf("[BUS]: Read16 from unknown addr 0x%08X (%s)\n", addr, ee ? "EmotionEngine" : "IOProcessor");
-    exit(1);
 }
 
-uint32_t Bus::Read32(uint32_t addr, bool ee)
+bool Bus::enable_fastmem()
 {
-    addr = TranslateAddr(addr);
-    if (addr >= 0x1FC00000 && addr < 0x20000000)
-        return *(uint32_t*)&bios[addr & 0x3FFFFF];
-    if (ee)
+    if (memory_fd < 0)
     {
-        if (addr < 0x2000000)
-            return *(uint32_t*)&eeRam[addr];
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
-            return *(uint32_t*)&eeScratchpad[addr - 0x70000000];
-        if (addr == 0x1000F430 || addr == 0x1000F400)
-            return 0;
-        else if (addr == 0x1000F130 || addr == 0x1000F410)
-            return 0;
-        if (addr == 0x1000F440)
+        printf("[BUS]: Fastmem needs a memfd backed address space\n");
+        return false;
+    }
+
+    if (fastmem_bus)
+    {
+        printf("[BUS]: Fastmem is already in use by another bus\n");
+        return false;
+    }
+
+    uint8_t* base = (uint8_t*)mmap(nullptr, 0x100000000, PROT_NONE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        printf("[BUS]: Failed to reserve the fastmem arena\n");
+        return false;
+    }
+
+    /* Map runs of virtual pages that are contiguous in the backing file */
+    uint32_t run_start = 0, run_offset = 0, run_pages = 0;
+    int run_prot = PROT_NONE;
+    for (uint64_t vpage = 0; vpage <= 0x100000; vpage++)
+    {
+        uint8_t* host = nullptr;
+        bool writable = false;
+        if (vpage < 0x100000)
+            host = backing_memory(TranslateAddr(vpage << 12), writable);
+
+        uint32_t offset = host ? host - memory : 0;
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        if (run_pages && host && prot == run_prot && offset == run_offset + run_pages * 0x1000)
+        {
+            run_pages++;
+            continue;
+        }
+
+        if (run_pages)
+        {
+            void* view = mmap(base + ((uint64_t)run_start << 12), (uint64_t)run_pages << 12, run_prot,
+                              MAP_SHARED | MAP_FIXED, memory_fd, run_offset);
+            if (view == MAP_FAILED)
+            {
+                printf("[BUS]: Failed to map fastmem view at 0x%08X\n", run_start << 12);
+                munmap(base, 0x100000000);
+                return false;
+            }
+        }
+
+        run_pages = host ? 1 : 0;
+        run_start = vpage;
+        run_offset = offset;
+        run_prot = prot;
+    }
+
+    fastmem_base = base;
+    fastmem_bus = this;
+
+    /* Pages already holding code have to fault on writes */
+    for (uint32_t page = 0; page < 0x2000; page++)
+    {
+        if (ee_code_pages[page])
+            set_page_writable(page, false);
+    }
+
+    struct sigaction action = {};
+    action.sa_sigaction = fastmem_fault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &old_segv_action);
+
+    printf("[BUS]: Fastmem arena at %p\n", base);
+    return true;
+}
+
+/* The instructions emitted by fastmem_read/fastmem_write */
+struct FastmemAccess
+{
+    uint8_t bytes[4];
+    uint8_t length;
+    uint8_t size;
+    bool store;
+};
+
+static const FastmemAccess fastmem_accesses[] =
+{
+    {{0x0F, 0xB6, 0x04, 0x0A}, 4, 1, false},
+    {{0x0F, 0xB7, 0x04, 0x0A}, 4, 2, false},
+    {{0x8B, 0x04, 0x0A}, 3, 4, false},
+    {{0x48, 0x8B, 0x04, 0x0A}, 4, 8, false},
+    {{0x88, 0x04, 0x0A}, 3, 1, true},
+    {{0x66, 0x89, 0x04, 0x0A}, 4, 2, true},
+    {{0x89, 0x04, 0x0A}, 3, 4, true},
+    {{0x48, 0x89, 0x04, 0x0A}, 4, 8, true},
+};
+
+/* Replays a faulting fastmem access through the slow path and
+   steps over the instruction. The guest address is in RCX and
+   the data in RAX, as pinned down by the inline assembly */
+bool Bus::handle_fastmem_fault(void* raw_context)
+{
+    auto context = (ucontext_t*)raw_context;
+    auto& gregs = context->uc_mcontext.gregs;
+    const uint8_t* rip = (const uint8_t*)gregs[REG_RIP];
+
+    for (auto& access : fastmem_accesses)
+    {
+        if (std::memcmp(rip, access.bytes, access.length) != 0)
+            continue;
+
+        uint32_t addr = (uint32_t)gregs[REG_RCX];
+        uint64_t data = gregs[REG_RAX];
+        if (access.store)
+        {
+            switch (access.size)
+            {
+            case 1: Write8Slow(addr, data, true); break;
+            case 2: Write16Slow(addr, data, true); break;
+            case 4: Write32Slow(addr, data, true); break;
+            case 8: Write64Slow(addr, data, true); break;
+            }
+        }
+        else
+        {
+            switch (access.size)
+            {
+            case 1: gregs[REG_RAX] = Read8Slow(addr, true); break;
+            case 2: gregs[REG_RAX] = Read16Slow(addr, true); break;
+            case 4: gregs[REG_RAX] = Read32Slow(addr, true); break;
+            case 8: gregs[REG_RAX] = Read64Slow(addr, true); break;
+            }
+        }
+
+        gregs[REG_RIP] += access.length;
+        return true;
+    }
+
+    return false;
+}
+
+void Bus::fastmem_fault(int, siginfo_t* info, void* context)
+{
+    uint8_t* addr = (uint8_t*)info->si_addr;
+    if (fastmem_bus && addr >= fastmem_bus->fastmem_base && addr < fastmem_bus->fastmem_base + 0x100000000)
+    {
+        if (fastmem_bus->handle_fastmem_fault(context))
+            return;
+    }
+
+    /* Not one of ours, let the previous handler have it on the retry */
+    sigaction(SIGSEGV, &old_segv_action, nullptr);
+}
+
+void Bus::register_mmio(uint32_t start, uint32_t end, MMIOHandler handler)
+{
+    mmio_handlers.push_back(std::move(handler));
+    uint16_t index = mmio_handlers.size();
+
+    for (uint32_t addr = start; addr < end; addr += 4)
+    {
+        auto& slots = mmio_pages[addr >> 12];
+        if (!slots)
+            slots = std::make_unique<uint16_t[]>(1024);
+
+        slots[(addr & 0xFFF) >> 2] = index;
+    }
+}
+
+/* Registers that belong to the bus itself or to units without their own class */
+void Bus::map_registers()
+{
+    /* Memory controller, only the RDRAM initialization sequence matters */
+    register_mmio(0x1000F430, 0x1000F434,
+    {
+        .read32 = [](uint32_t) -> uint32_t { return 0; },
+        .write32 = [this](uint32_t, uint32_t data)
+        {
+            uint8_t SA = (data >> 16) & 0xFFF;
+            uint8_t SBC = (data >> 6) & 0xF;
+
+            if (SA == 0x21 && SBC == 0x1 && ((MCH_DRD >> 7) & 1) == 0)
+                rdram_sdevid = 0;
+
+            MCH_RICM = data & ~0x80000000;
+        }
+    });
+    register_mmio(0x1000F440, 0x1000F444,
+    {
+        .read32 = [this](uint32_t) -> uint32_t
         {
             uint8_t SOP = (MCH_RICM >> 6) & 0xF;
             uint8_t SA = (MCH_RICM >> 16) & 0xFFF;
@@ -109,132 +370,197 @@ uint32_t Bus::Read32(uint32_t addr, bool ee)
                 }
             }
             return 0;
-        }
-        if (addr >= 0x10000000 && addr < 0x10002000)
+        },
+        .write32 = [this](uint32_t, uint32_t data) { MCH_DRD = data; }
+    });
+
+    /* Registers that read as zero and ignore writes */
+    for (uint32_t addr : { 0x1000F130, 0x1000F400, 0x1000F410, 0x1F80141C })
+    {
+        register_mmio(addr, addr + 4,
+        {
+            .read32 = [](uint32_t) -> uint32_t { return 0; },
+            .write32 = [](uint32_t, uint32_t) {}
+        });
+    }
+
+    /* Registers that only ignore writes */
+    for (uint32_t addr : { 0x1000F100, 0x1000F120, 0x1000F140, 0x1000F150, 0x1000F420,
+                           0x1000F450, 0x1000F460, 0x1000F480, 0x1000F490, 0x1000F500, 0x1000F510 })
+    {
+        register_mmio(addr, addr + 4, { .write32 = [](uint32_t, uint32_t) {} });
+    }
+
+    register_mmio(0x1F803204, 0x1F803208, { .read8 = [](uint32_t) -> uint8_t { return 0; } });
+    register_mmio(0x1F803800, 0x1F803804, { .read16 = [](uint32_t) -> uint16_t { return 0xFFFF; } });
+    register_mmio(0x1A000008, 0x1A00000C, { .write16 = [](uint32_t, uint16_t) {} });
+    register_mmio(0x1F801470, 0x1F801474, { .write16 = [](uint32_t, uint16_t) {} });
+
+    /* Debug console output */
+    register_mmio(0x1000F180, 0x1000F184,
+    {
+        .write8 = [this](uint32_t, uint8_t data)
         {
-            return timers->read(addr);    
+            console << data;
+            console.flush();
         }
-        if (addr == 0x1000F000 || addr == 0x1000F010)
-            return intc->read(addr);
-        if (addr == 0x1F80141C)
-            return 0;
-        else if (addr >= 0x1C000000 && addr < 0x1C200000)
-            return *(uint32_t*)&iopRam[addr - 0x1C000000];
-        else if (addr >= 0x10008000 && addr < 0x1000E000)
-            return dmac->read_channel(addr);
-        switch (addr)
+    });
+
+    /* GS privileged registers */
+    register_mmio(0x12000000, 0x12001084,
+    {
+        .read32 = [this](uint32_t addr) -> uint32_t
         {
-        case 0x10003000:
-        case 0x10003010:
-        case 0x10003020:
-        case 0x10003030:
-        case 0x10003040:
-        case 0x10003050:
-        case 0x10003060:
-        case 0x10003070:
-        case 0x10003080:
-        case 0x10003090:
-        case 0x100030A0:
-            return gif->read(addr);
-        case 0x1000E000 ... 0x1000E060:
-            return dmac->read_global(addr);
-        case 0x1000F520:
-            return dmac->read_enabler(addr);
-        case 0x10003800:
-        case 0x10003850:
-        case 0x10003900:
-        case 0x10003910:
-        case 0x10003920:
-        case 0x10003930:
-            return vif[0]->read(addr);
-        case 0x10002000:
-        case 0x10002010:
-        case 0x10002020:
-        case 0x10002030:
-            return ipu->read(addr);
-        case 0x1000F200:
-        case 0x1000F210:
-        case 0x1000F220:
-        case 0x1000F230:
-            return sif->read(addr);
-        case 0x1F808268:
-        case 0x1F80826C:
-        case 0x1F808270:
-        case 0x1F808274:
-            return sio2->read(addr);
+            return gs->read_priv(addr & ~0x7) >> ((addr & 0x4) * 8);
+        },
+        .read64 = [this](uint32_t addr) { return gs->read_priv(addr); },
+        .write64 = [this](uint32_t addr, uint64_t data) { gs->write_priv(addr, data); }
+    });
+
+    /* VU0/VU1 code and data memory */
+    register_mmio(0x11000000, 0x11010000,
+    {
+        .write64 = [this](uint32_t addr, uint64_t data)
+        {
+            bool vid = addr & 0x8000;
+            if (addr & 0x4000)
+                vu[vid]->write<Memory::Data, uint64_t>(addr, data);
+            else
+                vu[vid]->write<Memory::Code, uint64_t>(addr, data);
+        },
+        .write128 = [this](uint32_t addr, uint128_t data)
+        {
+            bool vid = addr & 0x8000;
+            if (addr & 0x4000)
+                vu[vid]->write<Memory::Data, uint128_t>(addr, data);
+            else
+                vu[vid]->write<Memory::Code, uint128_t>(addr, data);
         }
+    });
+}
+
+uint8_t Bus::Read8Slow(uint32_t addr, bool ee)
+{
+    addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->read8)
+        return handler->read8(addr);
+
+    if (addr >= 0x1FC00000 && addr < 0x20000000)
+        return bios[addr - 0x1FC00000];
+    if (ee)
+    {
+        if (addr < 0x2000000)
+            return eeRam[addr];
+        if (addr >= 0x70000000 && addr < 0x70004000)
+            return eeScratchpad[addr - 0x70000000];
+    }
+    printf("[BUS]: Read8 from unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+uint16_t Bus::Read16Slow(uint32_t addr, bool ee)
+{
+    addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->read16)
+        return handler->read16(addr);
+
+    if (addr >= 0x1FC00000 && addr < 0x20000000)
+        return *(uint16_t*)&bios[addr - 0x1FC00000];
+    if (ee)
+    {
+        if (addr >= 0x70000000 && addr < 0x70004000)
+            return *(uint16_t*)&eeScratchpad[addr - 0x70000000];
+        if (addr < 0x2000000)
+            return *(uint16_t*)&eeRam[addr];
+    }
+    printf("[BUS]: Read16 from unknown addr 0x%08X (%s)\n", addr, ee ? "EmotionEngine" : "IOProcessor");
+    exit(1);
+}
+
+uint32_t Bus::Read32Slow(uint32_t addr, bool ee)
+{
+    addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->read32)
+        return handler->read32(addr);
+
+    if (addr >= 0x1FC00000 && addr < 0x20000000)
+        return *(uint32_t*)&bios[addr & 0x3FFFFF];
+    if (ee)
+    {
+        if (addr < 0x2000000)
+            return *(uint32_t*)&eeRam[addr];
+        if (addr >= 0x70000000 && addr < 0x70004000)
+            return *(uint32_t*)&eeScratchpad[addr - 0x70000000];
+        if (addr >= 0x1C000000 && addr < 0x1C200000)
+            return *(uint32_t*)&iopRam[addr - 0x1C000000];
     }
     else
     {
         if (addr >= iop_scratchpad_start && addr <= iop_scratchpad_start + 0x400)
             return *(uint32_t*)&iopScratchpad[addr - iop_scratchpad_start];
-        switch (addr)
-        {
-        }
     }
     printf("[BUS]: Read from unknown addr 0x%08X\n", addr);
     exit(1);
 }
 
-uint64_t Bus::Read64(uint32_t addr, bool ee)
+uint64_t Bus::Read64Slow(uint32_t addr, bool ee)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->read64)
+        return handler->read64(addr);
+
     if (ee)
     {
         if (addr >= 0x1FC00000 && addr < 0x20000000)
             return *(uint64_t*)&bios[addr - 0x1FC00000];
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
+        if (addr >= 0x70000000 && addr < 0x70004000)
             return *(uint64_t*)&eeScratchpad[addr - 0x70000000];
         if (addr < 0x2000000)
             return *(uint64_t*)&eeRam[addr];
-        switch (addr)
-        {
-        case 0x10002000:
-        case 0x10002010:
-        case 0x10002020:
-        case 0x10002030:
-            return ipu->read(addr);
-        }
     }
     printf("[BUS]: Read64 from unknown addr 0x%08X\n", addr);
     exit(1);
 }
 
-Register Bus::Read128(uint32_t addr)
+Register Bus::Read128Slow(uint32_t addr)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->read128)
+    {
+        uint128_t value = handler->read128(addr);
+        return *(Register*)&value;
+    }
+
     if (addr < 0x2000000)
     {
         return *(Register*)&eeRam[addr];
     }
-    printf("[BUS]: Write128 to unknown addr 0x%08X\n", addr);
+    printf("[BUS]: Read128 from unknown addr 0x%08X\n", addr);
     exit(1);
 }
 
-void Bus::Write8(uint32_t addr, uint8_t data, bool ee)
+void Bus::Write8Slow(uint32_t addr, uint8_t data, bool ee)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->write8)
+        return handler->write8(addr, data);
 
-    if (addr == 0x1000F180)
-    {
-        console << data;
-        console.flush();
-        return;
-    }
     if (ee)
     {
         if (addr >= 0x1fff8000 && addr < 0x20000000)
         {
+           check_code_write(addr);
            bios[addr - 0x1FC00000] = data;
            return;
         }
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
+        if (addr >= 0x70000000 && addr < 0x70004000)
         {
             eeScratchpad[addr - 0x70000000] = data;
             return;
         }
         if (addr < 0x2000000)
         {
+            check_code_write(addr);
             eeRam[addr] = data;
             return;
         }
@@ -258,140 +584,56 @@ void Bus::Write8(uint32_t addr, uint8_t data, bool ee)
     exit(1);
 }
 
-void Bus::Write16(uint32_t addr, uint16_t data, bool ee)
+void Bus::Write16Slow(uint32_t addr, uint16_t data, bool ee)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->write16)
+        return handler->write16(addr, data);
 
-    if (addr == 0x1F801472 || addr == 0x1F801470)
-        return;
     if (ee)
     {
-        if (addr >= 0x70000000 && addr <= 0x700003fff)
+        if (addr >= 0x70000000 && addr < 0x70004000)
         {
             *(uint16_t*)&eeScratchpad[addr - 0x70000000] = data;
             return;
         }
         if (addr < 0x2000000)
         {
+            check_code_write(addr);
             *(uint16_t*)&eeRam[addr] = data;
             return;
         }
-
-        switch (addr)
-        {
-        case 0x1A000008:
-            return;
-        }
-    }
-    else
-    {
     }
     printf("[BUS]: Write16 to unknown addr 0x%08X (%s)\n", addr, ee ? "EmotionEngine" : "IOProcessor");
     exit(1);
 }
 
-void Bus::Write32(uint32_t addr, uint32_t data, bool ee)
+void Bus::Write32Slow(uint32_t addr, uint32_t data, bool ee)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->write32)
+        return handler->write32(addr, data);
 
     if (ee)
     {
-        if (addr < 0x2000000 && ee)
+        if (addr < 0x2000000)
         {
+            check_code_write(addr);
             *(uint32_t*)&eeRam[addr] = data;
             return;
         }
-        else if (addr == 0x1000F500 || addr == 0x1000F510)
-            return;
-        else if (addr >= 0x70000000 && addr <= 0x700003fff)
+        else if (addr >= 0x70000000 && addr < 0x70004000)
         {
             *(uint32_t*)&eeScratchpad[addr - 0x70000000] = data;
             return;
         }
-        else if (addr == 0x1000F140 || addr == 0x1000F150 || addr == 0x1000F100 || addr == 0x1000F120)
-            return;
-        else if (addr == 0x1000F130 || addr == 0x1000F400 || addr == 0x1000F420 || addr == 0x1000F450)
-            return;
-        else if (addr == 0x1000F410 || addr == 0x1000F480 || addr == 0x1000F490 || addr == 0x1000F460 || addr == 0x1000F410)
-            return;
-        else if (addr == 0x1000F430)
-        {
-            uint8_t SA = (data >> 16) & 0xFFF;
-            uint8_t SBC = (data >> 6) & 0xF;
-
-            if (SA == 0x21 && SBC == 0x1 && ((MCH_DRD >> 7) & 1) == 0)
-                rdram_sdevid = 0;
-            
-            MCH_RICM = data & ~0x80000000;
-            return;
-        }
-        else if (addr == 0x1000F440)
-        {
-            MCH_DRD = data;
-            return;
-        }
-        else if (addr >= 0x1000F200 && addr <= 0x1000F260)
-        {
-            sif->write(addr, data);
-            return;
-        }
-        else if (addr >= 0x10000000 && addr < 0x10002000)
-        {
-            timers->write(addr, data);
-            return;
-        }
-        else if (addr == 0x1000F010 || addr == 0x1000F000)
-        {
-            intc->write(addr, data);
-            return;
-        }
-        else if (addr == 0x1F80141C)
-            return;
         else if (addr >= 0x1C000000 && addr <= 0x1C200000)
         {
             *(uint32_t*)&iopRam[addr - 0x1C000000] = data;
-            return;
-        }
-        else if (addr >= 0x10008000 && addr < 0x1000E000)
-        {
-            dmac->write_channel(addr, data);
-            return;
-        }
-        switch (addr)
-        {
-        case 0x10003000:
-        case 0x10003010:
-        case 0x10003020:
-        case 0x10003030:
-        case 0x10003040:
-        case 0x10003050:
-        case 0x10003060:
-        case 0x10003070:
-        case 0x10003080:
-        case 0x10003090:
-        case 0x100030A0:
-            gif->write(addr, data);
-            return;
-        case 0x1000E000 ... 0x1000E060:
-            dmac->write_global(addr, data);
-            return;
-        case 0x1000F590:
-            dmac->write_enabler(addr, data);
-            return;
-        case 0x10003C00:
-        case 0x10003C10:
-        case 0x10003C20:
-        case 0x10003C30:
-            vif[1]->write(addr, data);
-            return;
-        case 0x10003810:
-        case 0x10003820:
-        case 0x10003830:
-            vif[0]->write(addr, data);
-            return;
-        case 0x10002000:
-        case 0x10002010:
-            ipu->write(addr, data);
+            if (ee_iop_ram_written)
+                ee_iop_ram_written(addr - 0x1C000000);
+            else
+                check_iop_code_write(addr - 0x1C000000);
             return;
         }
     }
@@ -402,16 +644,8 @@ void Bus::Write32(uint32_t addr, uint32_t data, bool ee)
             *(uint32_t*)&iopScratchpad[addr - iop_scratchpad_start] = data;
             return;
         }
-        if (addr == 0x1F802070)
-        {
-            return;
-        }
         switch (addr)
         {
-        case 0x1F808200 ... 0x1F808260:
-        case 0x1F808268:
-            sio2->write(addr, data);
-            return;
         case 0x1F801004:
         case 0x1F80100C:
         case 0x1F801010:
@@ -426,7 +660,6 @@ void Bus::Write32(uint32_t addr, uint32_t data, bool ee)
         case 0x1F801410:
         case 0x1F801414:
         case 0x1F801418:
-        case 0x1F80141C:
         case 0x1F801420:
         case 0x1F802070:
         case 0x1F801060:
@@ -443,11 +676,15 @@ void Bus::Write32(uint32_t addr, uint32_t data, bool ee)
     exit(1);
 }
 
-void Bus::Write64(uint32_t addr, uint64_t data, bool ee)
+void Bus::Write64Slow(uint32_t addr, uint64_t data, bool ee)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->write64)
+        return handler->write64(addr, data);
+
     if (addr < 0x2000000 && ee)
     {
+        check_code_write(addr);
         *(uint64_t*)&eeRam[addr] = data;
         return;
     }
@@ -456,88 +693,219 @@ void Bus::Write64(uint32_t addr, uint64_t data, bool ee)
         *(uint64_t*)&eeScratchpad[addr - 0x70000000] = data;
         return;
     }
-    if (addr >= 0x12000000 && addr <= 0x12001080)
-    {
-        gs->write_priv(addr, data);
-        return;
-    }
-    if ((addr == 0x1000F000 || addr == 0x1000F010) && ee)
-    {
-        intc->write(addr, data);
-        return;
-    }
-    if (addr >= 0x11000000 && addr < 0x11010000)
-    {
-        bool vid = addr & 0x8000;
-        bool memory = addr & 0x4000;
-
-        if (memory)
-            vu[vid]->write<Memory::Data, uint64_t>(addr, data);
-        else
-            vu[vid]->write<Memory::Code, uint64_t>(addr, data);
-        return;
-    }
-    switch (addr)
-    {
-    case 0x10002000:
-    case 0x10002010:
-        ipu->write(addr, data);
-        return;
-    }
     printf("[BUS]: Write64 to unknown addr 0x%08X\n", addr);
     exit(1);
 }
 
-void Bus::Write128(uint32_t addr, Register data)
+void Bus::Write128Slow(uint32_t addr, Register data)
 {
     addr = TranslateAddr(addr);
+    if (auto handler = find_mmio(addr); handler && handler->write128)
+        return handler->write128(addr, *(uint128_t*)data.ud);
+
     if (addr < 0x2000000)
     {
+        check_code_write(addr);
         *(Register*)&eeRam[addr] = data;
         return;
     }
-    if (addr == 0x10006000)
+    if (addr >= 0x70000000 && addr < 0x70004000)
     {
         uint128_t val = *(uint128_t*)data.ud;
-        gif->write_path3(addr, val);
+        *(uint128_t*)&eeScratchpad[addr - 0x70000000] = val;
         return;
     }
-    if (addr >= 0x11000000 && addr < 0x11010000)
+    printf("[BUS]: Write128 to unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+void Bus::map_iop_pages()
+{
+    for (int i = 0; i < 1024; i++)
     {
-        bool vid = addr & 0x8000;
-        bool memory = addr & 0x4000;
-        uint128_t val = *(uint128_t*)data.ud;
+        iop_read_table[i] = empty_table;
+        iop_write_table[i] = empty_table;
+    }
 
-        if (memory)
-            vu[vid]->write<Memory::Data, uint128_t>(addr, val);
-        else
-            vu[vid]->write<Memory::Code, uint128_t>(addr, val);
-        return;
+    for (uint32_t vpage = 0; vpage < 0x100000; vpage++)
+    {
+        uint32_t vaddr = vpage << 12;
+        uint32_t paddr = iop_translate(vaddr);
+
+        uint8_t* read = nullptr;
+        bool writable = true;
+        if (paddr < 0x200000)
+            read = &iopRam[paddr];
+        else if (paddr >= 0x1F800000 && paddr < 0x1F801000)
+            read = iopScratchpad;
+        else if (paddr >= 0x1FC00000 && paddr < 0x20000000)
+        {
+            read = &bios[paddr - 0x1FC00000];
+            writable = false;
+        }
+
+        if (!read)
+            continue;
+
+        uint32_t dir = vaddr >> 22;
+        if (iop_read_table[dir] == empty_table)
+        {
+            tables.push_back(std::make_unique<uint8_t*[]>(1024));
+            iop_read_table[dir] = tables.back().get();
+            tables.push_back(std::make_unique<uint8_t*[]>(1024));
+            iop_write_table[dir] = tables.back().get();
+        }
+
+        iop_read_table[dir][vpage & 0x3FF] = read;
+        iop_write_table[dir][vpage & 0x3FF] = writable ? read : nullptr;
     }
-    if (addr == 0x10005000)
+}
+
+/* Maps or unmaps a physical iopRam page in all three segments */
+void Bus::set_iop_page_writable(uint32_t page, bool writable)
+{
+    uint32_t paddr = page << 12;
+    for (uint32_t segment : { 0x00000000u, 0x80000000u, 0xA0000000u })
     {
-        uint128_t val = *(uint128_t*)data.ud;
-        vif[1]->write_fifo<uint128_t>(addr, val);
-        return;
+        uint32_t vaddr = segment | paddr;
+        iop_write_table[vaddr >> 22][(vaddr >> 12) & 0x3FF] = writable ? &iopRam[paddr] : nullptr;
     }
-    if (addr == 0x10004000)
+}
+
+void Bus::register_iop_mmio(uint32_t start, uint32_t end, MMIOHandler handler)
+{
+    iop_mmio_handlers.push_back(std::move(handler));
+    uint16_t index = iop_mmio_handlers.size();
+
+    for (uint32_t addr = start; addr < end; addr += 4)
     {
-        uint128_t val = *(uint128_t*)data.ud;
-        vif[0]->write_fifo<uint128_t>(addr, val);
+        auto& slots = iop_mmio_pages[addr >> 12];
+        if (!slots)
+            slots = std::make_unique<uint16_t[]>(1024);
+
+        slots[(addr & 0xFFF) >> 2] = index;
+    }
+}
+
+void Bus::map_iop_registers()
+{
+    /* POST2, the BIOS reports boot progress here */
+    register_iop_mmio(0x1F802070, 0x1F802074,
+    {
+        .write8 = [](uint32_t, uint8_t) {},
+        .write32 = [](uint32_t, uint32_t) {}
+    });
+
+    for (uint32_t addr : { 0x1F801010, 0x1F801450 })
+        register_iop_mmio(addr, addr + 4, { .read32 = [](uint32_t) -> uint32_t { return 0x20; } });
+
+    register_iop_mmio(0x1F801070, 0x1F80107C,
+    {
+        .read32 = [this](uint32_t addr) -> uint32_t
+        {
+            switch (addr)
+            {
+            case 0x1F801070:
+                return iop_intc->read_istat();
+            case 0x1F801074:
+                return iop_intc->read_imask();
+            default:
+                return iop_intc->read_ictrl();
+            }
+        },
+        .write32 = [this](uint32_t addr, uint32_t data)
+        {
+            switch (addr)
+            {
+            case 0x1F801070:
+                iop_intc->write_istat(data);
+                break;
+            case 0x1F801074:
+                iop_intc->write_imask(data);
+                break;
+            default:
+                iop_intc->write_ictrl(data);
+                break;
+            }
+        }
+    });
+}
+
+uint8_t Bus::iop_read8_slow(uint32_t addr)
+{
+    addr = iop_translate(addr);
+    if (auto handler = find_iop_mmio(addr); handler && handler->read8)
+        return handler->read8(addr);
+
+    printf("[BUS]: Read8 from unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+uint16_t Bus::iop_read16_slow(uint32_t addr)
+{
+    addr = iop_translate(addr);
+    if (auto handler = find_iop_mmio(addr); handler && handler->read16)
+        return handler->read16(addr);
+
+    printf("[BUS]: Read16 from unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+uint32_t Bus::iop_read32_slow(uint32_t addr)
+{
+    addr = iop_translate(addr);
+    if (auto handler = find_iop_mmio(addr); handler && handler->read32)
+        return handler->read32(addr);
+
+    printf("[BUS]: Read32 from unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+/* RAM pages only end up here when they hold decoded code */
+void Bus::iop_write8_slow(uint32_t addr, uint8_t data)
+{
+    addr = iop_translate(addr);
+    if (addr < 0x200000)
+    {
+        check_iop_code_write(addr);
+        iopRam[addr] = data;
         return;
     }
-    if (addr == 0x10007010)
+    if (auto handler = find_iop_mmio(addr); handler && handler->write8)
+        return handler->write8(addr, data);
+
+    printf("[BUS]: Write8 to unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+void Bus::iop_write16_slow(uint32_t addr, uint16_t data)
+{
+    addr = iop_translate(addr);
+    if (addr < 0x200000)
     {
-        uint128_t val = *(uint128_t*)data.ud;
-        ipu->write_fifo(addr, val);
+        check_iop_code_write(addr);
+        *(uint16_t*)&iopRam[addr] = data;
         return;
     }
-    if (addr >= 0x70000000 && addr < 0x70004000)
+    if (auto handler = find_iop_mmio(addr); handler && handler->write16)
+        return handler->write16(addr, data);
+
+    printf("[BUS]: Write16 to unknown addr 0x%08X\n", addr);
+    exit(1);
+}
+
+void Bus::iop_write32_slow(uint32_t addr, uint32_t data)
+{
+    addr = iop_translate(addr);
+    if (addr < 0x200000)
     {
-        uint128_t val = *(uint128_t*)data.ud;
-        *(uint128_t*)&eeScratchpad[addr - 0x70000000] = val;
+        check_iop_code_write(addr);
+        *(uint32_t*)&iopRam[addr] = data;
         return;
     }
-    printf("[BUS]: Write128 to unknown addr 0x%08X\n", addr);
+    if (auto handler = find_iop_mmio(addr); handler && handler->write32)
+        return handler->write32(addr, data);
+
+    printf("[BUS]: Write32 to unknown addr 0x%08X\n", addr);
     exit(1);
-}
\ No newline at end of file
+}
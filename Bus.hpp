@@ -1,7 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <csignal>
 #include <string>
+#include <functional>
+#include <memory>
+#include <vector>
 #include <gs/gs.hpp>
 #include <intc.hpp>
 #include <ee_timers.hpp>
@@ -14,13 +18,41 @@
 #include <ipu.h>
 #include <sio2.h>
 #include <iop/iop_intc.hpp>
+#include <scheduler.hpp>
+
+/* Typed accessors for a range of memory mapped registers. Widths a
+   device doesn't implement stay empty and end up as unknown accesses */
+struct MMIOHandler
+{
+    std::function<uint8_t(uint32_t)> read8 = {};
+    std::function<uint16_t(uint32_t)> read16 = {};
+    std::function<uint32_t(uint32_t)> read32 = {};
+    std::function<uint64_t(uint32_t)> read64 = {};
+    std::function<uint128_t(uint32_t)> read128 = {};
+    std::function<void(uint32_t, uint8_t)> write8 = {};
+    std::function<void(uint32_t, uint16_t)> write16 = {};
+    std::function<void(uint32_t, uint32_t)> write32 = {};
+    std::function<void(uint32_t, uint64_t)> write64 = {};
+    std::function<void(uint32_t, uint128_t)> write128 = {};
+};
 
 class Bus
 {
 private:
-    uint8_t bios[0x400000];
-    uint8_t eeScratchpad[1024*16];
-    uint8_t iopScratchpad[1024];
+    /* RAM, BIOS and the scratchpad share one memfd backed allocation so
+       that the fastmem arena can map extra views of the same memory */
+    static constexpr uint32_t RAM_OFFSET = 0;
+    static constexpr uint32_t BIOS_OFFSET = 0x2000000;
+    static constexpr uint32_t SCRATCHPAD_OFFSET = 0x2400000;
+    static constexpr uint32_t MEMORY_SIZE = 0x2404000;
+
+    int memory_fd = -1;
+    uint8_t* memory;
+    uint8_t* bios;
+    uint8_t* eeScratchpad;
+    /* Only the first 1KB exists, the rest pads it to a full page
+       so the IOP page table can point straight at it */
+    uint8_t iopScratchpad[0x1000];
     uint32_t iop_scratchpad_start = 0x1F800000;
 
     uint32_t KUSEG_MASKS[8] = 
@@ -40,6 +72,141 @@ private:
     uint8_t rdram_sdevid = 0;
     uint32_t ram_setting = 0;
 
+    /* Called on every slow path EE store into RAM/BIOS so decoded code can be dropped */
+    void check_code_write(uint32_t addr)
+    {
+        uint32_t page = addr >> 12;
+        if (ee_code_pages[page])
+        {
+            ee_code_pages[page] = false;
+            set_page_writable(page, true);
+            ee_code_written(page);
+        }
+    }
+
+    /* Two level page table over the EE virtual address space with 4KB
+       pages. The first level is indexed by the top 10 bits, the second
+       by the next 10 and entries point straight at eeRam, bios or
+       eeScratchpad. A null entry means the access takes the slow path,
+       which is the case for MMIO, BIOS writes and pages holding code */
+    uint8_t** read_table[1024];
+    uint8_t** write_table[1024];
+    uint8_t* empty_table[1024] = {};
+    std::vector<std::unique_ptr<uint8_t*[]>> tables;
+
+    /* First level entries that alias each 4MB of RAM */
+    std::vector<uint32_t> ram_aliases[8];
+
+    void allocate_memory();
+    uint8_t* backing_memory(uint32_t paddr, bool& writable);
+    void map_pages();
+    void set_page_writable(uint32_t page, bool writable);
+
+    /* Fastmem accessors. Register usage and addressing mode are fixed so
+       the fault handler only has to recognize these exact encodings */
+    template <typename T>
+    T fastmem_read(uint32_t addr)
+    {
+        uint64_t value;
+        if constexpr (sizeof(T) == 1)
+            asm volatile("movzbl (%%rdx,%%rcx), %%eax" : "=a"(value) : "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else if constexpr (sizeof(T) == 2)
+            asm volatile("movzwl (%%rdx,%%rcx), %%eax" : "=a"(value) : "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else if constexpr (sizeof(T) == 4)
+            asm volatile("movl (%%rdx,%%rcx), %%eax" : "=a"(value) : "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else
+            asm volatile("movq (%%rdx,%%rcx), %%rax" : "=a"(value) : "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        return (T)value;
+    }
+
+    template <typename T>
+    void fastmem_write(uint32_t addr, T data)
+    {
+        uint64_t value = data;
+        if constexpr (sizeof(T) == 1)
+            asm volatile("movb %%al, (%%rdx,%%rcx)" : : "a"(value), "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else if constexpr (sizeof(T) == 2)
+            asm volatile("movw %%ax, (%%rdx,%%rcx)" : : "a"(value), "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else if constexpr (sizeof(T) == 4)
+            asm volatile("movl %%eax, (%%rdx,%%rcx)" : : "a"(value), "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+        else
+            asm volatile("movq %%rax, (%%rdx,%%rcx)" : : "a"(value), "d"(fastmem_base), "c"((uint64_t)addr) : "memory");
+    }
+
+    /* Device registers by physical 4KB page, then by 4 byte slot. Slots
+       hold an index into mmio_handlers plus one, zero means unmapped */
+    std::vector<MMIOHandler> mmio_handlers;
+    std::unique_ptr<uint16_t[]> mmio_pages[0x20000];
+
+    MMIOHandler* find_mmio(uint32_t paddr)
+    {
+        if (paddr >= 0x20000000 || !mmio_pages[paddr >> 12])
+            return nullptr;
+
+        uint16_t index = mmio_pages[paddr >> 12][(paddr & 0xFFF) >> 2];
+        return index ? &mmio_handlers[index - 1] : nullptr;
+    }
+
+    void map_registers();
+
+    /* IOP side equivalents. The page table is indexed by IOP virtual
+       address and covers iopRam, BIOS and the scratchpad through KUSEG,
+       KSEG0 and KSEG1. Misses go through a separate MMIO table since
+       the IOP sees different registers than the EE at the same addresses */
+    uint8_t** iop_read_table[1024];
+    uint8_t** iop_write_table[1024];
+
+    std::vector<MMIOHandler> iop_mmio_handlers;
+    std::unique_ptr<uint16_t[]> iop_mmio_pages[0x20000];
+
+    MMIOHandler* find_iop_mmio(uint32_t paddr)
+    {
+        if (paddr >= 0x20000000 || !iop_mmio_pages[paddr >> 12])
+            return nullptr;
+
+        uint16_t index = iop_mmio_pages[paddr >> 12][(paddr & 0xFFF) >> 2];
+        return index ? &iop_mmio_handlers[index - 1] : nullptr;
+    }
+
+    static uint32_t iop_translate(uint32_t addr)
+    {
+        /* KSEG0 and KSEG1 mirror the physical space, KUSEG and KSEG2 don't */
+        if (addr >= 0x80000000 && addr < 0xC0000000)
+            return addr & 0x1FFFFFFF;
+        return addr;
+    }
+
+    void map_iop_pages();
+    void map_iop_registers();
+    void set_iop_page_writable(uint32_t page, bool writable);
+
+    uint8_t* iop_read_page(uint32_t addr) { return iop_read_table[addr >> 22][(addr >> 12) & 0x3FF]; }
+    uint8_t* iop_write_page(uint32_t addr) { return iop_write_table[addr >> 22][(addr >> 12) & 0x3FF]; }
+
+    uint8_t iop_read8_slow(uint32_t addr);
+    uint16_t iop_read16_slow(uint32_t addr);
+    uint32_t iop_read32_slow(uint32_t addr);
+    void iop_write8_slow(uint32_t addr, uint8_t data);
+    void iop_write16_slow(uint32_t addr, uint16_t data);
+    void iop_write32_slow(uint32_t addr, uint32_t data);
+
+    bool handle_fastmem_fault(void* context);
+    static void fastmem_fault(int sig, siginfo_t* info, void* context);
+
+    uint8_t* read_page(uint32_t addr) { return read_table[addr >> 22][(addr >> 12) & 0x3FF]; }
+    uint8_t* write_page(uint32_t addr) { return write_table[addr >> 22][(addr >> 12) & 0x3FF]; }
+
+    uint8_t Read8Slow(uint32_t addr, bool ee);
+    uint16_t Read16Slow(uint32_t addr, bool ee);
+    uint32_t Read32Slow(uint32_t addr, bool ee);
+    uint64_t Read64Slow(uint32_t addr, bool ee);
+    Register Read128Slow(uint32_t addr);
+    void Write8Slow(uint32_t addr, uint8_t data, bool ee);
+    void Write16Slow(uint32_t addr, uint16_t data, bool ee);
+    void Write32Slow(uint32_t addr, uint32_t data, bool ee);
+    void Write64Slow(uint32_t addr, uint64_t data, bool ee);
+    void Write128Slow(uint32_t addr, Register data);
+public:
     uint32_t TranslateAddr(uint32_t addr)
     {
         if (addr >= 0x70000000 && addr <= 0x70004000)
@@ -49,8 +216,61 @@ private:
         else
             return addr & 0x1FFFFFFF;
     }
-public:
-    uint8_t eeRam[0x2000000];
+
+    /* Physical 4KB pages of IOP RAM the IOP has decoded code from */
+    bool iop_code_pages[0x200] = {};
+    std::function<void(uint32_t)> iop_code_written;
+
+    void check_iop_code_write(uint32_t addr)
+    {
+        uint32_t page = addr >> 12;
+        if (iop_code_pages[page])
+        {
+            iop_code_pages[page] = false;
+            set_iop_page_writable(page, true);
+            iop_code_written(page);
+        }
+    }
+
+    /* Set while the IOP runs on its own thread. EE stores into IOP RAM
+       are handed over instead of touching the IOP's code tracking */
+    std::function<void(uint32_t)> ee_iop_ram_written;
+
+    /* Takes the page out of the IOP write table so stores to it get caught */
+    void mark_iop_code_page(uint32_t page)
+    {
+        if (!iop_code_pages[page])
+        {
+            iop_code_pages[page] = true;
+            set_iop_page_writable(page, false);
+        }
+    }
+
+    /* Physical 4KB pages the EE has decoded code from */
+    bool ee_code_pages[0x20000] = {};
+    std::function<void(uint32_t)> ee_code_written;
+
+    /* Flags a physical page as holding decoded code, which takes it out
+       of the write page table so that stores to it can be caught */
+    void mark_code_page(uint32_t page)
+    {
+        if (!ee_code_pages[page])
+        {
+            ee_code_pages[page] = true;
+            set_page_writable(page, false);
+        }
+    }
+
+    /* For writes to EE RAM that don't go through the bus, like DMA */
+    void check_code_write_range(uint32_t addr, uint32_t size)
+    {
+        for (uint32_t page = addr >> 12; page <= (addr + size - 1) >> 12; page++)
+            check_code_write(page << 12);
+    }
+
+    uint8_t* scratchpad() const { return eeScratchpad; }
+
+    uint8_t* eeRam;
     uint8_t iopRam[0x200000];
     gs::GraphicsSynthesizer *gs;
     INTC* intc;
@@ -63,106 +283,183 @@ public:
     IPU* ipu;
     SIO2* sio2;
     IOP_INTC* iop_intc;
+    Scheduler scheduler;
     Bus(std::string biosFilePath, gs::GraphicsSynthesizer *gs);
+    ~Bus();
+
+    /* Optional 4GB host reservation mirroring the EE address space. RAM,
+       BIOS and scratchpad are mapped in, everything else is left
+       unmapped and reaches the devices through the SIGSEGV handler */
+    bool enable_fastmem();
+    uint8_t* fastmem_base = nullptr;
+    /* Routes accesses to the physical range [start, end) to the handler */
+    void register_mmio(uint32_t start, uint32_t end, MMIOHandler handler);
+
     void attachIntc(INTC* _intc) {intc = _intc;}
     void attachTimers(Timers* _timer) {timers = _timer;}
     void attachGIF(GIF* _gif) {gif = _gif;}
 
-    uint8_t Read8(uint32_t addr, bool ee);
-    uint16_t Read16(uint32_t addr, bool ee);
-    uint32_t Read32(uint32_t addr, bool ee);
-    uint64_t Read64(uint32_t addr, bool ee);
-    Register Read128(uint32_t addr);
-    void Write8(uint32_t addr, uint8_t data, bool ee);
-    void Write16(uint32_t addr, uint16_t data, bool ee);
-    void Write32(uint32_t addr, uint32_t data, bool ee);
-    void Write64(uint32_t addr, uint64_t data, bool ee);
-    void Write128(uint32_t addr, Register data);
+    uint8_t Read8(uint32_t addr, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_read<uint8_t>(addr);
+
+        uint8_t* page = read_page(addr);
+        if (ee && page)
+            return page[addr & 0xFFF];
+        return Read8Slow(addr, ee);
+    }
+
+    uint16_t Read16(uint32_t addr, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_read<uint16_t>(addr);
+
+        uint8_t* page = read_page(addr);
+        if (ee && page)
+            return *(uint16_t*)&page[addr & 0xFFF];
+        return Read16Slow(addr, ee);
+    }
+
+    uint32_t Read32(uint32_t addr, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_read<uint32_t>(addr);
+
+        uint8_t* page = read_page(addr);
+        if (ee && page)
+            return *(uint32_t*)&page[addr & 0xFFF];
+        return Read32Slow(addr, ee);
+    }
+
+    uint64_t Read64(uint32_t addr, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_read<uint64_t>(addr);
+
+        uint8_t* page = read_page(addr);
+        if (ee && page)
+            return *(uint64_t*)&page[addr & 0xFFF];
+        return Read64Slow(addr, ee);
+    }
+
+    Register Read128(uint32_t addr)
+    {
+        uint8_t* page = read_page(addr);
+        if (page)
+            return *(Register*)&page[addr & 0xFFF];
+        return Read128Slow(addr);
+    }
+
+    void Write8(uint32_t addr, uint8_t data, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_write<uint8_t>(addr, data);
+
+        uint8_t* page = write_page(addr);
+        if (ee && page)
+            page[addr & 0xFFF] = data;
+        else
+            Write8Slow(addr, data, ee);
+    }
+
+    void Write16(uint32_t addr, uint16_t data, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_write<uint16_t>(addr, data);
+
+        uint8_t* page = write_page(addr);
+        if (ee && page)
+            *(uint16_t*)&page[addr & 0xFFF] = data;
+        else
+            Write16Slow(addr, data, ee);
+    }
+
+    void Write32(uint32_t addr, uint32_t data, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_write<uint32_t>(addr, data);
+
+        uint8_t* page = write_page(addr);
+        if (ee && page)
+            *(uint32_t*)&page[addr & 0xFFF] = data;
+        else
+            Write32Slow(addr, data, ee);
+    }
+
+    void Write64(uint32_t addr, uint64_t data, bool ee)
+    {
+        if (ee && fastmem_base)
+            return fastmem_write<uint64_t>(addr, data);
+
+        uint8_t* page = write_page(addr);
+        if (ee && page)
+            *(uint64_t*)&page[addr & 0xFFF] = data;
+        else
+            Write64Slow(addr, data, ee);
+    }
+
+    void Write128(uint32_t addr, Register data)
+    {
+        uint8_t* page = write_page(addr);
+        if (page)
+            *(Register*)&page[addr & 0xFFF] = data;
+        else
+            Write128Slow(addr, data);
+    }
+
+    /* Routes IOP accesses to the physical range [start, end) to the handler */
+    void register_iop_mmio(uint32_t start, uint32_t end, MMIOHandler handler);
 
+    /* IOP accesses, addresses are IOP virtual addresses */
     uint8_t iop_read8(uint32_t addr)
     {
-        if (addr >= 0x1FC00000 && addr <= 0x20000000)
-            return bios[addr - 0x1FC00000];
-        if (addr < 0x00200000)
-            return iopRam[addr];
-        printf("[BUS]: Read8 from unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_read_page(addr);
+        if (page)
+            return page[addr & 0xFFF];
+        return iop_read8_slow(addr);
     }
 
     uint16_t iop_read16(uint32_t addr)
     {
-        if (addr >= 0x1FC00000 && addr <= 0x20000000)
-            return *(uint16_t*)&bios[addr - 0x1FC00000];
-        if (addr < 0x00200000)
-            return *(uint16_t*)&iopRam[addr];
-        printf("[BUS]: Read16 from unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_read_page(addr);
+        if (page)
+            return *(uint16_t*)&page[addr & 0xFFF];
+        return iop_read16_slow(addr);
     }
 
     uint32_t iop_read32(uint32_t addr)
     {
-        if (addr >= 0x1FC00000 && addr <= 0x20000000)
-            return *(uint32_t*)&bios[addr - 0x1FC00000];
-        if (addr < 0x00200000)
-            return *(uint32_t*)&iopRam[addr];
-        switch (addr)
-        {
-        case 0x1F801450:
-            return 0x20;
-        case 0x1F801010:
-            return 0x20;
-        case 0x1F801070:
-            return iop_intc->read_istat();
-        case 0x1F801074:
-            return iop_intc->read_imask();
-        case 0x1F801078:
-            return iop_intc->read_ictrl();
-        }
-        printf("[BUS]: Read32 from unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_read_page(addr);
+        if (page)
+            return *(uint32_t*)&page[addr & 0xFFF];
+        return iop_read32_slow(addr);
     }
 
     void iop_write8(uint32_t addr, uint8_t data)
     {
-        if (addr < 0x00200000)
-        {
-            iopRam[addr] = data;
-            return;
-        }
-        switch (addr)
-        {
-        case 0x1F802070:
-            return;
-        }
-        printf("[BUS]: Write8 to unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_write_page(addr);
+        if (page)
+            page[addr & 0xFFF] = data;
+        else
+            iop_write8_slow(addr, data);
     }
 
     void iop_write16(uint32_t addr, uint16_t data)
     {
-        printf("[BUS]: Write16 to unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_write_page(addr);
+        if (page)
+            *(uint16_t*)&page[addr & 0xFFF] = data;
+        else
+            iop_write16_slow(addr, data);
     }
 
     void iop_write32(uint32_t addr, uint32_t data)
     {
-        switch (addr)
-        {
-        case 0x1F802070: // POST2 (BIOS POST value)
-            return;
-        case 0xFFFE0130: // Cache control, irrelevant
-            return;
-        case 0x1F801070:
-            iop_intc->write_istat(data);
-            return;
-        case 0x1F801074:
-            iop_intc->write_imask(data);
-            return;
-        case 0x1F801078:
-            iop_intc->write_ictrl(data);
-            return;
-        }
-        printf("[BUS]: Write32 to unknown addr 0x%08X\n", addr);
-        exit(1);
+        uint8_t* page = iop_write_page(addr);
+        if (page)
+            *(uint32_t*)&page[addr & 0xFFF] = data;
+        else
+            iop_write32_slow(addr, data);
     }
 };
\ No newline at end of file
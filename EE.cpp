@@ -1,4 +1,5 @@
 #include <EE.hpp>
+#include <jit/ee_jit.hpp>
 #include <cstring>
 
 static inline float overflow_check(uint32_t value)
@@ -41,7 +42,7 @@ void EE_COP1::op_madd(Instruction instr)
 EmotionEngine::EmotionEngine(Bus* _bus)
 : bus(_bus),
 intc(INTC(this)),
-timers(Timers(&intc))
+timers(Timers(&intc, &_bus->scheduler))
 {
     pc = 0xBFC00000;
     std::memset(regs, 0, sizeof(regs));
@@ -50,10 +51,16 @@ timers(Timers(&intc))
     next_instr = {};
     next_instr.value = bus->Read32(pc, true);
     next_instr.pc = pc;
+    next_decoded = decode_full(next_instr.value);
+
+    /* Drop any decoded blocks when the code under them is overwritten */
+    bus->ee_code_written = [this](uint32_t page) { invalidate_page(page); };
 
     regs[0].ud[0] = 0;
 }
 
+EmotionEngine::~EmotionEngine() = default;
+
 std::string regNames[] =
 {
     "$zero",
@@ -92,87 +99,264 @@ std::string regNames[] =
 
 void EmotionEngine::Clock(uint32_t cycles)
 {
+    /* Take interrupts raised by scheduler events since the last slice */
+    if (intc.int_pending())
+    {
+        //printf("[EE] Interrupt!\n");
+        exception(Exception::Interrupt, true);
+    }
+
     cycles_to_execute = cycles;
-    for (int cycle = cycles; cycle > 0; cycle--)
+    if (jit)
+        instructions_retired += jit->run(cycles);
+    else
     {
-        instr = next_instr;
+        for (int cycle = cycles; cycle > 0; cycle--)
+            step();
+        instructions_retired += cycles;
+    }
+}
 
-        if (pc == 0x80001000)
-            printf("[EE]: Entering Kernel\n");
-        if (pc == 0x00081FC0)
-            printf("[EE]: Entering EENULL\n");
+void EmotionEngine::step()
+{
+    instr = next_instr;
+    decoded = next_decoded;
 
-        fetch_next();
+    if (pc == 0x80001000)
+        printf("[EE]: Entering Kernel\n");
+    if (pc == 0x00081FC0)
+        printf("[EE]: Entering EENULL\n");
+
+    fetch_next();
+
+    skip_branch_delay = false;
+    branch_taken = false;
 
-        skip_branch_delay = false;
-        branch_taken = false;
+    if (!decoded.handler)
+    {
+        //printf("[EE]: NOP\n");
+        return;
+    }
+
+    (this->*decoded.handler)();
 
-        if (instr.value == 0)
+    regs[0].ud[0] = 0;
+    cycles_to_execute--;
+    cop0.count += 1;
+}
+
+void EmotionEngine::enable_jit()
+{
+    jit = std::make_unique<EEJit>(this, bus);
+}
+
+EmotionEngine::Handler EmotionEngine::decode(uint32_t value)
+{
+    Instruction code;
+    code.value = value;
+
+    if (value == 0)
+        return nullptr;
+
+    switch (code.opcode)
+    {
+    case 0x00:
+    {
+        /* Resolve SPECIAL down to the final handler, anything
+           unknown still goes through special() to report it */
+        switch (code.r_type.funct)
         {
-            //printf("[EE]: NOP\n");
-            continue;
+        case 0x00: return &EmotionEngine::sll;
+        case 0x02: return &EmotionEngine::srl;
+        case 0x03: return &EmotionEngine::sra;
+        case 0x04: return &EmotionEngine::sllv;
+        case 0x06: return &EmotionEngine::srlv;
+        case 0x07: return &EmotionEngine::srav;
+        case 0x08: return &EmotionEngine::jr;
+        case 0x09: return &EmotionEngine::jalr;
+        case 0x0A: return &EmotionEngine::movz;
+        case 0x0B: return &EmotionEngine::movn;
+        case 0x0F: return &EmotionEngine::sync;
+        case 0x10: return &EmotionEngine::mfhi;
+        case 0x12: return &EmotionEngine::mflo;
+        case 0x14: return &EmotionEngine::dsllv;
+        case 0x17: return &EmotionEngine::dsrav;
+        case 0x18: return &EmotionEngine::mult;
+        case 0x1A: return &EmotionEngine::div;
+        case 0x1B: return &EmotionEngine::divu;
+        case 0x21: return &EmotionEngine::addu;
+        case 0x23: return &EmotionEngine::subu;
+        case 0x24: return &EmotionEngine::op_and;
+        case 0x25: return &EmotionEngine::op_or;
+        case 0x27: return &EmotionEngine::nor;
+        case 0x2A: return &EmotionEngine::slt;
+        case 0x2B: return &EmotionEngine::sltu;
+        case 0x2D: return &EmotionEngine::daddu;
+        case 0x38: return &EmotionEngine::dsll;
+        case 0x3A: return &EmotionEngine::dsrl;
+        case 0x3C: return &EmotionEngine::dsll32;
+        case 0x3E: return &EmotionEngine::dsrl32;
+        case 0x3F: return &EmotionEngine::dsra32;
+        default: return &EmotionEngine::special;
         }
-        
-        switch (instr.opcode)
+    }
+    case 0x01:
+    {
+        switch (code.i_type.rt)
         {
-        case 0x00: special(); break;
-        case 0x01: regimm(); break;
-        case 0x02: j(); break;
-        case 0x03: jal(); break;
-        case 0x04: beq(); break;
-        case 0x05: bne(); break;
-        case 0x06: blez(); break;
-        case 0x07: bgtz(); break;
-        case 0x09: addiu(); break;
-        case 0x0A: slti(); break;
-        case 0x0B: sltiu(); break;
-        case 0x0C: andi(); break;
-        case 0x0D: ori(); break;
-        case 0x0E: xori(); break;
-        case 0x0F: lui(); break;
-        case 0x10: op_cop0(); break;
-        case 0x11: op_cop1(); break;
-        case 0x12: op_cop2(); break;
-        case 0x14: beql(); break;
-        case 0x15: bnel(); break;
-        case 0x19: daddiu(); break;
-        case 0x1A: ldl(); break;
-        case 0x1B: ldr(); break;
-        case 0x1C: mmi(); break;
-        case 0x1E: lq(); break;
-        case 0x1F: sq(); break;
-        case 0x20: lb(); break;
-        case 0x21: lh(); break;
-        case 0x23: lw(); break;
-        case 0x24: lbu(); break;
-        case 0x25: lhu(); break;
-        case 0x27: lwu(); break;
-        case 0x28: sb(); break;
-        case 0x29: sh(); break;
-        case 0x2B: sw(); break;
-        case 0x2C: sdl(); break;
-        case 0x2D: sdr(); break;
-        case 0x2F: cache(); break;
-        case 0x37: ld(); break;
-        case 0x39: swc1(); break;
-        case 0x3F: sd(); break;
-        default:
-            printf("[EE]: Unimplemented 0x%02X\n", instr.opcode);
-            exit(1);
+        case 0x00: return &EmotionEngine::bltz;
+        case 0x01: return &EmotionEngine::bgez;
+        default: return &EmotionEngine::regimm;
         }
+    }
+    case 0x02: return &EmotionEngine::j;
+    case 0x03: return &EmotionEngine::jal;
+    case 0x04: return &EmotionEngine::beq;
+    case 0x05: return &EmotionEngine::bne;
+    case 0x06: return &EmotionEngine::blez;
+    case 0x07: return &EmotionEngine::bgtz;
+    case 0x09: return &EmotionEngine::addiu;
+    case 0x0A: return &EmotionEngine::slti;
+    case 0x0B: return &EmotionEngine::sltiu;
+    case 0x0C: return &EmotionEngine::andi;
+    case 0x0D: return &EmotionEngine::ori;
+    case 0x0E: return &EmotionEngine::xori;
+    case 0x0F: return &EmotionEngine::lui;
+    case 0x10: return &EmotionEngine::op_cop0;
+    case 0x11: return &EmotionEngine::op_cop1;
+    case 0x12: return &EmotionEngine::op_cop2;
+    case 0x14: return &EmotionEngine::beql;
+    case 0x15: return &EmotionEngine::bnel;
+    case 0x19: return &EmotionEngine::daddiu;
+    case 0x1A: return &EmotionEngine::ldl;
+    case 0x1B: return &EmotionEngine::ldr;
+    case 0x1C: return &EmotionEngine::mmi;
+    case 0x1E: return &EmotionEngine::lq;
+    case 0x1F: return &EmotionEngine::sq;
+    case 0x20: return &EmotionEngine::lb;
+    case 0x21: return &EmotionEngine::lh;
+    case 0x23: return &EmotionEngine::lw;
+    case 0x24: return &EmotionEngine::lbu;
+    case 0x25: return &EmotionEngine::lhu;
+    case 0x27: return &EmotionEngine::lwu;
+    case 0x28: return &EmotionEngine::sb;
+    case 0x29: return &EmotionEngine::sh;
+    case 0x2B: return &EmotionEngine::sw;
+    case 0x2C: return &EmotionEngine::sdl;
+    case 0x2D: return &EmotionEngine::sdr;
+    case 0x2F: return &EmotionEngine::cache;
+    case 0x37: return &EmotionEngine::ld;
+    case 0x39: return &EmotionEngine::swc1;
+    case 0x3F: return &EmotionEngine::sd;
+    default: return &EmotionEngine::unknown;
+    }
+}
 
-        regs[0].ud[0] = 0;
-        cycles_to_execute--;
-        cop0.count += 1;
+EEDecodedInstr EmotionEngine::decode_full(uint32_t value)
+{
+    Instruction code;
+    code.value = value;
+
+    EEDecodedInstr decoded;
+    decoded.value = value;
+    decoded.handler = decode(value);
+    decoded.rs = code.r_type.rs;
+    decoded.rt = code.r_type.rt;
+    decoded.rd = code.r_type.rd;
+    decoded.sa = code.r_type.sa;
+    decoded.imm = (int16_t)code.i_type.immediate;
+
+    return decoded;
+}
+
+bool EmotionEngine::ends_block(uint32_t value)
+{
+    Instruction code;
+    code.value = value;
+
+    switch (code.opcode)
+    {
+    case 0x00:
+        /* JR, JALR, SYSCALL, BREAK */
+        switch (code.r_type.funct)
+        {
+        case 0x08: case 0x09: case 0x0C: case 0x0D:
+            return true;
+        }
+        return false;
+    case 0x01: /* REGIMM branches */
+    case 0x02 ... 0x07: /* J, JAL, BEQ, BNE, BLEZ, BGTZ */
+    case 0x14 ... 0x17: /* Branch likely */
+        return true;
+    case 0x10: /* ERET */
+        return value == 0x42000018;
     }
-    
-    timers.tick(cycles / 2);
 
-    if (intc.int_pending())
+    return false;
+}
+
+EEBlock* EmotionEngine::lookup_block(uint32_t vaddr)
+{
+    uint32_t paddr = bus->TranslateAddr(vaddr);
+    cur_index = 0;
+
+    /* Only RAM and BIOS are cached, everything else is fetched every time */
+    bool ram = paddr < 0x2000000;
+    bool bios = paddr >= 0x1FC00000 && paddr < 0x20000000;
+    if ((!ram && !bios) || (vaddr & 0x3))
+        return nullptr;
+
+    auto it = blocks.find(paddr);
+    if (it != blocks.end())
+        return it->second.get();
+
+    /* Decode a new block up to the first branch delay slot or the page end */
+    auto block = std::make_unique<EEBlock>();
+    block->start = paddr;
+
+    uint32_t page = paddr >> 12;
+    bool delay_slot = false;
+    for (uint32_t addr = paddr; (addr >> 12) == page; addr += 4)
     {
-        //printf("[EE] Interrupt!\n");
-        exception(Exception::Interrupt, true);
+        uint32_t value = bus->Read32(addr, true);
+        block->instrs.push_back(decode_full(value));
+
+        if (delay_slot)
+            break;
+        delay_slot = ends_block(value);
     }
+
+    bus->mark_code_page(page);
+    page_blocks[page].push_back(paddr);
+
+    auto ptr = block.get();
+    blocks[paddr] = std::move(block);
+    return ptr;
+}
+
+void EmotionEngine::invalidate_page(uint32_t page)
+{
+    if (jit)
+        jit->invalidate_page(page);
+
+    auto it = page_blocks.find(page);
+    if (it == page_blocks.end())
+        return;
+
+    for (auto start : it->second)
+    {
+        if (cur_block && cur_block->start == start)
+            cur_block = nullptr;
+        blocks.erase(start);
+    }
+
+    page_blocks.erase(it);
+}
+
+void EmotionEngine::unknown()
+{
+    printf("[EE]: Unimplemented 0x%02X\n", instr.opcode);
+    exit(1);
 }
 
 void EmotionEngine::special()
@@ -280,7 +464,7 @@ void EmotionEngine::special()
 
 void EmotionEngine::regimm()
 {
-    uint16_t type = (instr.value >> 16) & 0x1F;
+    uint16_t type = decoded.rt;
     switch (type)
     {
     case 0x00:
@@ -297,8 +481,8 @@ void EmotionEngine::regimm()
 
 void EmotionEngine::bltz()
 {
-    int32_t imm = (int16_t)instr.i_type.immediate;
-    uint16_t rs = instr.i_type.rs;
+    int32_t imm = decoded.imm;
+    uint16_t rs = decoded.rs;
 
     int32_t offset = imm << 2;
     int64_t reg = regs[rs].ud[0];
@@ -314,8 +498,8 @@ void EmotionEngine::bltz()
 
 void EmotionEngine::bgez()
 {
-    int32_t imm = (int16_t)instr.i_type.immediate;
-    uint16_t rs = instr.i_type.rs;
+    int32_t imm = decoded.imm;
+    uint16_t rs = decoded.rs;
 
     int32_t offset = imm << 2;
     int64_t reg = (int64_t)regs[rs].ud[0];
@@ -353,10 +537,10 @@ void EmotionEngine::jal()
 
 void EmotionEngine::beq()
 {
-    uint8_t rs = instr.i_type.rs;
-    uint8_t rt = instr.i_type.rt;
+    uint8_t rs = decoded.rs;
+    uint8_t rt = decoded.rt;
 
-    int64_t imm = (int16_t)instr.i_type.immediate;
+    int64_t imm = decoded.imm;
 
     int32_t offset = imm << 2;
     //printf("[EE]: BEQ %s (0x%08lX), %s, 0x%08X\n", regNames[rs].c_str(), regs[rs].ud[0], regNames[rt].c_str(), instr.pc + offset + 4);
@@ -370,9 +554,9 @@ void EmotionEngine::beq()
 
 void EmotionEngine::bne()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    int32_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    int32_t imm = decoded.imm;
 
     //printf("[EE]: BNE %s, %s, 0x%08X (%s)\n", regNames[rt].c_str(), regNames[rs].c_str(), instr.pc + 4 + (imm << 2), regs[rs].ud[0] != regs[rt].ud[0] ? "taken" : "ignored");
 
@@ -388,8 +572,8 @@ void EmotionEngine::bne()
 
 void EmotionEngine::blez()
 {
-    int32_t imm = (int16_t)instr.i_type.immediate;
-    uint16_t rs = instr.i_type.rs;
+    int32_t imm = decoded.imm;
+    uint16_t rs = decoded.rs;
 
     int32_t offset = imm << 2;
     //printf("[EE]: BLEZ 0x%08X\n", instr.pc + 4 + offset);
@@ -404,8 +588,8 @@ void EmotionEngine::blez()
 
 void EmotionEngine::bgtz()
 {
-    int32_t imm = (int16_t)instr.i_type.immediate;
-    uint16_t rs = instr.i_type.rs;
+    int32_t imm = decoded.imm;
+    uint16_t rs = decoded.rs;
 
     int32_t offset = imm << 2;
     //printf("[EE]: BGTZ 0x%08X\n", instr.pc + 4 + offset);
@@ -420,9 +604,9 @@ void EmotionEngine::bgtz()
 
 void EmotionEngine::addiu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    int16_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    int32_t imm = decoded.imm;
 
     int32_t result = regs[rs].ud[0] + imm;
     regs[rt].ud[0] = result;
@@ -432,10 +616,10 @@ void EmotionEngine::addiu()
 
 void EmotionEngine::slti()
 {
-    uint8_t rs = instr.i_type.rs;
-    uint8_t rt = instr.i_type.rt;
+    uint8_t rs = decoded.rs;
+    uint8_t rt = decoded.rt;
 
-    int64_t imm = (int16_t)instr.i_type.immediate;
+    int64_t imm = decoded.imm;
 
     int64_t reg = regs[rs].ud[0];
     regs[rt].ud[0] = reg < imm;
@@ -445,9 +629,9 @@ void EmotionEngine::slti()
 
 void EmotionEngine::sltiu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    uint64_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint64_t imm = decoded.imm;
 
     regs[rt].ud[0] = regs[rs].ud[0] < imm;
 
@@ -456,9 +640,9 @@ void EmotionEngine::sltiu()
 
 void EmotionEngine::andi()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    uint64_t imm = instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint64_t imm = decoded.imm & 0xFFFF;
 
     regs[rt].ud[0] = regs[rs].ud[0] & imm;
     //printf("[EE]: ANDI %s, %s, 0x%08lX\n", regNames[rt].c_str(), regNames[rs].c_str(), imm);
@@ -466,9 +650,9 @@ void EmotionEngine::andi()
 
 void EmotionEngine::ori()
 {
-    uint16_t rs = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    uint16_t imm = instr.i_type.immediate;
+    uint16_t rs = decoded.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t imm = decoded.imm & 0xFFFF;
 
     //printf("[EE]: ORI %s, %s, 0x%08X\n", regNames[rt].c_str(), regNames[rs].c_str(), imm);
 
@@ -477,9 +661,9 @@ void EmotionEngine::ori()
 
 void EmotionEngine::xori()
 {
-    uint16_t rs = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    uint16_t imm = instr.i_type.immediate;
+    uint16_t rs = decoded.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t imm = decoded.imm & 0xFFFF;
 
     //printf("[EE]: XORI %s, %s, 0x%08X\n", regNames[rt].c_str(), regNames[rs].c_str(), imm);
 
@@ -488,8 +672,8 @@ void EmotionEngine::xori()
 
 void EmotionEngine::lui()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint32_t imm = instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint32_t imm = decoded.imm & 0xFFFF;
 
     regs[rt].ud[0] = (int32_t)(imm << 16);
 
@@ -498,7 +682,7 @@ void EmotionEngine::lui()
 
 void EmotionEngine::op_cop0()
 {
-    uint8_t fmt = instr.value >> 21 & 0x1F;
+    uint8_t fmt = decoded.rs;
 
     switch (fmt)
     {
@@ -508,8 +692,8 @@ void EmotionEngine::op_cop0()
         {
         case 0:
         {
-            uint16_t rd = (instr.value >> 11) & 0x1F;
-            uint16_t rt = (instr.value >> 16) & 0x1F;
+            uint16_t rd = decoded.rd;
+            uint16_t rt = decoded.rt;
 
             regs[rt].ud[0] = cop0.regs[rd];
             //printf("[EE]: MFC0 %s, $%d (0x%08X)\n", regNames[rt].c_str(), rd, cop0.regs[rd]);
@@ -523,8 +707,8 @@ void EmotionEngine::op_cop0()
     }
     case 4:
     {
-        uint16_t rt = (instr.value >> 16) & 0x1F;
-        uint16_t rd = (instr.value >> 11) & 0x1F;
+        uint16_t rt = decoded.rt;
+        uint16_t rd = decoded.rd;
 
         cop0.regs[rd] = regs[rt].uw[0];
         //printf("[EE]: MTC0 $%d, %s\n", rd, regNames[rt].c_str());
@@ -552,7 +736,7 @@ void EmotionEngine::op_cop0()
 
 void EmotionEngine::op_cop1()
 {
-    uint32_t fmt = (instr.value >> 21) & 0x1F;
+    uint32_t fmt = decoded.rs;
     switch (fmt)
     {
     case 0x04:
@@ -572,16 +756,16 @@ void EmotionEngine::op_cop1()
 
 void EmotionEngine::mtc1()
 {
-    uint16_t fs = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t fs = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     cop1.fpr[fs].uint = regs[rt].uw[0];
 }
 
 void EmotionEngine::ctc1()
 {
-    uint16_t fs = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t fs = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     switch (fs)
     {
@@ -592,7 +776,7 @@ void EmotionEngine::ctc1()
 
 void EmotionEngine::op_cop2()
 {
-    uint32_t fmt = (instr.value >> 21) & 0x1F;
+    uint32_t fmt = decoded.rs;
     auto& vu0 = bus->vu[0];
 
     switch (fmt)
@@ -620,9 +804,9 @@ void EmotionEngine::op_cop2()
 
 void EmotionEngine::beql()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    int32_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    int32_t imm = decoded.imm;
 
     int32_t offset = imm << 2;
 
@@ -642,9 +826,9 @@ void EmotionEngine::beql()
 
 void EmotionEngine::bnel()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
-    int32_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    int32_t imm = decoded.imm;
 
     int32_t offset = imm << 2;
 
@@ -664,9 +848,9 @@ void EmotionEngine::bnel()
 
 void EmotionEngine::daddiu()
 {
-    uint16_t rs = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rs = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     int64_t reg = regs[rs].ud[0];
     regs[rt].ud[0] = reg + offset;
@@ -681,9 +865,9 @@ void EmotionEngine::ldl()
     };
     static const uint8_t LDL_SHIFT[8] = { 56, 48, 40, 32, 24, 16, 8, 0 };
 
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t addr = offset + regs[base].uw[0];
     uint32_t aligned_addr = addr & ~0x7;
@@ -704,9 +888,9 @@ void EmotionEngine::ldr()
     static const uint8_t LDR_SHIFT[8] = { 0, 8, 16, 24, 32, 40, 48, 56 };
 
 
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t addr = offset + regs[base].uw[0];
     uint32_t aligned_addr = addr & ~0x7;
@@ -719,8 +903,8 @@ void EmotionEngine::ldr()
 
 void EmotionEngine::div()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
 
     int32_t reg1 = regs[rs].uw[0];
     int32_t reg2 = regs[rt].uw[0];
@@ -751,7 +935,7 @@ void EmotionEngine::mmi()
     {
     case 0x08:
     {
-        uint8_t subtype = (instr.value >> 6) & 0x1F;
+        uint8_t subtype = decoded.sa;
         switch (subtype)
         {
         default:
@@ -783,22 +967,22 @@ void EmotionEngine::mmi()
 
 void EmotionEngine::mmi2()
 {
-    switch (instr.r_type.sa)
+    switch (decoded.sa)
     {
     case 0x12:
         pand();
         break;
     default:
-        printf("[EE]: Unimplemented MMI2 opcode 0x%02X\n", instr.r_type.sa);
+        printf("[EE]: Unimplemented MMI2 opcode 0x%02X\n", decoded.sa);
         exit(1);
     }
 }
 
 void EmotionEngine::pand()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     regs[rd].ud[0] = regs[rs].ud[0] & regs[rt].ud[0];
     regs[rd].ud[1] = regs[rs].ud[1] & regs[rt].ud[1];
@@ -806,7 +990,7 @@ void EmotionEngine::pand()
 
 void EmotionEngine::mflo1()
 {
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rd = decoded.rd;
 
     regs[rd].ud[0] = lo1;
 
@@ -815,9 +999,9 @@ void EmotionEngine::mflo1()
 
 void EmotionEngine::mult1()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t reg1 = (int64_t)regs[rs].ud[0];
     int64_t reg2 = (int64_t)regs[rt].ud[0];
@@ -830,8 +1014,8 @@ void EmotionEngine::mult1()
 
 void EmotionEngine::div1()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
 
     int32_t reg1 = regs[rs].uw[0];
     int32_t reg2 = regs[rt].uw[0];
@@ -857,8 +1041,8 @@ void EmotionEngine::div1()
 
 void EmotionEngine::divu1()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
 
     if (regs[rt].uw[0] != 0)
     {
@@ -871,9 +1055,9 @@ void EmotionEngine::divu1()
 
 void EmotionEngine::lq()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t imm = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t imm = decoded.imm;
 
     uint32_t vaddr = regs[base].uw[0] + imm;
     regs[rt] = bus->Read128(vaddr);
@@ -881,9 +1065,9 @@ void EmotionEngine::lq()
 
 void EmotionEngine::sq()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     if ((vaddr & 0xF) != 0)
@@ -897,9 +1081,9 @@ void EmotionEngine::sq()
 
 void EmotionEngine::lb()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     regs[rt].ud[0] = bus->Read8(vaddr, true);
@@ -909,9 +1093,9 @@ void EmotionEngine::lb()
 
 void EmotionEngine::lh()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     if (vaddr & 0x1)
@@ -925,9 +1109,9 @@ void EmotionEngine::lh()
 
 void EmotionEngine::lw()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
 
@@ -945,9 +1129,9 @@ void EmotionEngine::lw()
 
 void EmotionEngine::lbu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     regs[rt].ud[0] = bus->Read8(vaddr, true);
@@ -957,9 +1141,9 @@ void EmotionEngine::lbu()
 
 void EmotionEngine::lhu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     if (vaddr & 0x1)
@@ -974,9 +1158,9 @@ void EmotionEngine::lhu()
 
 void EmotionEngine::lwu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
 
@@ -990,9 +1174,9 @@ void EmotionEngine::lwu()
 
 void EmotionEngine::sb()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     uint16_t data = regs[rt].uw[0] & 0xFF;
@@ -1003,9 +1187,9 @@ void EmotionEngine::sb()
 
 void EmotionEngine::sh()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     uint16_t data = regs[rt].uw[0] & 0xFFFF;
@@ -1022,9 +1206,9 @@ void EmotionEngine::sh()
 
 void EmotionEngine::sw()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     uint32_t data = regs[rt].uw[0];
@@ -1048,9 +1232,9 @@ void EmotionEngine::sdl()
     };
     static const uint8_t SDL_SHIFT[8] = { 56, 48, 40, 32, 24, 16, 8, 0 };
 
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t addr = offset + regs[base].uw[0];
     uint32_t aligned_addr = addr & ~0x7;
@@ -1070,9 +1254,9 @@ void EmotionEngine::sdr()
     };
     static const uint8_t SDR_SHIFT[8] = { 0, 8, 16, 24, 32, 40, 48, 56 };
     
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t addr = offset + regs[base].uw[0];
     uint32_t aligned_addr = addr & ~0x7;
@@ -1085,9 +1269,9 @@ void EmotionEngine::sdr()
 
 void EmotionEngine::ld()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t base = instr.i_type.rs;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t rt = decoded.rt;
+    uint16_t base = decoded.rs;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
 
@@ -1105,9 +1289,9 @@ void EmotionEngine::ld()
 
 void EmotionEngine::swc1()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t ft = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t ft = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     uint32_t data = cop1.fpr[ft].uint;
@@ -1117,9 +1301,9 @@ void EmotionEngine::swc1()
 
 void EmotionEngine::sd()
 {
-    uint16_t base = instr.i_type.rs;
-    uint16_t rt = instr.i_type.rt;
-    int16_t offset = (int16_t)instr.i_type.immediate;
+    uint16_t base = decoded.rs;
+    uint16_t rt = decoded.rt;
+    int32_t offset = decoded.imm;
 
     uint32_t vaddr = offset + regs[base].uw[0];
     uint64_t data = regs[rt].ud[0];
@@ -1139,9 +1323,9 @@ void EmotionEngine::sd()
 
 void EmotionEngine::sll()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t sa = instr.r_type.sa;
+    uint16_t rt = decoded.rt;
+    uint16_t rd = decoded.rd;
+    uint16_t sa = decoded.sa;
 
     regs[rd].ud[0] = (uint64_t)(int32_t)(regs[rt].uw[0] << sa);
 
@@ -1150,9 +1334,9 @@ void EmotionEngine::sll()
 
 void EmotionEngine::srl()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     regs[rd].ud[0] = (int32_t)(regs[rt].uw[0] >> sa);
 
@@ -1161,9 +1345,9 @@ void EmotionEngine::srl()
 
 void EmotionEngine::sra()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     int32_t reg = (int32_t)regs[rt].uw[0];
     regs[rd].ud[0] = reg >> sa;
@@ -1173,9 +1357,9 @@ void EmotionEngine::sra()
 
 void EmotionEngine::sllv()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     uint32_t reg = regs[rt].uw[0];
     uint16_t sa = regs[rs].uw[0] & 0x3F;
@@ -1184,9 +1368,9 @@ void EmotionEngine::sllv()
 
 void EmotionEngine::srlv()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     uint16_t sa = regs[rs].uw[0] & 0x3F;
     regs[rd].ud[0] = (int32_t)(regs[rt].uw[0] >> sa);
@@ -1194,9 +1378,9 @@ void EmotionEngine::srlv()
 
 void EmotionEngine::srav()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     int32_t reg = (int32_t)regs[rt].uw[0];
     uint16_t sa = regs[rs].uw[0] & 0x3F;
@@ -1205,7 +1389,7 @@ void EmotionEngine::srav()
 
 void EmotionEngine::jr()
 {
-    uint16_t rs = instr.i_type.rs;
+    uint16_t rs = decoded.rs;
     pc = regs[rs].uw[0];
 
     next_instr.is_delay_slot = true;
@@ -1216,8 +1400,8 @@ void EmotionEngine::jr()
 
 void EmotionEngine::jalr()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     pc = regs[rs].uw[0];
     regs[rd].ud[0] = instr.pc + 8;
@@ -1227,9 +1411,9 @@ void EmotionEngine::jalr()
 
 void EmotionEngine::movz()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     if (regs[rt].ud[0] == 0) regs[rd].ud[0] = regs[rs].ud[0];
 
@@ -1238,9 +1422,9 @@ void EmotionEngine::movz()
 
 void EmotionEngine::movn()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     if (regs[rt].ud[0] != 0) regs[rd].ud[0] = regs[rs].ud[0];
 
@@ -1254,9 +1438,9 @@ void EmotionEngine::sync()
 
 void EmotionEngine::dsllv()
 {
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     uint64_t reg = regs[rt].ud[0];
     uint16_t sa = regs[rs].uw[0] & 0x3F;
@@ -1265,9 +1449,9 @@ void EmotionEngine::dsllv()
 
 void EmotionEngine::dsrav()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t reg = (int64_t)regs[rt].ud[0];
     uint16_t sa = regs[rs].uw[0] & 0x3F;
@@ -1278,9 +1462,9 @@ void EmotionEngine::dsrav()
 
 void EmotionEngine::mult()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t reg1 = (int64_t)regs[rs].ud[0];
     int64_t reg2 = (int64_t)regs[rt].ud[0];
@@ -1294,7 +1478,7 @@ void EmotionEngine::mult()
 
 void EmotionEngine::mfhi()
 {
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rd = decoded.rd;
 
     regs[rd].ud[0] = hi0;
     //printf("[EE]: MFHI %s\n", regNames[rd].c_str());
@@ -1302,7 +1486,7 @@ void EmotionEngine::mfhi()
 
 void EmotionEngine::mflo()
 {
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rd = decoded.rd;
     regs[rd].ud[0] = lo0;
 
     //printf("[EE]: MFLO %s\n", regNames[rd].c_str());
@@ -1310,8 +1494,8 @@ void EmotionEngine::mflo()
 
 void EmotionEngine::divu()
 {
-    uint16_t rt = instr.i_type.rt;
-    uint16_t rs = instr.i_type.rs;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
 
     if (regs[rt].uw[0] == 0)
     {
@@ -1329,9 +1513,9 @@ void EmotionEngine::divu()
 
 void EmotionEngine::subu()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int32_t reg1 = regs[rs].uw[0];
     int32_t reg2 = regs[rt].uw[0];
@@ -1341,9 +1525,9 @@ void EmotionEngine::subu()
 
 void EmotionEngine::addu()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
     
     int32_t result = regs[rs].ud[0] + regs[rt].ud[0];
     regs[rd].ud[0] = result;
@@ -1353,9 +1537,9 @@ void EmotionEngine::addu()
 
 void EmotionEngine::op_and()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     regs[rd].ud[0] = regs[rs].ud[0] & regs[rt].ud[0];
 
@@ -1364,9 +1548,9 @@ void EmotionEngine::op_and()
 
 void EmotionEngine::op_or()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     //printf("[EE]: OR %s, %s, %s\n", regNames[rd].c_str(), regNames[rs].c_str(), regNames[rt].c_str());
 
@@ -1375,18 +1559,18 @@ void EmotionEngine::op_or()
 
 void EmotionEngine::nor()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     regs[rd].ud[0] = ~(regs[rs].ud[0] | regs[rt].ud[0]);
 }
 
 void EmotionEngine::slt()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t reg1 = regs[rs].ud[0];
     int64_t reg2 = regs[rt].ud[0];
@@ -1397,9 +1581,9 @@ void EmotionEngine::slt()
 
 void EmotionEngine::sltu()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     //printf("[EE]: SLTU %s, %s, %s (0x%lX)\n", regNames[rd].c_str(), regNames[rs].c_str(), regNames[rt].c_str(), regs[rt].ud[0]);
     regs[rd].ud[0] = regs[rs].ud[0] < regs[rt].ud[0];
@@ -1407,9 +1591,9 @@ void EmotionEngine::sltu()
 
 void EmotionEngine::daddu()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t reg1 = regs[rs].ud[0];
     int64_t reg2 = regs[rt].ud[0];
@@ -1420,9 +1604,9 @@ void EmotionEngine::daddu()
 
 void EmotionEngine::dadd()
 {
-    uint16_t rt = instr.r_type.rt;
-    uint16_t rs = instr.r_type.rs;
-    uint16_t rd = instr.r_type.rd;
+    uint16_t rt = decoded.rt;
+    uint16_t rs = decoded.rs;
+    uint16_t rd = decoded.rd;
 
     int64_t result = regs[rs].ud[0] + regs[rt].ud[0];
     regs[rd].ud[0] = result;
@@ -1430,9 +1614,9 @@ void EmotionEngine::dadd()
 
 void EmotionEngine::dsll()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     regs[rd].ud[0] = (int32_t)(regs[rt].uw[0] >> sa);
 
@@ -1441,18 +1625,18 @@ void EmotionEngine::dsll()
 
 void EmotionEngine::dsrl()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     regs[rd].ud[0] = regs[rt].ud[0] >> sa;
 }
 
 void EmotionEngine::dsll32()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     //printf("[EE]: DSLL32 %s, %s, 0x%02X\n", regNames[rd].c_str(), regNames[rt].c_str(), sa);
     regs[rd].ud[0] = regs[rt].ud[0] << (sa + 32);
@@ -1460,9 +1644,9 @@ void EmotionEngine::dsll32()
 
 void EmotionEngine::dsrl32()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
     
     regs[rd].ud[0] = regs[rt].ud[0] >> (sa + 32);
 
@@ -1471,9 +1655,9 @@ void EmotionEngine::dsrl32()
 
 void EmotionEngine::dsra32()
 {
-    uint16_t sa = instr.r_type.sa;
-    uint16_t rd = instr.r_type.rd;
-    uint16_t rt = instr.r_type.rt;
+    uint16_t sa = decoded.sa;
+    uint16_t rd = decoded.rd;
+    uint16_t rt = decoded.rt;
 
     int64_t reg = (int64_t)regs[rt].ud[0];
     regs[rd].ud[0] = reg >> (sa + 32);
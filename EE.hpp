@@ -7,6 +7,10 @@
 #include <intc.hpp>
 #include <ee_timers.hpp>
 #include <fstream>
+#include <memory>
+#include <vector>
+
+class EEJit;
 
 union FPR
 {
@@ -78,6 +82,29 @@ struct Instruction
     bool is_delay_slot = false;
 };
 
+class EmotionEngine;
+
+/* An instruction as stored in the decode cache. The handler is
+   resolved through the opcode tables once when the block is built
+   and the operand fields are pulled out of the word ahead of time,
+   the interpreter handlers read them from here instead of the word */
+struct EEDecodedInstr
+{
+    uint32_t value;
+    void (EmotionEngine::*handler)();
+    uint8_t rs, rt, rd, sa;
+    int32_t imm;
+};
+
+/* Straight-line code up to (and including) the delay slot of
+   the first branch, never crossing a 4KB page. Blocks are keyed
+   by the physical address of their first instruction */
+struct EEBlock
+{
+    uint32_t start;
+    std::vector<EEDecodedInstr> instrs;
+};
+
 struct EE_COP1
 {
     void execute(Instruction instr);
@@ -93,13 +120,54 @@ struct EE_COP1
 class EmotionEngine
 {
 private:
+    friend class EEJit;
+    using Handler = void (EmotionEngine::*)();
+
     void fetch_next()
     {
         next_instr = {};
-        next_instr.value = bus->Read32(pc, true);
         next_instr.pc = pc;
+
+        /* Keep walking the current block while execution is sequential */
+        if (!cur_block || pc != cur_pc)
+            cur_block = lookup_block(pc);
+
+        if (cur_block)
+        {
+            next_decoded = cur_block->instrs[cur_index++];
+            next_instr.value = next_decoded.value;
+
+            cur_pc = pc + 4;
+            if (cur_index == cur_block->instrs.size())
+                cur_block = nullptr;
+        }
+        else
+        {
+            /* Code outside of RAM/BIOS is never cached */
+            next_instr.value = bus->Read32(pc, true);
+            next_decoded = decode_full(next_instr.value);
+        }
+
         pc += 4;
     }
+
+    /* Decode cache */
+    Handler decode(uint32_t value);
+    EEDecodedInstr decode_full(uint32_t value);
+    static bool ends_block(uint32_t value);
+    EEBlock* lookup_block(uint32_t vaddr);
+    void invalidate_page(uint32_t page);
+
+    std::unordered_map<uint32_t, std::unique_ptr<EEBlock>> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> page_blocks;
+    EEBlock* cur_block = nullptr;
+    uint32_t cur_index = 0, cur_pc = 0;
+    EEDecodedInstr decoded = {}, next_decoded = {};
+
+    /* Optional recompiler, the interpreter is used when this is null */
+    std::unique_ptr<EEJit> jit;
+    void step();
+
     uint32_t hi0 = 0, hi1 = 0;
     uint32_t lo0 = 0, lo1 = 0;
     uint32_t pc;
@@ -270,6 +338,7 @@ private:
     void sdl(); // 0x2C
     void sdr(); // 0x2D
     void cache() {} // 0x2F
+    void unknown(); // Anything the decoder doesn't recognize
     void ld(); // 0x37
     void swc1(); // 0x39
     void sd(); // 0x3F
@@ -330,10 +399,15 @@ public:
     COP0 cop0;
     EE_COP1 cop1;
     EmotionEngine(Bus* _bus);
+    ~EmotionEngine();
+    void enable_jit();
     INTC* getIntc() {return &intc;}
     Timers* getTimers() {return &timers;}
 
     void Clock(uint32_t cycles);
+
+    /* Every executed instruction including NOPs, for statistics */
+    uint64_t instructions_retired = 0;
     void exception(Exception exception, bool log)
     {
         if (log)
@@ -2,8 +2,13 @@
 #include <Bus.hpp>
 #include <EE.hpp>
 #include <sif.hpp>
+#include <sif_hle.hpp>
 #include <gs/gif.hpp>
+#include <logger.hpp>
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstring>
 
 inline uint32_t get_channel(uint32_t value)
 {
@@ -20,7 +25,7 @@ inline uint32_t get_channel(uint32_t value)
 	case 0xd0: return 8;
 	case 0xd4: return 9;
 	default:
-		printf("[DMAC] Invalid channel id provided 0x%X, aborting...\n", value);
+		LOG(DMAC, Error, "[DMAC] Invalid channel id provided 0x%X, aborting...\n", value);
         exit(1);
 	}
 }
@@ -61,7 +66,7 @@ constexpr const char* GLOBALS[] =
 		uint32_t offset = (addr >> 4) & 0xf;
 		auto ptr = (uint32_t*)&channels[channel] + offset;
 
-		printf("[DMAC] Reading 0x%X from %s of channel %d\n", *ptr, REGS[offset], channel);
+		LOG(DMAC, Debug, "[DMAC] Reading 0x%X from %s of channel %d\n", *ptr, REGS[offset], channel);
 		return *ptr;
 	}
 
@@ -74,19 +79,29 @@ constexpr const char* GLOBALS[] =
 		uint32_t offset = (addr >> 4) & 0xf;
 		auto ptr = (uint32_t*)&channels[channel] + offset;
 
-		printf("[DMAC] Writing 0x%X to %s of channel %d\n", data, REGS[offset], channel);
+		LOG(DMAC, Debug, "[DMAC] Writing 0x%X to %s of channel %d\n", data, REGS[offset], channel);
 		/* The lower bits of MADR must be zero: */
 		/* NOTE: This is actually required since the BIOS writes
 		   unaligned addresses to the GIF channel for some reason
 		   and expects it to be read correctly... */
         if (offset == 1)
-            data &= 0x01fffff0;
+            data &= 0x81fffff0;
 
         *ptr = data;
 
-		if (channels[channel].control.running)
+		/* Only CHCR can start or stop a channel */
+		if (offset == 0)
 		{
-			printf("\n[DMAC] Transfer for channel %d started (%d)!\n\n", channel, channels[channel].qword_count);
+			if (channels[channel].control.running)
+			{
+				LOG(DMAC, Info, "\n[DMAC] Transfer for channel %d started (%d)!\n\n", channel, channels[channel].qword_count);
+				active_channels |= (1 << channel);
+				sif_stalled &= ~(1 << channel);
+			}
+			else
+			{
+				active_channels &= ~(1 << channel);
+			}
 		}
 	}
 
@@ -97,7 +112,7 @@ constexpr const char* GLOBALS[] =
 		uint32_t offset = (addr >> 4) & 0xf;
 		auto ptr = (uint32_t*)&globals + offset;
 
-		printf("[DMAC] Reading 0x%X from %s\n", *ptr, GLOBALS[offset]);
+		LOG(DMAC, Debug, "[DMAC] Reading 0x%X from %s\n", *ptr, GLOBALS[offset]);
 		return *ptr;
 	}
 
@@ -105,7 +120,7 @@ constexpr const char* GLOBALS[] =
 	{
 		assert(addr == 0x1000F520);
 
-		printf("[DMAC] Reading D_ENABLER = 0x%X\n", globals.d_enable);
+		LOG(DMAC, Debug, "[DMAC] Reading D_ENABLER = 0x%X\n", globals.d_enable);
 		return globals.d_enable;
 	}
 
@@ -116,7 +131,7 @@ constexpr const char* GLOBALS[] =
 		uint32_t offset = (addr >> 4) & 0xf;
 		auto ptr = (uint32_t*)&globals + offset;
 
-		printf("[DMAC] Writing 0x%X to %s\n", data, GLOBALS[offset]);
+		LOG(DMAC, Debug, "[DMAC] Writing 0x%X to %s\n", data, GLOBALS[offset]);
 
 		if (offset == 1) /* D_STAT */
 		{
@@ -139,317 +154,438 @@ constexpr const char* GLOBALS[] =
 	{
 		assert(addr == 0x1000F590);
 
-		printf("[DMAC] Writing D_ENABLEW = 0x%X\n", data);
+		LOG(DMAC, Debug, "[DMAC] Writing D_ENABLEW = 0x%X\n", data);
 		globals.d_enable = data;
 	}
 
-	void DMAController::tick(uint32_t cycles)
+	void DMAController::register_mmio(Bus* bus)
+	{
+		bus->register_mmio(0x10008000, 0x1000E000,
+		{
+			.read32 = [this](uint32_t addr) { return read_channel(addr); },
+			.write32 = [this](uint32_t addr, uint32_t data) { write_channel(addr, data); }
+		});
+		bus->register_mmio(0x1000E000, 0x1000E064,
+		{
+			.read32 = [this](uint32_t addr) { return read_global(addr); },
+			.write32 = [this](uint32_t addr, uint32_t data) { write_global(addr, data); }
+		});
+		bus->register_mmio(0x1000F520, 0x1000F524, { .read32 = [this](uint32_t addr) { return read_enabler(addr); } });
+		bus->register_mmio(0x1000F590, 0x1000F594, { .write32 = [this](uint32_t addr, uint32_t data) { write_enabler(addr, data); } });
+	}
+
+	uint32_t DMAController::runnable_channels() const
 	{
 		if (globals.d_enable & 0x10000)
-			return;
+			return 0;
+
+		/* With priority control enabled only the channels
+		   whose CDE bit is set in D_PCR may run */
+		uint32_t mask = active_channels;
+		if (globals.d_pcr & (1u << 31))
+			mask &= (globals.d_pcr >> 16) & 0x3FF;
 
-		for (int cycle = cycles; cycle > 0; cycle--)
+		return mask;
+	}
+
+	uint64_t DMAController::next_event() const
+	{
+		/* A channel that can run moves data every cycle. IPU_FROM never
+		   has output to fetch, so it can't make progress either */
+		uint32_t stalled = sif_stalled | (1 << DMAChannels::IPU_FROM);
+		if (runnable_channels() & ~stalled)
+			return 0;
+
+		return Scheduler::NO_EVENT;
+	}
+
+	void DMAController::tick(uint32_t cycles)
+	{
+		/* Each channel gets one step per cycle, either a qword, the end of the
+		   transfer or a tag fetch. Channels don't depend on each other and their
+		   destinations only drain after the DMAC ticked, so every channel can
+		   spend its whole share at once and move data in blocks. Lower channel
+		   numbers are serviced first */
+		uint32_t pending = runnable_channels();
+		while (pending)
 		{
-			/* Check each channel */
-			for (uint32_t id = 0; id < 10; id++)
+			uint32_t id = std::countr_zero(pending);
+			pending &= pending - 1;
+
+			auto& channel = channels[id];
+			uint32_t address = channel.address, qword_count = channel.qword_count;
+			uint32_t tag_address = channel.tag_address.value;
+			bool end_transfer = channel.end_transfer;
+
+			uint32_t budget = cycles;
+			while (budget && channel.control.running)
 			{
-				auto& channel = channels[id];
-				if (channel.control.running)
+				/* Transfer any pending qwords */
+				if (channel.qword_count > 0)
 				{
-					/* Transfer any pending qwords */
-					if (channel.qword_count > 0)
-					{
-						/* This is channel specific */
-						switch (id)
-						{
-						case DMAChannels::VIF0:
-						case DMAChannels::VIF1:
-						{
-							auto& vif = bus->vif[id];
-							uint128_t qword = *(uint128_t*)&bus->eeRam[channel.address];
-							if (vif->write_fifo(0, qword))
-							{
-								uint64_t upper = qword >> 64, lower = qword;
-								printf("[DMAC] Writing 0x%lX%016lX to VIF%d\n", upper, lower, id);
-
-								channel.address += 16;
-								channel.qword_count--;
-
-								if (!channel.qword_count && !channel.control.mode)
-									channel.end_transfer = true;
-							}
-							break;
-						}
-						case DMAChannels::GIFC:
-						{
-							auto& gif = bus->gif;
-							uint128_t qword = *(uint128_t*)&bus->eeRam[channel.address];
-
-							/* Send data to the PATH3 port of the GIF */
-							if (gif->write_path3(0, qword))
-							{
-								uint64_t upper = qword >> 64, lower = qword;
-								printf("[DMAC][GIF] Writing 0x%lX%016lX to PATH3\n", upper, lower);
-
-								channel.address += 16;
-								channel.qword_count--;
-
-								if (!channel.qword_count && !channel.control.mode)
-									channel.end_transfer = true;
-							}
-
-							break;
-						}
-						case DMAChannels::SIF0:
-						{
-							/* SIF0 receives data from the SIF0 fifo */
-							auto& sif = bus->sif;
-							if (sif->sif0_fifo.size() >= 4)
-							{
-								uint32_t data[4];
-								for (int i = 0; i < 4; i++)
-								{
-									data[i] = sif->sif0_fifo.front();
-									sif->sif0_fifo.pop();
-								}
-
-								uint128_t qword = *(uint128_t*)data;
-								uint64_t upper = qword >> 64, lower = qword;
-								printf("[DMAC][SIF0] Receiving packet from SIF0 FIFO: 0x%lX%016lX\n", upper, lower);
-
-								/* Write the packet to the specified address */
-								bus->Write128(channel.address, *(Register*)&qword);
-
-								/* MADR/TADR update while a transfer is ongoing */
-								channel.qword_count--;
-								channel.address += 16;
-							}
-
-							break;
-						}
-						case DMAChannels::SIF1:
-						{
-							/* SIF1 pushes data to the SIF1 fifo */
-							auto& sif = bus->sif;
-							
-							uint128_t qword = *(uint128_t*)&bus->eeRam[channel.address];
-							uint32_t* data = (uint32_t*)&qword;
-							for (int i = 0; i < 4; i++)
-							{
-								sif->sif1_fifo.push(data[i]);
-							}
-
-							uint64_t upper = qword >> 64, lower = qword;
-							printf("[DMAC][SIF1] Transfering to SIF1 FIFO: 0x%lX%016lX\n", upper, lower);
-
-							/* MADR/TADR update while a transfer is ongoing */
-							channel.qword_count--;
-							channel.address += 16;
-							break;
-						}
-						default:
-                            printf("[DMAC] Unknown channel transfer with id %d\n", id);
-						}
-					} /* If the transfer ended, disable channel */
-					else if (channel.end_transfer)
-					{
-						printf("[DMAC] End transfer of channel %d\n", id);
-
-						/* End the transfer */
-						channel.end_transfer = false;
-						channel.control.running = 0;
-
-						/* Set the channel bit in the interrupt field of D_STAT */
-						globals.d_stat.channel_irq |= (1 << id);
-
-						/* Check for interrupts */
-						if (globals.d_stat.channel_irq & globals.d_stat.channel_irq_mask)
-						{
-							printf("\n[DMAC] INT1!\n\n");
-							cpu->cop0.cause.ip1_pending = 1;
-						}
-					}
-					else /* Read the next DMAtag */
-					{
-						fetch_tag(id);
-					}
+					uint32_t count = transfer(id, std::min(budget, channel.qword_count));
+
+					/* The destination is full, it won't drain until the next tick */
+					if (!count)
+						break;
+
+					budget -= count;
+				} /* If the transfer ended, disable channel */
+				else if (channel.end_transfer)
+				{
+					LOG(DMAC, Info, "[DMAC] End transfer of channel %d\n", id);
+
+					/* End the transfer */
+					channel.end_transfer = false;
+					channel.control.running = 0;
+					active_channels &= ~(1 << id);
+
+					raise_interrupt(id);
+					budget--;
+				}
+				else /* Read the next DMAtag */
+				{
+					fetch_tag(id);
+					budget--;
 				}
 			}
+
+			/* Nothing moved, the channel is waiting on the other end of its FIFO */
+			bool stalled = channel.control.running && channel.address == address &&
+				channel.qword_count == qword_count && channel.tag_address.value == tag_address &&
+				channel.end_transfer == end_transfer;
+			if (stalled && (id == DMAChannels::SIF0 || id == DMAChannels::SIF1))
+				sif_stalled |= (1 << id);
 		}
 	}
-	
-	void DMAController::fetch_tag(uint32_t id)
+
+	void DMAController::raise_interrupt(uint32_t id)
+	{
+		/* Set the channel bit in the interrupt field of D_STAT */
+		globals.d_stat.channel_irq |= (1 << id);
+
+		/* Check for interrupts */
+		if (globals.d_stat.channel_irq & globals.d_stat.channel_irq_mask)
+		{
+			LOG(DMAC, Info, "\n[DMAC] INT1!\n\n");
+			cpu->cop0.cause.ip1_pending = 1;
+		}
+	}
+
+	uint128_t* DMAController::memory(uint32_t address)
+	{
+		if (address & SPR_SELECT)
+			return (uint128_t*)&bus->scratchpad()[address & 0x3FF0];
+
+		return (uint128_t*)&bus->eeRam[address & 0x1FFFFF0];
+	}
+
+	uint32_t DMAController::contiguous(uint32_t address)
+	{
+		if (address & SPR_SELECT)
+			return (0x4000 - (address & 0x3FF0)) / 16;
+
+		return (0x2000000 - (address & 0x1FFFFF0)) / 16;
+	}
+
+	void DMAController::write_memory(uint32_t address, const uint128_t* data, uint32_t count)
+	{
+		/* The EE recompiler has to hear about stores to pages it compiled */
+		if (!(address & SPR_SELECT) && count)
+			bus->check_code_write_range(address & 0x1FFFFF0, count * 16);
+
+		std::memcpy(memory(address), data, count * 16);
+	}
+
+	uint32_t DMAController::transfer(uint32_t id, uint32_t max_qwords)
 	{
-		DMATag tag;
 		auto& channel = channels[id];
+
+		/* Blocks never run past the end of RAM or the scratchpad */
+		max_qwords = std::min(max_qwords, contiguous(channel.address));
+		auto source = memory(channel.address);
+
+		/* This is channel specific */
+		uint32_t count = 0;
 		switch (id)
 		{
+		case DMAChannels::VIF0:
+		case DMAChannels::VIF1:
+		{
+			count = bus->vif[id]->write_fifo_block(source, max_qwords);
+			LOG(DMAC, Trace, "[DMAC] Writing %d qwords from 0x%X to VIF%d\n", count, channel.address, id);
+			break;
+		}
 		case DMAChannels::GIFC:
 		{
-			assert(!channel.tag_address.mem_select);
-
-			auto& gif = bus->gif;
-			auto address = channel.tag_address.address;
-
-			tag.value = *(uint128_t*)&bus->eeRam[address];
-			printf("[DMAC] Read GIF DMA tag 0x%lX\n", (uint64_t)tag.value);
-
-			/* Update channel from tag */
-			channel.qword_count = tag.qwords;
-			channel.control.tag = (tag.value >> 16) & 0xffff;
+			/* Send data to the PATH3 port of the GIF */
+			count = bus->gif->write_path3_block(source, max_qwords);
+			LOG(DMAC, Trace, "[DMAC][GIF] Writing %d qwords from 0x%X to PATH3\n", count, channel.address);
+			break;
+		}
+		case DMAChannels::IPU_FROM:
+		{
+			/* The IPU doesn't decode anything yet, so there is never output to fetch */
+			return 0;
+		}
+		case DMAChannels::IPU_TO:
+		{
+			for (count = 0; count < max_qwords; count++)
+				bus->ipu->write_fifo(0x10007010, source[count]);
 
-			uint16_t tag_id = tag.id;
-			switch (tag_id)
+			LOG(DMAC, Trace, "[DMAC][IPU] Writing %d qwords from 0x%X to the IPU\n", count, channel.address);
+			break;
+		}
+		case DMAChannels::SIF0:
+		{
+			/* SIF0 receives data from the SIF0 fifo */
+			auto& sif = bus->sif;
+			count = std::min<uint32_t>(max_qwords, sif->sif0_fifo.size() / 4);
+			for (uint32_t i = 0; i < count; i++)
 			{
-			case DMASourceID::REFE:
-				channel.address = tag.address;
-				channel.tag_address.value += 16;
-				channel.end_transfer = true;
-				break;
-			case DMASourceID::CNT:
-				channel.address = channel.tag_address.address + 16;
-				channel.tag_address.value = channel.address + channel.qword_count * 16;
-				break;
-            case DMASourceID::END:
-                channel.address = channel.tag_address.address + 16;
-                channel.end_transfer = true;
-                break;
-			default:
-                printf("\n[DMAC] Unrecognized GIF DMAtag id %d\n", tag_id);
+				uint128_t qword;
+				sif->sif0_fifo.pop_block((uint32_t*)&qword, 4);
+				write_memory(channel.address + i * 16, &qword, 1);
 			}
 
-			/* Just end transfer, since an interrupt will be raised there anyways  */
-			if (channel.control.enable_irq_bit && tag.irq)
-				channel.end_transfer = true;
+			LOG(DMAC, Trace, "[DMAC][SIF0] Received %d qwords from SIF0 FIFO to 0x%X\n", count, channel.address);
+			break;
+		}
+		case DMAChannels::SIF1:
+		{
+			/* SIF1 pushes data to the SIF1 fifo, stalling while it is full */
+			auto& sif = bus->sif;
+			count = std::min<uint32_t>(max_qwords, sif->sif1_fifo.free_space() / 4);
+			sif->sif1_fifo.push_block((uint32_t*)source, count * 4);
 
+			LOG(DMAC, Trace, "[DMAC][SIF1] Transfering %d qwords from 0x%X to SIF1 FIFO\n", count, channel.address);
 			break;
 		}
-		case DMAChannels::VIF0:
-		case DMAChannels::VIF1:
+		case DMAChannels::SPR_FROM:
 		{
-			assert(!channel.tag_address.mem_select);
+			uint32_t spr = SPR_SELECT | channel.scratchpad_address;
+			count = std::min(max_qwords, contiguous(spr));
+			write_memory(channel.address, memory(spr), count);
+			channel.scratchpad_address = (channel.scratchpad_address + count * 16) & 0x3FF0;
 
-			auto& vif = bus->vif[id];
-			auto address = channel.tag_address.address;
+			LOG(DMAC, Trace, "[DMAC][SPR] Copying %d qwords from scratchpad to 0x%X\n", count, channel.address);
+			break;
+		}
+		case DMAChannels::SPR_TO:
+		{
+			uint32_t spr = SPR_SELECT | channel.scratchpad_address;
+			count = std::min(max_qwords, contiguous(spr));
+			std::memcpy(memory(spr), source, count * 16);
+			channel.scratchpad_address = (channel.scratchpad_address + count * 16) & 0x3FF0;
 
-			tag.value = *(uint128_t*)&bus->eeRam[address];
-			printf("[DMAC] Read VIF%d DMA tag 0x%lX\n", id, (uint64_t)tag.value);
+			LOG(DMAC, Trace, "[DMAC][SPR] Copying %d qwords from 0x%X to scratchpad\n", count, channel.address);
+			break;
+		}
+		default:
+			LOG(DMAC, Warn, "[DMAC] Unknown channel transfer with id %d\n", id);
+			return 0;
+		}
 
-			/* Transfer the tag before any data */
-			if (channel.control.transfer_tag)
-			{
-                if (!vif->write_fifo<uint64_t>(0, tag.data))
-					return;
-			}
+		/* MADR/TADR update while a transfer is ongoing */
+		channel.address += count * 16;
+		channel.qword_count -= count;
 
-			/* Update channel from tag */
-			channel.qword_count = tag.qwords;
-			channel.control.tag = (tag.value >> 16) & 0xffff;
+		/* Normal mode transfers end with the last qword, chains wait on the next tag */
+		if (!channel.qword_count && !channel.control.mode)
+			channel.end_transfer = true;
 
-			uint16_t tag_id = tag.id;
-			switch (tag_id)
-			{
-			case DMASourceID::REFE:
-				channel.address = tag.address;
-				channel.tag_address.value += 16;
-				channel.end_transfer = true;
-				break;
-			case DMASourceID::CNT:
-				channel.address = channel.tag_address.address + 16;
-				channel.tag_address.value = channel.address + channel.qword_count * 16;
-				break;
-			case DMASourceID::NEXT:
-				channel.address = channel.tag_address.address + 16;
-				channel.tag_address.address = tag.address;
-				break;
-			default:
-                printf("\n[DMAC] Unrecognized VIF%d DMAtag id %d\n", id, tag_id);
-			}
+		return count;
+	}
 
-			/* Just end transfer, since an interrupt will be raised there anyways  */
-			if (channel.control.enable_irq_bit && tag.irq)
-				channel.end_transfer = true;
+	bool DMAController::transfer_tag(uint32_t id, const DMATag& tag)
+	{
+		switch (id)
+		{
+		case DMAChannels::VIF0:
+		case DMAChannels::VIF1:
+			/* The VIFs only get the upper half, which may hold commands */
+			return bus->vif[id]->write_fifo<uint64_t>(0, tag.data);
+		case DMAChannels::SIF1:
+		{
+			/* The IOP side expects the whole tag in front of the data */
+			uint128_t value = tag.value;
+			return bus->sif->sif1_fifo.push_block((uint32_t*)&value, 4);
+		}
+		default:
+			return true;
+		}
+	}
 
-			break;
+	void DMAController::fetch_tag(uint32_t id)
+	{
+		auto& channel = channels[id];
+
+		/* Normal mode channels that were started without data have nothing to read */
+		if (channel.control.mode != 1)
+		{
+			channel.end_transfer = true;
+			return;
 		}
+
+		DMATag tag;
+		switch (id)
+		{
 		case DMAChannels::SIF0:
 		{
+			/* Destination chain tags arrive in front of the data */
 			auto& sif = bus->sif;
-            if (sif->sif0_fifo.size() >= 2)
-			{
-				uint32_t data[2] = {};
-				for (int i = 0; i < 2; i++)
-				{
-					data[i] = sif->sif0_fifo.front();
-					sif->sif0_fifo.pop();
-				}
+			uint32_t data[2];
+			if (!sif->sif0_fifo.pop_block(data, 2))
+				return;
 
-				tag.value = *(uint64_t*)data;
-				printf("[DMAC] Read SIF0 DMA tag 0x%lX\n", (uint64_t)tag.value);
+			tag.value = *(uint64_t*)data;
+			apply_destination_tag(id, tag);
+			break;
+		}
+		case DMAChannels::SPR_FROM:
+		{
+			tag.value = *memory(SPR_SELECT | channel.scratchpad_address);
+			channel.scratchpad_address = (channel.scratchpad_address + 16) & 0x3FF0;
+			apply_destination_tag(id, tag);
+			break;
+		}
+		case DMAChannels::IPU_FROM:
+		{
+			LOG(DMAC, Warn, "[DMAC] IPU_FROM doesn't support chain mode\n");
+			channel.end_transfer = true;
+			break;
+		}
+		default:
+			apply_source_tag(id);
+		}
+	}
 
-				/* Update channel from tag */
-				channel.qword_count = tag.qwords;
-				channel.control.tag = (tag.value >> 16) & 0xffff;
-				channel.address = tag.address;
-				channel.tag_address.address += 16;
+	void DMAController::apply_source_tag(uint32_t id)
+	{
+		DMATag tag;
+		auto& channel = channels[id];
 
-				printf("[DMAC] QWC: %d\nADDR: 0x%X\n", channel.qword_count, channel.address);
+		tag.value = *memory(channel.tag_address.value);
+		LOG(DMAC, Debug, "[DMAC] Read DMA tag 0x%lX for channel %d\n", (uint64_t)tag.value, id);
 
-				/* Just end transfer, since an interrupt will be raised there anyways */
-				if (channel.control.enable_irq_bit && tag.irq)
-					channel.end_transfer = true;
-			}
-			break;
-		}
-		case DMAChannels::SIF1:
+		/* Host side RPC servers take whole SIF1 packets before they reach the FIFO */
+		bool intercepted = false;
+		if (id == DMAChannels::SIF1 && sif_hle)
 		{
-			assert(channel.control.mode == 1);
-			assert(!channel.tag_address.mem_select);
+			bool by_address = tag.id == DMASourceID::REFE || tag.id == DMASourceID::REF || tag.id == DMASourceID::REFS;
+			uint32_t data_address = by_address ? (uint32_t)(tag.value >> 32) & ~0xF : channel.tag_address.value + 16;
+			uint32_t size = std::min<uint32_t>(tag.qwords, contiguous(data_address)) * 16;
+			intercepted = sif_hle->intercept(tag.data, (uint8_t*)memory(data_address), size);
+		}
+
+		/* Transfer the tag before any data */
+		if (!intercepted && channel.control.transfer_tag && !transfer_tag(id, tag))
+			return;
 
-			auto address = channel.tag_address.address;
+		/* Update channel from tag */
+		channel.qword_count = tag.qwords;
+		channel.control.tag = (tag.value >> 16) & 0xffff;
 
-			/* Get tag from memory */
-			/* TODO: Access to other memory types */
-			tag.value = *(uint128_t*)&bus->eeRam[address];
-			printf("[DMAC] Read SIF1 DMA tag 0x%lX\n", (uint64_t)tag.value);
+		uint32_t tag_address = channel.tag_address.value;
+		uint32_t address = (uint32_t)(tag.value >> 32) & ~0xF;
 
-			/* Update channel from tag */
-			channel.qword_count = tag.qwords;
-			channel.control.tag = (tag.value >> 16) & 0xffff;
+		uint16_t tag_id = tag.id;
+		switch (tag_id)
+		{
+		case DMASourceID::REFE:
+			channel.address = address;
+			tag_address += 16;
+			channel.end_transfer = true;
+			break;
+		case DMASourceID::CNT:
+			channel.address = tag_address + 16;
+			tag_address = channel.address + channel.qword_count * 16;
+			break;
+		case DMASourceID::NEXT:
+			channel.address = tag_address + 16;
+			tag_address = address;
+			break;
+		case DMASourceID::REF:
+		case DMASourceID::REFS:
+			channel.address = address;
+			tag_address += 16;
+			break;
+		case DMASourceID::CALL:
+		{
+			channel.address = tag_address + 16;
 
-			uint16_t tag_id = tag.id;
-			switch (tag_id)
-			{
-			case DMASourceID::REFE:
+			/* Only two return addresses fit in ASR0/ASR1 */
+			uint32_t level = channel.control.stack_ptr;
+			if (level >= 2)
 			{
-				channel.address = tag.address;
-				channel.tag_address.value += 16;
+				LOG(DMAC, Warn, "[DMAC] DMA CALL stack overflow on channel %d\n", id);
 				channel.end_transfer = true;
 				break;
 			}
-			case DMASourceID::NEXT:
+
+			channel.saved_tag_address[level].value = channel.address + channel.qword_count * 16;
+			channel.control.stack_ptr = level + 1;
+			tag_address = address;
+			break;
+		}
+		case DMASourceID::RET:
+		{
+			channel.address = tag_address + 16;
+
+			/* Returning with an empty stack ends the chain */
+			uint32_t level = channel.control.stack_ptr;
+			if (level > 0)
 			{
-				channel.address = channel.tag_address.address + 16;
-				channel.tag_address.value = tag.address;
-				break;
+				channel.control.stack_ptr = level - 1;
+				tag_address = channel.saved_tag_address[level - 1].value;
 			}
-			case DMASourceID::REF:
+			else
 			{
-				channel.address = tag.address;
-				channel.tag_address.value += 16;
-				break;
-			}
-			default:
-                printf("\n[DMAC] Unrecognized SIF1 DMAtag id %d\n", tag_id);
+				channel.end_transfer = true;
 			}
+			break;
+		}
+		case DMASourceID::END:
+			channel.address = tag_address + 16;
+			channel.end_transfer = true;
+			break;
+		}
 
-			/* Just end transfer, since an interrupt will be raised there anyways */
-			if (channel.control.enable_irq_bit && tag.irq)
-				channel.end_transfer = true;
+		channel.tag_address.value = tag_address;
+		if (intercepted)
+			channel.qword_count = 0;
 
+		/* Just end transfer, since an interrupt will be raised there anyways  */
+		if (channel.control.enable_irq_bit && tag.irq)
+			channel.end_transfer = true;
+	}
+
+	void DMAController::apply_destination_tag(uint32_t id, const DMATag& tag)
+	{
+		auto& channel = channels[id];
+		LOG(DMAC, Debug, "[DMAC] Read destination DMA tag 0x%lX for channel %d\n", (uint64_t)tag.value, id);
+
+		/* Update channel from tag */
+		channel.qword_count = tag.qwords;
+		channel.control.tag = (tag.value >> 16) & 0xffff;
+		channel.address = (uint32_t)(tag.value >> 32) & ~0xF;
+
+		uint16_t tag_id = tag.id;
+		switch ((DMADestinationID)tag_id)
+		{
+		case DMADestinationID::CNTS:
+		case DMADestinationID::CNT:
+			break;
+		case DMADestinationID::END:
+			channel.end_transfer = true;
 			break;
-		}
 		default:
-            printf("[DMAC] Unknown channel %d\n", id);
+			LOG(DMAC, Warn, "\n[DMAC] Unrecognized destination DMAtag id %d\n", tag_id);
 		}
+
+		LOG(DMAC, Debug, "[DMAC] QWC: %d\nADDR: 0x%X\n", channel.qword_count, channel.address);
+
+		/* Just end transfer, since an interrupt will be raised there anyways */
+		if (channel.control.enable_irq_bit && tag.irq)
+			channel.end_transfer = true;
 	}
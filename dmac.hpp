@@ -1,18 +1,22 @@
 #pragma once
 
 #include <int128.h>
+#include <scheduler.hpp>
 
 class Bus;
 class EmotionEngine;
+class SIFHLE;
 
 constexpr uint32_t DMATAG_END = 0x7;
+/* Bit 31 of MADR, TADR, ASRn and tag addresses selects the scratchpad */
+constexpr uint32_t SPR_SELECT = 0x80000000;
 
 union TagAddr
 {
     uint32_t value;
     struct
     {
-        uint32_t address : 30;
+        uint32_t address : 31;
         uint32_t mem_select : 1;
     };
 };
@@ -123,6 +127,14 @@ enum DMASourceID : uint32_t
     END
 };
 
+/* Scoped since the names clash with the source IDs */
+enum class DMADestinationID : uint32_t
+{
+    CNTS = 0,
+    CNT = 1,
+    END = 7
+};
+
 class DMAController
 {
 public:
@@ -137,13 +149,51 @@ public:
     void write_global(uint32_t addr, uint32_t data);
     void write_enabler(uint32_t addr, uint32_t data);
 
+    void register_mmio(Bus* bus);
+
     void tick(uint32_t cycles);
+
+    /* EE cycles until tick() has work to do, NO_EVENT when no channel is
+       running or every running one is a SIF channel waiting on the IOP */
+    uint64_t next_event() const;
+
+    /* The IOP side moved data through the SIF FIFOs, so stalled SIF
+       channels may be able to continue */
+    void wake_sif() { sif_stalled = 0; }
+
+    /* Flags the channel in D_STAT and raises INT1 if it's unmasked */
+    void raise_interrupt(uint32_t id);
+    void attach_sif_hle(SIFHLE* hle) { sif_hle = hle; }
 private:
+    uint32_t runnable_channels() const;
+
+    /* Chain mode. Source channels (memory to peripheral) read their tags
+       from TADR, destination channels get them from the incoming data */
     void fetch_tag(uint32_t id);
+    void apply_source_tag(uint32_t id);
+    void apply_destination_tag(uint32_t id, const DMATag& tag);
+    bool transfer_tag(uint32_t id, const DMATag& tag);
+
+    /* Moves up to max_qwords to the channel's destination, returns how many it took */
+    uint32_t transfer(uint32_t id, uint32_t max_qwords);
+
+    /* RAM or scratchpad depending on SPR_SELECT */
+    uint128_t* memory(uint32_t address);
+    uint32_t contiguous(uint32_t address);
+    void write_memory(uint32_t address, const uint128_t* data, uint32_t count);
 private:
     Bus* bus;
     EmotionEngine* cpu;
 
     DMACChannel channels[10] = {};
     DMACGlobals globals = {};
+
+    /* Bit per channel with CHCR.STR set */
+    uint32_t active_channels = 0;
+
+    /* SIF channels that got nowhere on their last tick. Their FIFOs only
+       change when the IOP runs, so ticking them again before that is useless */
+    uint32_t sif_stalled = 0;
+
+    SIFHLE* sif_hle = nullptr;
 };
\ No newline at end of file
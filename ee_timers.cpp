@@ -1,5 +1,8 @@
 #include <ee_timers.hpp>
 #include <intc.hpp>
+#include <Bus.hpp>
+#include <scheduler.hpp>
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 
@@ -19,9 +22,15 @@ static const char* CLOCK[] =
 	"HBLANK"
 };
 
-Timers::Timers(INTC* intc)
-: intc(intc)
-{}
+Timers::Timers(INTC* intc, Scheduler* scheduler)
+: intc(intc), scheduler(scheduler)
+{
+    event_id = scheduler->register_function([this]()
+    {
+        update();
+        reschedule();
+    });
+}
 
 uint32_t Timers::read(uint32_t addr)
 {
@@ -31,6 +40,8 @@ uint32_t Timers::read(uint32_t addr)
     uint32_t offset = (addr & 0xf0) >> 4;
     uint32_t* ptr = (uint32_t*)&timers[num] + offset;
 
+    update();
+
     printf("[EE Timer]: Read %s (0x%08X) [%s]\n", REGS[offset], *ptr, timers[num].mode.enable ? "enabled" : "disabled");
 
     return *ptr;
@@ -44,6 +55,8 @@ void Timers::write(uint32_t addr, uint32_t data)
     uint32_t offset = (addr & 0xf0) >> 4;
     auto ptr = (uint32_t*)&timers[num] + offset;
 
+    update();
+
     if (offset == 1)
     {
         auto& timer = timers[num];
@@ -68,6 +81,44 @@ void Timers::write(uint32_t addr, uint32_t data)
     }
 
     *ptr = data;
+
+    reschedule();
+}
+
+void Timers::update()
+{
+    /* Timers count bus cycles, keep any odd EE cycle for the next update */
+    uint32_t cycles = (scheduler->get_time() - last_update) / 2;
+    last_update += cycles * 2;
+
+    if (cycles)
+        tick(cycles);
+}
+
+void Timers::reschedule()
+{
+    uint64_t next = UINT64_MAX;
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        auto& timer = timers[i];
+        if (!timer.mode.enable || !timer.ratio)
+            continue;
+
+        /* Bus cycles until the counter reaches the compare value or overflows */
+        uint64_t cycles = timer.counter > 0xffff ? 1 : (0xffff - timer.counter) / timer.ratio + 1;
+        if (timer.counter < timer.compare)
+            cycles = std::min<uint64_t>(cycles, (timer.compare - timer.counter + timer.ratio - 1) / timer.ratio);
+
+        next = std::min(next, cycles);
+    }
+
+    if (next == UINT64_MAX)
+    {
+        scheduler->remove_event(event_id);
+        return;
+    }
+
+    scheduler->add_event(event_id, last_update + next * 2 - scheduler->get_time());
 }
 
 void Timers::tick(uint32_t cycles)
@@ -107,4 +158,13 @@ void Timers::tick(uint32_t cycles)
             timer.counter -= 0xffff;
         }
     }
+}
+
+void Timers::register_mmio(Bus* bus)
+{
+    bus->register_mmio(0x10000000, 0x10002000,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
 }
\ No newline at end of file
@@ -36,10 +36,12 @@ struct Timer
 };
 
 class INTC;
+class Bus;
+class Scheduler;
 class Timers
 {
 public:
-    Timers(INTC* intc);
+    Timers(INTC* intc, Scheduler* scheduler);
     ~Timers() = default;
 
     void tick(uint32_t cycles);
@@ -47,7 +49,19 @@ public:
     uint32_t read(uint32_t addr);
     void write(uint32_t addr, uint32_t data);
 
+    void register_mmio(Bus* bus);
+
+private:
+    /* Counters are only brought up to date when they are accessed
+       or when the event for the next compare/overflow fires */
+    void update();
+    void reschedule();
+
 private:
     INTC* intc;
+    Scheduler* scheduler;
     Timer timers[4] = {};
+
+    uint32_t event_id;
+    uint64_t last_update = 0;
 };
\ No newline at end of file
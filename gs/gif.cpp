@@ -1,6 +1,8 @@
 #include <gs/gif.hpp>
 #include <gs/gs.hpp>
+#include <Bus.hpp>
 #include <cassert>
+#include <algorithm>
 
 
 static const char* REGS[10] =
@@ -58,12 +60,20 @@ void GIF::write(uint32_t addr, uint32_t data)
 
 void GIF::tick(uint32_t cycles)
 {
-    while (!fifo.empty() && cycles--)
+    while (!fifo.empty() && cycles)
     {
         if (!data_count)
+        {
             process_tag();
+            cycles--;
+        }
+        else if (tag.flg == Format::Image)
+            cycles -= transfer_image(cycles);
         else
+        {
             execute_command();
+            cycles--;
+        }
     }
 }
 
@@ -90,14 +100,24 @@ void GIF::process_tag()
         data_count = tag.nloop;
         reg_count = tag.nreg;
 
-        gpu->prim = tag.pre ? tag.prim : gpu->prim;
-
-        gpu->rgbaq.q = 1.0f;
+        gpu->start_packet(tag.pre, tag.prim);
 
         fifo.pop<uint128_t>();
     }
 }
 
+int GIF::transfer_image(uint32_t cycles)
+{
+    /* Everything queued goes to the GS in one go, still a qword per cycle */
+    uint128_t data[FIFO_QWORDS];
+    int count = std::min({ fifo.size<uint128_t>(), data_count, (int)std::min<uint32_t>(cycles, FIFO_QWORDS) });
+
+    fifo.pop_block(data, count);
+    gpu->write_hwreg(data, count);
+    data_count -= count;
+    return count;
+}
+
 void GIF::execute_command()
 {
     uint128_t qword;
@@ -116,13 +136,6 @@ void GIF::execute_command()
             }
             break;
         }
-        case Format::Image:
-        {
-            gpu->write_hwreg(qword);
-            gpu->write_hwreg(qword >> 64);
-            data_count--;
-            break;
-        }
         default:
             printf("[GIF]: Unknown format %d\n", format);
             exit(1);
@@ -202,4 +215,19 @@ void GIF::process_packed(uint128_t qword)
         exit(1);
     }
     reg_count--;
+}
+
+void GIF::register_mmio(Bus* bus)
+{
+    bus->register_mmio(0x10003000, 0x100030B0,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
+
+    /* PATH3 FIFO */
+    bus->register_mmio(0x10006000, 0x10006010,
+    {
+        .write128 = [this](uint32_t addr, uint128_t data) { write_path3(addr, data); }
+    });
 }
\ No newline at end of file
@@ -9,6 +9,8 @@ namespace gs
     struct GraphicsSynthesizer;
 }
 
+class Bus;
+
 union GIFCTRL
 {
     uint32_t value;
@@ -88,14 +90,21 @@ public:
 
     void tick(uint32_t cycles);
     void reset();
+    bool busy() const { return !fifo.empty(); }
 
     uint32_t read(uint32_t addr);
     void write(uint32_t addr, uint32_t data);
 
     bool write_path3(uint32_t, uint128_t data);
+    /* Returns how many of the qwords fit in the FIFO */
+    int write_path3_block(const uint128_t* data, int count) { return fifo.push_block(data, count); }
+
+    void register_mmio(Bus* bus);
 private:
     void process_tag();
     void execute_command();
+    /* Returns the qwords sent, at most one per cycle */
+    int transfer_image(uint32_t cycles);
 
     void process_packed(uint128_t qword);
 
@@ -104,7 +113,8 @@ private:
     GIFCTRL control = {};
     uint32_t mode = 0;
     GIFSTAT status = {};
-    util::Queue<uint32_t, 64> fifo;
+    constexpr static int FIFO_QWORDS = 16;
+    util::Queue<uint32_t, FIFO_QWORDS * 4> fifo;
 
     GIFTag tag = {};
     int data_count = 0, reg_count = 0;
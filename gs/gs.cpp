@@ -2,8 +2,10 @@
 #include <gs/gsrenderer.hpp>
 #include <cassert>
 #include <unordered_map>
-#include <glad/glad.h>
 #include <climits>
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
 
 using namespace gs;
 
@@ -65,21 +67,45 @@ std::unordered_map<int, const char*> REGS =
 
 namespace gs
 {
-	GraphicsSynthesizer::GraphicsSynthesizer()
+	GraphicsSynthesizer::GraphicsSynthesizer(std::unique_ptr<GSRenderer> renderer)
+	: renderer(std::move(renderer))
 	{
 		/* Allocate VRAM */
 		vram = new Page[512];
+		this->renderer->set_vram(vram);
 	}
 
 	GraphicsSynthesizer::~GraphicsSynthesizer()
 	{
+		set_thread(false);
 		delete[] vram;
 	}
 
+	/* The second group is sparse: CSR, IMR, BUSDIR and SIGLBLID sit at
+	   0x1000, 0x1010, 0x1040 and 0x1080 but are packed after BGCOLOR */
+	static uint32_t priv_offset(uint32_t addr)
+	{
+		if (!(addr & 0xf000))
+			return (addr >> 4) & 0xf;
+
+		switch (addr & 0xff0)
+		{
+		case 0x000: return 15;
+		case 0x010: return 16;
+		case 0x040: return 17;
+		case 0x080: return 18;
+		default:
+			printf("[GS]: Unknown privileged register %#x\n", addr);
+			exit(1);
+		}
+	}
+
 	uint64_t GraphicsSynthesizer::read_priv(uint32_t addr)
 	{
-		bool group = addr & 0xf000;
-		uint32_t offset = ((addr >> 4) & 0xf) + 15 * group;
+		/* Games poll these to wait on the GS, so it has to be done */
+		sync();
+
+		uint32_t offset = priv_offset(addr);
 		auto ptr = (uint64_t*)&priv_regs + offset;
 
 		//fmt::print("[GS] Reading {:#x} from {}\n", *ptr, PRIV_REGS[offset]);
@@ -91,8 +117,7 @@ namespace gs
 
 	void GraphicsSynthesizer::write_priv(uint32_t addr, uint64_t data)
 	{
-		bool group = addr & 0xf000;
-		uint32_t offset = ((addr >> 4) & 0xf) + 15 * group;
+		uint32_t offset = priv_offset(addr);
 		auto ptr = (uint64_t*)&priv_regs + offset;
 
 		*ptr = data;
@@ -109,6 +134,161 @@ namespace gs
 	}
 
 	void GraphicsSynthesizer::write(uint16_t addr, uint64_t data)
+	{
+		if (!thread.joinable())
+		{
+			execute_write(addr, data);
+			return;
+		}
+
+		post({ GSCommand::Write, addr, data });
+
+		/* Local memory is read back right after TRXDIR starts the transfer */
+		if (addr == 0x53 && (data & 0x3) == TRXDir::LocalHost)
+			sync();
+	}
+
+	void GraphicsSynthesizer::write_hwreg(const uint128_t* data, uint32_t count)
+	{
+		if (!thread.joinable())
+		{
+			execute_hwreg(data, count);
+			return;
+		}
+
+		GSCommand block[HWREG_CHUNK + 1];
+		while (count)
+		{
+			uint32_t chunk = std::min(count, HWREG_CHUNK);
+			block[0] = { GSCommand::HWREG, (uint16_t)chunk, 0 };
+			std::memcpy(&block[1], data, chunk * sizeof(uint128_t));
+
+			/* Pushed as a whole so the payload is there with its header */
+			while (!commands->push_block(block, chunk + 1))
+				std::this_thread::yield();
+
+			commands_posted++;
+			data += chunk;
+			count -= chunk;
+		}
+	}
+
+	void GraphicsSynthesizer::start_packet(bool pre, uint64_t prim)
+	{
+		if (thread.joinable())
+			post({ GSCommand::Tag, pre, prim });
+		else
+			execute_tag(pre, prim);
+	}
+
+	void GraphicsSynthesizer::render()
+	{
+		if (thread.joinable())
+			post({ GSCommand::Render, 0, 0 });
+		else
+			renderer->render();
+	}
+
+	void GraphicsSynthesizer::set_thread(bool enable)
+	{
+		if (enable == thread.joinable())
+			return;
+
+		if (enable)
+		{
+			if (!commands)
+				commands = std::make_unique<SPSCQueue<GSCommand, 1 << 16>>();
+
+			thread_quit = false;
+			thread = std::thread(&GraphicsSynthesizer::thread_main, this);
+		}
+		else
+		{
+			thread_quit.store(true, std::memory_order_release);
+			thread.join();
+		}
+	}
+
+	void GraphicsSynthesizer::sync()
+	{
+		if (!thread.joinable())
+			return;
+
+		uint32_t idle = 0;
+		while (commands_done.load(std::memory_order_acquire) != commands_posted)
+		{
+			if (++idle < 64)
+				_mm_pause();
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	void GraphicsSynthesizer::post(GSCommand command)
+	{
+		/* The GS thread never waits on us, so a full ring always drains */
+		while (!commands->push(command))
+			std::this_thread::yield();
+
+		commands_posted++;
+	}
+
+	void GraphicsSynthesizer::thread_main()
+	{
+		uint32_t idle = 0;
+		while (!thread_quit.load(std::memory_order_acquire))
+		{
+			if (run_command())
+				idle = 0;
+			else if (++idle < 64)
+				_mm_pause();
+			else
+				std::this_thread::yield();
+		}
+
+		/* Whatever was posted before the quit still has to land */
+		while (run_command());
+	}
+
+	bool GraphicsSynthesizer::run_command()
+	{
+		GSCommand command;
+		if (!commands->pop(command))
+			return false;
+
+		switch (command.type)
+		{
+		case GSCommand::Write:
+			execute_write(command.addr, command.data);
+			break;
+		case GSCommand::HWREG:
+		{
+			uint128_t payload[HWREG_CHUNK];
+			commands->pop_block((GSCommand*)payload, command.addr);
+			execute_hwreg(payload, command.addr);
+			break;
+		}
+		case GSCommand::Tag:
+			execute_tag(command.addr, command.data);
+			break;
+		case GSCommand::Render:
+			renderer->render();
+			break;
+		}
+
+		commands_done.fetch_add(1, std::memory_order_release);
+		return true;
+	}
+
+	void GraphicsSynthesizer::execute_tag(bool pre, uint64_t prim)
+	{
+		if (pre)
+			this->prim = prim;
+
+		rgbaq.q = 1.0f;
+	}
+
+	void GraphicsSynthesizer::execute_write(uint16_t addr, uint64_t data)
 	{
 		auto context = addr & 1;
 		switch (addr)
@@ -208,26 +388,9 @@ namespace gs
 			break;
 		case 0x47:
 		case 0x48:
+			/* TEST_1 sits at an odd address, unlike the other context registers */
+			context = addr - 0x47;
 			test[context] = data;
-			
-			/* Flush renderer */
-			renderer.render();
-			switch ((test[context] >> 17) & 0x3)
-			{
-			case 0:
-				glDepthFunc(GL_NEVER);
-				break;
-			case 1:
-				glDepthFunc(GL_GEQUAL);
-				break;
-			case 3:
-				glDepthFunc(GL_GREATER);
-				break;
-			default:
-                printf("[GS] Unknown depth function selected!\n");
-                exit(1);
-			}
-
 			break;
 		case 0x49:
 			pabe = data;
@@ -255,7 +418,11 @@ namespace gs
 			break;
 		case 0x53:
 			trxdir = data;
-			data_written = 0;
+			rows_written = 0;
+			transfer_data.clear();
+
+			/* Pending draws must land before the transfer touches local memory */
+			renderer->render();
 			break;
 		default:
             printf("[GS] Writting 0x%lX to unknown address 0x%X\n", data, addr);
@@ -263,7 +430,7 @@ namespace gs
 		}
     }
 
-	void GraphicsSynthesizer::write_hwreg(uint64_t data)
+	void GraphicsSynthesizer::execute_hwreg(const uint128_t* data, uint32_t count)
 	{
 		/* HWREG is only used for GIF -> VRAM transfers */
 		if (trxdir != TRXDir::HostLocal)
@@ -272,72 +439,152 @@ namespace gs
             exit(1);
 			return;
 		}
-		
-		/* Useful for many things */
-		uint32_t width_in_pages = bitbltbuf.dest_width;
-		uint32_t width_in_pixels = trxreg.width;
+
+		auto bytes = (const uint8_t*)data;
+		uint32_t size = count * sizeof(uint128_t);
 
 		uint16_t format = bitbltbuf.dest_pixel_format;
 		switch (format)
 		{
 		case PixelFormat::PSMCT32:
-		{
-			/* HWREG values are 64bit so they pack 2 pixels together */
-			uint32_t* pixels = (uint32_t*)&data;
-			for (int i = 0; i < 2; i++)
-			{
-				uint16_t x = data_written % width_in_pixels;
-				uint16_t y = data_written / width_in_pixels;
-
-				x += trxpos.dest_top_left_x;
-				y += trxpos.dest_top_left_y;
-
-				/* Calculate which page we are refering to */
-				/* NOTE: x, y can refer to outside of the selected page (if their values are bigger than the page dimentions) */
-				/* Update the page accordingly. Loop back if the page is over the page width */
-				uint32_t page = bitbltbuf.dest_base / BLOCKS_PER_PAGE;
-				page += (x / Page::PIXEL_WIDTH) % width_in_pages + (y / Page::PIXEL_HEIGHT) * width_in_pages;
-				
-				vram[page].write_psmct32(x, y, pixels[i]);
-				data_written++;
-			}
-			
+			upload<PSMCT32>(bytes, size);
+			break;
+		case PixelFormat::PSMCT24:
+			upload<PSMCT24>(bytes, size);
 			break;
-		}
 		case PixelFormat::PSMCT16:
+			upload<PSMCT16>(bytes, size);
+			break;
+		case PixelFormat::PSMCT16S:
+			upload<PSMCT16S>(bytes, size);
+			break;
+		case PixelFormat::PSMCT8:
+			upload<PSMCT8>(bytes, size);
+			break;
+		case PixelFormat::PSMCT4:
+			upload<PSMCT4>(bytes, size);
+			break;
+		case PixelFormat::PSMCT8H:
+			upload<PSMCT8H>(bytes, size);
+			break;
+		case PixelFormat::PSMCT4HL:
+			upload<PSMCT4HL>(bytes, size);
+			break;
+		case PixelFormat::PSMCT4HH:
+			upload<PSMCT4HH>(bytes, size);
+			break;
+		case PixelFormat::PSMZ32:
+			upload<PSMZ32>(bytes, size);
+			break;
+		case PixelFormat::PSMZ24:
+			upload<PSMZ24>(bytes, size);
+			break;
+		case PixelFormat::PSMZ16:
+			upload<PSMZ16>(bytes, size);
+			break;
+		case PixelFormat::PSMZ16S:
+			upload<PSMZ16S>(bytes, size);
+			break;
+		default:
+            printf("[GS] Unknown texture format 0x%X\n", format);
+            exit(1);
+		}
+	}
+
+	template<PixelFormat fmt>
+	void GraphicsSynthesizer::upload(const uint8_t* data, uint32_t size)
+	{
+		using Info = FormatInfo<fmt>;
+		uint32_t width = trxreg.width, height = trxreg.height;
+
+		/* Rows always start on a byte */
+		uint32_t row_size = width * Info::BITS / 8;
+		if (width * Info::BITS % 8)
 		{
-			uint16_t* pixels = (uint16_t*)&data;
-			for (int i = 0; i < 4; i++)
-			{
-				uint16_t x = data_written % width_in_pixels;
-				uint16_t y = data_written / width_in_pixels;
+			printf("[GS] Transfer of width %d isn't a whole number of bytes per row\n", width);
+			exit(1);
+		}
 
-				x += trxpos.dest_top_left_x;
-				y += trxpos.dest_top_left_y;
+		/* Data past the end of the transfer is dropped */
+		while (size && rows_written < height)
+		{
+			/* Rows up to the next block boundary, or the end of the transfer */
+			uint32_t y = trxpos.dest_top_left_y + rows_written;
+			uint32_t rows = std::min<uint32_t>(Info::BLOCK_PIXEL_HEIGHT - y % Info::BLOCK_PIXEL_HEIGHT, height - rows_written);
+			uint32_t needed = rows * row_size;
 
-				uint32_t page = bitbltbuf.dest_base / BLOCKS_PER_PAGE;
-				page += (x / 64) % width_in_pages + (y / 64) * width_in_pages;
+			/* Skip the copy when the data holds the rows whole */
+			if (transfer_data.empty() && size >= needed)
+			{
+				upload_rows<fmt>(data, y, rows);
+				data += needed;
+				size -= needed;
+			}
+			else
+			{
+				uint32_t copied = std::min<uint32_t>(needed - transfer_data.size(), size);
+				transfer_data.insert(transfer_data.end(), data, data + copied);
+				data += copied;
+				size -= copied;
 
-				vram[page].write_psmct16(x, y, pixels[i]);
-				data_written++;
+				if (transfer_data.size() < needed)
+					break;
+
+				upload_rows<fmt>(transfer_data.data(), y, rows);
+				transfer_data.clear();
 			}
-			break;
-		}
-		default:
-            printf("[GS] Unknown texture format 0x%X\n", format);
-            exit(1);
+
+			rows_written += rows;
 		}
 
 		/* Check if transfer has completed */
-		if (data_written >= trxreg.width * trxreg.height)
+		if (rows_written >= height)
 		{
-			data_written = 0;
+			rows_written = 0;
+			transfer_data.clear();
 
 			/* Deactivate TRXDIR */
 			trxdir = TRXDir::None;
 		}
 	}
 
+	template<PixelFormat fmt>
+	void GraphicsSynthesizer::upload_rows(const uint8_t* data, uint32_t y, uint32_t rows)
+	{
+		using Info = FormatInfo<fmt>;
+		constexpr uint32_t BLOCK_WIDTH = Info::BLOCK_PIXEL_WIDTH;
+
+		auto memory = (uint8_t*)vram;
+		uint32_t base = bitbltbuf.dest_base, buffer_width = bitbltbuf.dest_width;
+		uint32_t width = trxreg.width;
+		uint32_t x0 = trxpos.dest_top_left_x, x1 = x0 + width;
+
+		/* Only rows covering whole blocks can be written a block at a time,
+		   and only if the blocks start on a byte of the data */
+		uint32_t block_x0 = x1, block_x1 = x1;
+		if (rows == Info::BLOCK_PIXEL_HEIGHT)
+		{
+			block_x0 = std::min((x0 + BLOCK_WIDTH - 1) & ~(BLOCK_WIDTH - 1), x1);
+			block_x1 = std::max(block_x0, x1 & ~(BLOCK_WIDTH - 1));
+			if ((block_x0 - x0) * Info::BITS % 8)
+				block_x0 = block_x1 = x1;
+		}
+
+		for (uint32_t x = block_x0; x < block_x1; x += BLOCK_WIDTH)
+			write_block<fmt>(memory, x, y, base, buffer_width, data + (x - x0) * Info::BITS / 8, width);
+
+		/* Unaligned edges a pixel at a time */
+		for (uint32_t row = 0; row < rows; row++)
+		{
+			uint32_t start = row * width;
+			for (uint32_t x = x0; x < block_x0; x++)
+				write_pixel<fmt>(memory, x, y + row, base, buffer_width, unpack_pixel<fmt>(data, start + x - x0));
+
+			for (uint32_t x = block_x1; x < x1; x++)
+				write_pixel<fmt>(memory, x, y + row, base, buffer_width, unpack_pixel<fmt>(data, start + x - x0));
+		}
+	}
+
     void GraphicsSynthesizer::submit_vertex_fog(XYZF xyzf, bool draw_kick)
     {
         GSVertex vertex;
@@ -356,21 +603,40 @@ namespace gs
         process_vertex(vertex, draw_kick);
     }
 
+    GSDrawState GraphicsSynthesizer::draw_state() const
+	{
+		/* PRIM always gives the type, the attributes can come from PRMODE */
+		uint64_t attributes = (prmodecont & 0x1) ? prim : (prim & 0x7) | (prmode & ~0x7ull);
+		int context = (attributes >> 9) & 0x1;
+
+		GSDrawState state;
+		state.prim = attributes;
+		state.frame = frame[context];
+		state.zbuf = zbuf[context];
+		state.test = test[context];
+		state.alpha = alpha[context];
+		state.scissor = scissor[context];
+		state.fba = fba[context];
+		state.pabe = pabe;
+		state.colclamp = colclamp;
+		state.dthe = dthe;
+		return state;
+	}
+
     void GraphicsSynthesizer::process_vertex(GSVertex vertex, bool draw_kick)
 	{
-		/* Convert the primitive coords to window coords */
-		vertex.x = (vertex.x - xyoffset[0].x_offset) / 16.0f;
-		vertex.y = (vertex.y - xyoffset[0].y_offset) / 16.0f;
+		GSDrawState state = draw_state();
+		int context = (state.prim >> 9) & 0x1;
 
-		/* Convert to OpenGL coords */
-		vertex.x = (vertex.x / 320.0f) - 1.0f;
-		vertex.y = 1.0f - (vertex.y / 112.0f);
-        vertex.z = vertex.z / static_cast<float>(INT_MAX);
+		/* Convert the primitive coords to window coords */
+		vertex.x = (vertex.x - xyoffset[context].x_offset) / 16.0f;
+		vertex.y = (vertex.y - xyoffset[context].y_offset) / 16.0f;
 		
 		/* Set color information */
-		vertex.r = rgbaq.r / 255.0f;
-		vertex.g = rgbaq.g / 255.0f;
-		vertex.b = rgbaq.b / 255.0f;
+		vertex.r = rgbaq.r;
+		vertex.g = rgbaq.g;
+		vertex.b = rgbaq.b;
+		vertex.a = rgbaq.a;
 
 		if (!vqueue.push(vertex))
 		{
@@ -390,7 +656,8 @@ namespace gs
                     GSVertex v1, v2;
                     vqueue.read(&v1); vqueue.pop();
                     vqueue.read(&v2); vqueue.pop();
-                    renderer.submit_sprite(v1, v2);
+                    renderer->set_draw_state(state);
+                    renderer->submit_sprite(v1, v2);
                     break;
                 }
                 break;
@@ -398,15 +665,30 @@ namespace gs
                 switch (prim & 0x7)
                 {
                 case Primitive::Triangle:
-                    GSVertex v;
+                case Primitive::TriangleStrip:
+                case Primitive::TriangleFan:
+                    GSVertex v[3];
+                    renderer->set_draw_state(state);
                     for (int i = 0; i < 3; i++)
                     {
-                        vqueue.read(&v);
+                        vqueue.read(&v[i]);
                         bool f = vqueue.pop();
 
                         assert(f);
 
-                        renderer.submit_vertex(v);
+                        renderer->submit_vertex(v[i]);
+                    }
+
+                    /* Strips keep the last two vertices, fans the first and the last */
+                    if ((prim & 0x7) == Primitive::TriangleStrip)
+                    {
+                        vqueue.push(v[1]);
+                        vqueue.push(v[2]);
+                    }
+                    else if ((prim & 0x7) == Primitive::TriangleFan)
+                    {
+                        vqueue.push(v[0]);
+                        vqueue.push(v[2]);
                     }
                     break;
                 }
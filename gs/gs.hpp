@@ -3,7 +3,13 @@
 #include <gs/gsvram.h>
 #include <gs/gsrenderer.hpp>
 #include <gs/queue.h>
+#include <spsc_queue.hpp>
+#include <int128.h>
+#include <atomic>
 #include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 namespace gs
 {
@@ -156,13 +162,24 @@ namespace gs
 		None = 3
 	};
 
+	/* Work handed from the emulation thread to the GS thread, already
+	   decoded by the GIF into register writes. HWREG carries its qword
+	   count in addr and is followed by that many qwords of data */
+	struct GSCommand
+	{
+		enum Type : uint16_t { Write, HWREG, Tag, Render } type;
+		uint16_t addr;
+		uint64_t data;
+	};
+	static_assert(sizeof(GSCommand) == sizeof(uint128_t));
+
 	struct GraphicsSynthesizer
 	{
 		friend struct GIF;
-		GraphicsSynthesizer();
+		GraphicsSynthesizer(std::unique_ptr<GSRenderer> renderer);
 		~GraphicsSynthesizer();
 
-		/* Used by the EE */
+		/* Used by the EE. Reads wait for the GS thread to catch up */
 		uint64_t read_priv(uint32_t addr);
 		void write_priv(uint32_t addr, uint64_t data);
 
@@ -170,16 +187,58 @@ namespace gs
 		uint64_t read(uint16_t addr);
 		void write(uint16_t addr, uint64_t data);
 
-		/* Transfer data to/from VRAM */
-		void write_hwreg(uint64_t data);
+		/* Transfer data to/from VRAM, in qwords as sent by the GIF */
+		void write_hwreg(const uint128_t* data, uint32_t count);
+
+		/* A new GIFtag loads PRIM when PRE is set and resets Q */
+		void start_packet(bool pre, uint64_t prim);
+
+		/* Flushes the renderer, called once per frame */
+		void render();
+
+		/* Runs everything above on its own host thread, fed by a command
+		   ring. The renderer is then used from that thread only, so it
+		   can't be a GL one */
+		void set_thread(bool enable);
+
+		/* Waits until the GS thread has executed every posted command */
+		void sync();
 
 	private:
+		void execute_write(uint16_t addr, uint64_t data);
+		void execute_hwreg(const uint128_t* data, uint32_t count);
+		void execute_tag(bool pre, uint64_t prim);
+
+		/* Host to local transfers gather the rows of one block row, which
+		   then go to local memory a block at a time where aligned */
+		template<PixelFormat fmt>
+		void upload(const uint8_t* data, uint32_t size);
+		template<PixelFormat fmt>
+		void upload_rows(const uint8_t* data, uint32_t y, uint32_t rows);
+
+		void thread_main();
+		bool run_command();
+		void post(GSCommand command);
+
 		/* Registers the new vertex. If there are enough vertices,
 		a primitive is drawn based on the PRIM setting */
         void submit_vertex(XYZ xyz, bool draw_kick);
         void submit_vertex_fog(XYZF xyzf, bool draw_kick);
         void process_vertex(GSVertex vertex, bool draw_kick);
 
+		/* Registers of the context selected by the current primitive */
+		GSDrawState draw_state() const;
+
+	private:
+		std::thread thread;
+		std::atomic<bool> thread_quit = false;
+		/* Only the emulation thread posts, so it tracks the count alone */
+		uint64_t commands_posted = 0;
+		std::atomic<uint64_t> commands_done = 0;
+		std::unique_ptr<SPSCQueue<GSCommand, 1 << 16>> commands;
+		/* HWREG payloads are split so the GS thread can pop them in one go */
+		constexpr static uint32_t HWREG_CHUNK = 64;
+
 	public:
 		GSPRegs priv_regs = {};
 		
@@ -192,14 +251,14 @@ namespace gs
 		uint64_t tex0[2] = {}, tex1[2] = {}, tex2[2] = {};
 		uint64_t clamp[2] = {}, fog = 0, fogcol = 0;
 		XYOFFSET xyoffset[2] = {};
-		uint64_t prmodecont = 0, prmode = 0;
+		uint64_t prmodecont = 1, prmode = 0;
 		uint64_t texclut = 0, scanmsk = 0;
 		uint64_t miptbp1[2] = {}, miptbp2[2] = {};
 		uint64_t texa = 0, texflush = 0;
 		uint64_t scissor[2] = {}, alpha[2] = {};
 		uint64_t dimx = 0, dthe = 0, colclamp = 0;
 		uint64_t test[2] = {};
-		uint64_t pabe = 0, fba[2];
+		uint64_t pabe = 0, fba[2] = {};
 		uint64_t frame[2] = {}, zbuf[2] = {};
 		BITBLTBUF bitbltbuf = {};
 		TRXPOS trxpos = {};
@@ -211,10 +270,12 @@ namespace gs
 		
 		/* GS VRAM is divided into 8K pages */
 		Page* vram = nullptr;
-		/* Used to track how many pixels where written during a transfer */
-		int data_written = 0;
+		/* Rows of the transfer already in local memory and the data
+		   of the next ones */
+		uint32_t rows_written = 0;
+		std::vector<uint8_t> transfer_data;
 
 		/* Used the render with various GPU accelerated backends */
-		GSRenderer renderer;
+		std::unique_ptr<GSRenderer> renderer;
 	};
 }
\ No newline at end of file
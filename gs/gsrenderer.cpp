@@ -1,4 +1,5 @@
 #include <gs/gsrenderer.hpp>
+#include <climits>
 #include <glad/glad.h>
 #include <cstdio>
 #include <cstdlib>
@@ -28,7 +29,7 @@ void main()
 
 namespace gs
 {
-	GSRenderer::GSRenderer()
+	GLRenderer::GLRenderer()
 	{
         int success;
         char infoLog[513];
@@ -91,41 +92,70 @@ namespace gs
         glBindVertexArray(vao);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GSVertex) * 1024 * 512, nullptr, GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLVertex) * 1024 * 512, nullptr, GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GSVertex), (void*)0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GLVertex), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GSVertex), (void*)(3 * sizeof(float)));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GLVertex), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(1);
 
-        /* Enable depth testing */
+        /* Enable depth testing, the function follows ZTST from the first draw */
         glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
 	}
     
-    void GSRenderer::render()
+    void GLRenderer::render()
     {
         /* Add data to the VBO */
-        glBufferSubData(GL_ARRAY_BUFFER, 0, draw_data.size() * sizeof(GSVertex), draw_data.data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, draw_data.size() * sizeof(GLVertex), draw_data.data());
 
         /* Draw vertices */
         glDrawArrays(GL_TRIANGLES, 0, draw_data.size());
         
         draw_data.clear();
     }
+
+    /* The viewport is fixed at 640x224 for now */
+    GLRenderer::GLVertex GLRenderer::to_gl(const GSVertex& v)
+    {
+        GLVertex vertex;
+        vertex.x = (v.x / 320.0f) - 1.0f;
+        vertex.y = 1.0f - (v.y / 112.0f);
+        vertex.z = v.z / static_cast<float>(INT_MAX);
+        vertex.r = v.r / 255.0f;
+        vertex.g = v.g / 255.0f;
+        vertex.b = v.b / 255.0f;
+        return vertex;
+    }
     
-    void GSRenderer::submit_vertex(GSVertex v1)
+    void GLRenderer::submit_vertex(GSVertex v1)
+    {
+        draw_data.push_back(to_gl(v1));
+    }
+
+    void GLRenderer::submit_sprite(GSVertex v1, GSVertex v2)
     {
-        draw_data.push_back(v1);
+        GLVertex p1 = to_gl(v1), p2 = to_gl(v2);
+        draw_data.push_back({ .x = p2.x, .y = p1.y });
+        draw_data.push_back({ .x = p2.x, .y = p2.y });
+        draw_data.push_back({ .x = p1.x, .y = p1.y });
+        draw_data.push_back({ .x = p2.x, .y = p2.y });
+        draw_data.push_back({ .x = p1.x, .y = p2.y });
+        draw_data.push_back({ .x = p1.x, .y = p1.y });
     }
 
-    void GSRenderer::submit_sprite(GSVertex v1, GSVertex v2)
+    void GLRenderer::set_draw_state(const GSDrawState& state)
     {
-        draw_data.push_back({ .x = v2.x, .y = v1.y });
-        draw_data.push_back({ .x = v2.x, .y = v2.y });
-        draw_data.push_back({ .x = v1.x, .y = v1.y });
-        draw_data.push_back({ .x = v2.x, .y = v2.y });
-        draw_data.push_back({ .x = v1.x, .y = v2.y });
-        draw_data.push_back({ .x = v1.x, .y = v1.y });
+        uint32_t ztst = (state.test >> 17) & 0x3;
+        if (ztst == depth_test)
+            return;
+
+        /* Vertices already queued were kicked with the old test */
+        render();
+        depth_test = ztst;
+
+        static const GLenum functions[] = { GL_NEVER, GL_ALWAYS, GL_GEQUAL, GL_GREATER };
+        glDepthFunc(functions[ztst]);
     }
 }
\ No newline at end of file
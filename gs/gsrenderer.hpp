@@ -16,21 +16,79 @@ namespace gs
         Sprite = 6
     };
 
+    struct Page;
+
+    /* x and y are window coordinates in pixels, XYOFFSET already applied,
+       z is the raw depth value from XYZ/XYZF */
     struct GSVertex
     {
-        float x, y, z = 0;
-        float r = 0.0f, g = 0.0f, b = 0.0f;
+        float x, y;
+        uint32_t z = 0;
+        uint8_t r = 0, g = 0, b = 0, a = 0;
+    };
+
+    /* Registers that decide how a primitive is drawn, latched for the
+       context it selects when it's kicked */
+    struct GSDrawState
+    {
+        /* PRIM, or PRMODE's attributes when PRMODECONT.AC is cleared */
+        uint64_t prim;
+        uint64_t frame, zbuf, test, alpha, scissor, fba;
+        uint64_t pabe, colclamp, dthe;
+
+        bool operator==(const GSDrawState&) const = default;
     };
 
+    /* Interface the GS hands its primitives to */
     struct GSRenderer
     {
-        GSRenderer();
-        void render();
+        virtual ~GSRenderer() = default;
 
-        void submit_vertex(GSVertex v1);
-        void submit_sprite(GSVertex v1, GSVertex v2);
+        virtual void render() = 0;
+
+        /* Local memory, for backends that draw into it */
+        virtual void set_vram(Page*) {}
+        /* Called with the current state before every primitive is submitted */
+        virtual void set_draw_state(const GSDrawState&) {}
+
+        virtual void submit_vertex(GSVertex v1) = 0;
+        virtual void submit_sprite(GSVertex v1, GSVertex v2) = 0;
+    };
+
+    /* Draws through OpenGL, needs a current context on construction */
+    struct GLRenderer : public GSRenderer
+    {
+        GLRenderer();
+
+        void render() override;
+
+        /* Only the depth test is applied, which flushes the batch */
+        void set_draw_state(const GSDrawState& state) override;
+
+        void submit_vertex(GSVertex v1) override;
+        void submit_sprite(GSVertex v1, GSVertex v2) override;
     private:
+        /* Normalized device coordinates and color */
+        struct GLVertex
+        {
+            float x, y, z = 0;
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+        };
+
+        static GLVertex to_gl(const GSVertex& v);
+
         uint32_t vbo, vao;
-        std::vector<GSVertex> draw_data;
+        std::vector<GLVertex> draw_data;
+        /* ZTST of the batch, GL starts out with ALWAYS */
+        uint32_t depth_test = 1;
+    };
+
+    /* Discards everything, used when running without a window */
+    struct NullRenderer : public GSRenderer
+    {
+        void render() override {}
+
+        void submit_vertex(GSVertex) override {}
+        void submit_sprite(GSVertex, GSVertex) override {}
     };
 };
\ No newline at end of file
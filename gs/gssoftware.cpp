@@ -0,0 +1,579 @@
+#include <gs/gssoftware.hpp>
+#include <gs/gsvram.h>
+#include <logger.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gs
+{
+    /* Flush early instead of letting a single frame queue without bound */
+    constexpr size_t MAX_QUEUED_PRIMITIVES = 1 << 16;
+
+    /* FBP, FBW and PSM of FRAME, ZBP and PSM of ZBUF. Together they decide
+       which address each screen position ends up at */
+    constexpr uint64_t FRAME_LAYOUT_MASK = 0x3F3F01FF;
+    constexpr uint64_t ZBUF_LAYOUT_MASK = 0x0F0001FF;
+
+    static RasterState decode_state(const GSDrawState& regs)
+    {
+        RasterState state;
+        state.fbp = (regs.frame & 0x1FF) * BLOCKS_PER_PAGE;
+        state.fbw = (regs.frame >> 16) & 0x3F;
+        state.fpsm = (regs.frame >> 24) & 0x3F;
+        state.fbmsk = regs.frame >> 32;
+
+        state.zbp = (regs.zbuf & 0x1FF) * BLOCKS_PER_PAGE;
+        state.zpsm = 0x30 | ((regs.zbuf >> 24) & 0xF);
+        state.zmsk = (regs.zbuf >> 32) & 0x1;
+
+        state.ate = regs.test & 0x1;
+        state.atst = (regs.test >> 1) & 0x7;
+        state.aref = (regs.test >> 4) & 0xFF;
+        state.afail = (regs.test >> 12) & 0x3;
+        state.date = (regs.test >> 14) & 0x1;
+        state.datm = (regs.test >> 15) & 0x1;
+        state.zte = (regs.test >> 16) & 0x1;
+        state.ztst = (regs.test >> 17) & 0x3;
+
+        state.abe = (regs.prim >> 6) & 0x1;
+        state.blend_a = regs.alpha & 0x3;
+        state.blend_b = (regs.alpha >> 2) & 0x3;
+        state.blend_c = (regs.alpha >> 4) & 0x3;
+        state.blend_d = (regs.alpha >> 6) & 0x3;
+        state.fix = (regs.alpha >> 32) & 0xFF;
+        state.pabe = regs.pabe & 0x1;
+        state.clamp = regs.colclamp & 0x1;
+        state.fba = regs.fba & 0x1;
+
+        /* Only the 16bit formats have a 1bit alpha to test */
+        if (state.fpsm == PSMCT24 || state.fpsm == PSMZ24)
+            state.date = false;
+
+        bool depth_access = state.zte || !state.zmsk;
+        state.vectorizable = !(state.fpsm & 0x2) && (!depth_access || !(state.zpsm & 0x2));
+        return state;
+    }
+
+    static uint32_t buffer_address(uint32_t psm, int x, int y, uint32_t base, uint32_t width)
+    {
+        switch (psm)
+        {
+        case PSMCT32:
+            return pixel_address<PSMCT32>(x, y, base, width);
+        case PSMCT24:
+            return pixel_address<PSMCT24>(x, y, base, width);
+        case PSMCT16:
+            return pixel_address<PSMCT16>(x, y, base, width);
+        case PSMCT16S:
+            return pixel_address<PSMCT16S>(x, y, base, width);
+        case PSMZ32:
+            return pixel_address<PSMZ32>(x, y, base, width);
+        case PSMZ24:
+            return pixel_address<PSMZ24>(x, y, base, width);
+        case PSMZ16:
+            return pixel_address<PSMZ16>(x, y, base, width);
+        case PSMZ16S:
+            return pixel_address<PSMZ16S>(x, y, base, width);
+        }
+
+        return 0;
+    }
+
+    static bool is_16bit(uint32_t psm)
+    {
+        return psm & 0x2;
+    }
+
+    static bool supported_format(uint32_t psm)
+    {
+        switch (psm)
+        {
+        case PSMCT32: case PSMCT24: case PSMCT16: case PSMCT16S:
+        case PSMZ32: case PSMZ24: case PSMZ16: case PSMZ16S:
+            return true;
+        }
+
+        return false;
+    }
+
+    /* Frame buffer pixels are handled as RGBA8888 */
+    static uint32_t read_frame(const uint8_t* vram, uint32_t psm, uint32_t address)
+    {
+        if (is_16bit(psm))
+        {
+            uint32_t value = ((const uint16_t*)vram)[address];
+            return ((value & 0x1F) << 3) | ((value & 0x3E0) << 6) |
+                   ((value & 0x7C00) << 9) | ((value & 0x8000) ? 0x80000000 : 0);
+        }
+
+        uint32_t value = ((const uint32_t*)vram)[address];
+        return (psm & 0x1) ? (value & 0xFFFFFF) | 0x80000000 : value;
+    }
+
+    static void write_frame(uint8_t* vram, uint32_t psm, uint32_t address, uint32_t value)
+    {
+        if (is_16bit(psm))
+        {
+            ((uint16_t*)vram)[address] = ((value >> 3) & 0x1F) | ((value >> 6) & 0x3E0) |
+                                         ((value >> 9) & 0x7C00) | ((value >> 16) & 0x8000);
+        }
+        else if (psm & 0x1)
+        {
+            /* The upper byte is left alone */
+            auto& pixel = ((uint32_t*)vram)[address];
+            pixel = (pixel & 0xFF000000) | (value & 0xFFFFFF);
+        }
+        else
+            ((uint32_t*)vram)[address] = value;
+    }
+
+    static bool alpha_test(const RasterState& state, uint32_t alpha)
+    {
+        switch (state.atst)
+        {
+        case 0: return false;
+        case 1: return true;
+        case 2: return alpha < state.aref;
+        case 3: return alpha <= state.aref;
+        case 4: return alpha == state.aref;
+        case 5: return alpha >= state.aref;
+        case 6: return alpha > state.aref;
+        default: return alpha != state.aref;
+        }
+    }
+
+    static int blend_input(uint32_t select, int source, int dest)
+    {
+        return select == 0 ? source : select == 1 ? dest : 0;
+    }
+
+    /* The full pixel pipeline: alpha test, destination alpha test, depth
+       test, alpha blending and the masked writes. color is RGBA8888 */
+    static void draw_pixel(uint8_t* vram, const RasterState& state, int x, int y, uint32_t z, uint32_t color)
+    {
+        bool write_color = true, write_alpha = true;
+        bool write_depth = !state.zmsk;
+
+        if (state.ate && !alpha_test(state, color >> 24))
+        {
+            switch (state.afail)
+            {
+            case 0:
+                return;
+            case 1:
+                write_depth = false;
+                break;
+            case 2:
+                write_color = false;
+                break;
+            case 3:
+                write_depth = false;
+                write_alpha = false;
+                break;
+            }
+        }
+
+        uint32_t frame_address = buffer_address(state.fpsm, x, y, state.fbp, state.fbw);
+        uint32_t dest = read_frame(vram, state.fpsm, frame_address);
+        if (state.date && (dest >> 31) != state.datm)
+            return;
+
+        /* Depth is clamped to what the format can hold */
+        if (state.zpsm & 0x2)
+            z = std::min(z, 0xFFFFu);
+        else if (state.zpsm & 0x1)
+            z = std::min(z, 0xFFFFFFu);
+
+        uint32_t depth_address = buffer_address(state.zpsm, x, y, state.zbp, state.fbw);
+        if (state.zte)
+        {
+            uint32_t depth = is_16bit(state.zpsm) ? ((uint16_t*)vram)[depth_address] :
+                                                     ((uint32_t*)vram)[depth_address] & ((state.zpsm & 0x1) ? 0xFFFFFF : 0xFFFFFFFF);
+            switch (state.ztst)
+            {
+            case 0:
+                return;
+            case 2:
+                if (z < depth)
+                    return;
+                break;
+            case 3:
+                if (z <= depth)
+                    return;
+                break;
+            }
+        }
+
+        if (write_color)
+        {
+            uint32_t alpha = color >> 24;
+            uint32_t result = color & 0xFFFFFF;
+            if (state.abe && !(state.pabe && !(alpha & 0x80)))
+            {
+                int coefficient = state.blend_c == 0 ? alpha : state.blend_c == 1 ? dest >> 24 : state.fix;
+
+                result = 0;
+                for (int i = 0; i < 24; i += 8)
+                {
+                    int source = (color >> i) & 0xFF;
+                    int target = (dest >> i) & 0xFF;
+                    int a = blend_input(state.blend_a, source, target);
+                    int b = blend_input(state.blend_b, source, target);
+                    int d = blend_input(state.blend_d, source, target);
+
+                    int value = (((a - b) * coefficient) >> 7) + d;
+                    value = state.clamp ? std::clamp(value, 0, 255) : value & 0xFF;
+                    result |= value << i;
+                }
+            }
+
+            if (state.fba)
+                alpha |= 0x80;
+
+            result |= (write_alpha ? alpha : dest >> 24) << 24;
+            result = (result & ~state.fbmsk) | (dest & state.fbmsk);
+            write_frame(vram, state.fpsm, frame_address, result);
+        }
+
+        if (write_depth)
+        {
+            if (is_16bit(state.zpsm))
+                ((uint16_t*)vram)[depth_address] = z;
+            else if (state.zpsm & 0x1)
+            {
+                auto& depth = ((uint32_t*)vram)[depth_address];
+                depth = (depth & 0xFF000000) | z;
+            }
+            else
+                ((uint32_t*)vram)[depth_address] = z;
+        }
+    }
+
+    void draw_span_scalar(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1)
+    {
+        int64_t edge[3];
+        for (int i = 0; i < 3; i++)
+            edge[i] = setup.edge[i] + setup.edge_dx[i] * x0 + setup.edge_dy[i] * y;
+
+        for (int x = x0; x <= x1; x++)
+        {
+            bool inside = setup.sprite || (edge[0] >= 0 && edge[1] >= 0 && edge[2] >= 0);
+            for (int i = 0; i < 3; i++)
+                edge[i] += setup.edge_dx[i];
+
+            if (!inside)
+                continue;
+
+            uint32_t color = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                float value = setup.color[i] + setup.color_dx[i] * x + setup.color_dy[i] * y;
+                color |= (uint32_t)std::clamp((int)value, 0, 255) << (i * 8);
+            }
+
+            double z = setup.z + setup.z_dx * x + setup.z_dy * y;
+            z = std::clamp(z, 0.0, 4294967295.0);
+
+            draw_pixel(vram, state, x, y, (uint32_t)z, color);
+        }
+    }
+
+    SpanFunction select_span_function()
+    {
+        if (__builtin_cpu_supports("avx2"))
+            return draw_span_avx2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return draw_span_sse41;
+
+        return draw_span_scalar;
+    }
+
+    SoftwareRenderer::SoftwareRenderer(uint32_t threads)
+    : draw_span(select_span_function())
+    {
+        if (!threads)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        /* The thread calling render() does its share of the tiles */
+        for (uint32_t i = 1; i < threads; i++)
+            workers.emplace_back(&SoftwareRenderer::worker_main, this);
+    }
+
+    SoftwareRenderer::~SoftwareRenderer()
+    {
+        {
+            std::lock_guard guard(lock);
+            quit = true;
+        }
+
+        work_ready.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void SoftwareRenderer::set_vram(Page* vram)
+    {
+        this->vram = (uint8_t*)vram;
+    }
+
+    void SoftwareRenderer::set_draw_state(const GSDrawState& state)
+    {
+        if (!state_changed && state == current_state)
+            return;
+
+        /* Tiles only keep workers apart while every queued primitive maps a
+           screen position to the same address, so draw what's queued before
+           the buffers move or change layout */
+        if ((state.frame ^ current_state.frame) & FRAME_LAYOUT_MASK ||
+            (state.zbuf ^ current_state.zbuf) & ZBUF_LAYOUT_MASK)
+            render();
+
+        current_state = state;
+        state_changed = true;
+    }
+
+    void SoftwareRenderer::submit_vertex(GSVertex v1)
+    {
+        triangle[vertex_count++] = v1;
+        if (vertex_count == 3)
+        {
+            setup_triangle(triangle[0], triangle[1], triangle[2]);
+            vertex_count = 0;
+        }
+    }
+
+    void SoftwareRenderer::submit_sprite(GSVertex v1, GSVertex v2)
+    {
+        setup_sprite(v1, v2);
+    }
+
+    /* Vertex positions are 12.4 fixed point like on the GS, pixels are
+       sampled at their integer coordinates */
+    void SoftwareRenderer::setup_triangle(GSVertex v1, GSVertex v2, GSVertex v3)
+    {
+        const GSVertex* v[3] = { &v1, &v2, &v3 };
+        int64_t x[3], y[3];
+        for (int i = 0; i < 3; i++)
+        {
+            x[i] = std::lround(v[i]->x * 16.0f);
+            y[i] = std::lround(v[i]->y * 16.0f);
+        }
+
+        int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (!area)
+            return;
+
+        /* Keep a single winding so the inside is always positive */
+        if (area < 0)
+        {
+            std::swap(v[1], v[2]);
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            area = -area;
+        }
+
+        SpanSetup setup = {};
+        setup.sprite = false;
+        for (int i = 0; i < 3; i++)
+        {
+            /* Edge opposite to vertex i */
+            int a = (i + 1) % 3, b = (i + 2) % 3;
+            int64_t dx = x[b] - x[a], dy = y[b] - y[a];
+
+            /* Pixels exactly on an edge only belong to top and left edges */
+            bool top_left = dy < 0 || (dy == 0 && dx > 0);
+
+            setup.edge_dx[i] = -dy * 16;
+            setup.edge_dy[i] = dx * 16;
+            setup.edge[i] = dy * x[a] - dx * y[a] - (top_left ? 0 : 1);
+        }
+
+        /* Plane equations in pixels, flat shading takes the last vertex's color */
+        bool gouraud = (current_state.prim >> 3) & 0x1;
+        auto plane = [&](double a0, double a1, double a2, double& value, double& ddx, double& ddy)
+        {
+            ddx = ((a1 - a0) * (y[2] - y[0]) - (a2 - a0) * (y[1] - y[0])) * 16.0 / area;
+            ddy = ((a2 - a0) * (x[1] - x[0]) - (a1 - a0) * (x[2] - x[0])) * 16.0 / area;
+            value = a0 - ddx * x[0] / 16.0 - ddy * y[0] / 16.0;
+        };
+
+        const uint8_t* colors[3] = { &v[0]->r, &v[1]->r, &v[2]->r };
+        for (int i = 0; i < 4; i++)
+        {
+            if (gouraud)
+            {
+                double value, ddx, ddy;
+                plane(colors[0][i], colors[1][i], colors[2][i], value, ddx, ddy);
+                setup.color[i] = value;
+                setup.color_dx[i] = ddx;
+                setup.color_dy[i] = ddy;
+            }
+            else
+                setup.color[i] = (&v3.r)[i];
+        }
+
+        plane(v[0]->z, v[1]->z, v[2]->z, setup.z, setup.z_dx, setup.z_dy);
+
+        setup.x0 = (*std::min_element(x, x + 3) + 15) >> 4;
+        setup.y0 = (*std::min_element(y, y + 3) + 15) >> 4;
+        setup.x1 = *std::max_element(x, x + 3) >> 4;
+        setup.y1 = *std::max_element(y, y + 3) >> 4;
+        queue_primitive(setup);
+    }
+
+    /* Sprites cover the pixels from the first vertex up to, but not
+       including, the second and take depth and color from the second */
+    void SoftwareRenderer::setup_sprite(GSVertex v1, GSVertex v2)
+    {
+        int64_t x0 = std::lround(v1.x * 16.0f), x1 = std::lround(v2.x * 16.0f);
+        int64_t y0 = std::lround(v1.y * 16.0f), y1 = std::lround(v2.y * 16.0f);
+        if (x0 > x1)
+            std::swap(x0, x1);
+        if (y0 > y1)
+            std::swap(y0, y1);
+
+        SpanSetup setup = {};
+        setup.sprite = true;
+        for (int i = 0; i < 4; i++)
+            setup.color[i] = (&v2.r)[i];
+        setup.z = v2.z;
+
+        setup.x0 = (x0 + 15) >> 4;
+        setup.y0 = (y0 + 15) >> 4;
+        setup.x1 = (x1 - 1) >> 4;
+        setup.y1 = (y1 - 1) >> 4;
+        queue_primitive(setup);
+    }
+
+    void SoftwareRenderer::queue_primitive(const SpanSetup& primitive)
+    {
+        if (!vram)
+            return;
+
+        if (state_changed)
+        {
+            raster_states.push_back(decode_state(current_state));
+            state_changed = false;
+        }
+
+        const RasterState& state = raster_states.back();
+        if (!supported_format(state.fpsm))
+        {
+            LOG(GS, Warn, "[GS] Software renderer can't draw to format 0x%X\n", state.fpsm);
+            return;
+        }
+
+        /* Clip to the scissor, which also keeps everything inside the 2048x2048 window */
+        SpanSetup setup = primitive;
+        setup.state = raster_states.size() - 1;
+        setup.x0 = std::max<int>(setup.x0, current_state.scissor & 0x7FF);
+        setup.x1 = std::min<int>(setup.x1, (current_state.scissor >> 16) & 0x7FF);
+        setup.y0 = std::max<int>(setup.y0, (current_state.scissor >> 32) & 0x7FF);
+        setup.y1 = std::min<int>(setup.y1, (current_state.scissor >> 48) & 0x7FF);
+        if (setup.x0 > setup.x1 || setup.y0 > setup.y1)
+            return;
+
+        uint32_t index = primitives.size();
+        primitives.push_back(setup);
+
+        for (int ty = setup.y0 / TILE_HEIGHT; ty <= setup.y1 / TILE_HEIGHT; ty++)
+        {
+            for (int tx = setup.x0 / TILE_WIDTH; tx <= setup.x1 / TILE_WIDTH; tx++)
+            {
+                auto& bin = bins[ty * TILES_X + tx];
+                if (bin.empty())
+                    used_tiles.push_back(ty * TILES_X + tx);
+
+                bin.push_back(index);
+            }
+        }
+
+        if (primitives.size() >= MAX_QUEUED_PRIMITIVES)
+            render();
+    }
+
+    void SoftwareRenderer::draw_tile(uint32_t tile)
+    {
+        int tile_x0 = (tile % TILES_X) * TILE_WIDTH;
+        int tile_y0 = (tile / TILES_X) * TILE_HEIGHT;
+
+        for (uint32_t index : bins[tile])
+        {
+            const SpanSetup& setup = primitives[index];
+            const RasterState& state = raster_states[setup.state];
+
+            int x0 = std::max(setup.x0, tile_x0);
+            int x1 = std::min(setup.x1, tile_x0 + TILE_WIDTH - 1);
+            int y0 = std::max(setup.y0, tile_y0);
+            int y1 = std::min(setup.y1, tile_y0 + TILE_HEIGHT - 1);
+
+            for (int y = y0; y <= y1; y++)
+                draw_span(vram, state, setup, y, x0, x1);
+        }
+
+        bins[tile].clear();
+    }
+
+    void SoftwareRenderer::draw_tiles()
+    {
+        uint32_t tile;
+        while ((tile = next_tile.fetch_add(1, std::memory_order_relaxed)) < used_tiles.size())
+            draw_tile(used_tiles[tile]);
+    }
+
+    void SoftwareRenderer::worker_main()
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock guard(lock);
+                work_ready.wait(guard, [&] { return quit || generation != seen; });
+                if (quit)
+                    return;
+
+                seen = generation;
+            }
+
+            draw_tiles();
+
+            std::lock_guard guard(lock);
+            if (!--busy_workers)
+                work_done.notify_one();
+        }
+    }
+
+    void SoftwareRenderer::render()
+    {
+        if (primitives.empty())
+            return;
+
+        next_tile.store(0, std::memory_order_relaxed);
+        if (!workers.empty())
+        {
+            {
+                std::lock_guard guard(lock);
+                busy_workers = workers.size();
+                generation++;
+            }
+
+            work_ready.notify_all();
+        }
+
+        draw_tiles();
+
+        if (!workers.empty())
+        {
+            std::unique_lock guard(lock);
+            work_done.wait(guard, [&] { return !busy_workers; });
+        }
+
+        primitives.clear();
+        used_tiles.clear();
+
+        /* Keep only the current state around */
+        raster_states.clear();
+        state_changed = true;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <gs/gsrenderer.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gs
+{
+    /* Draw state decoded once for every distinct GSDrawState */
+    struct RasterState
+    {
+        uint32_t fbp, fbw, fpsm, fbmsk;
+        uint32_t zbp, zpsm;
+        bool zmsk;
+
+        bool zte;
+        uint32_t ztst;
+        bool ate, date, datm;
+        uint32_t atst, aref, afail;
+
+        bool abe, pabe, clamp, fba;
+        uint32_t blend_a, blend_b, blend_c, blend_d, fix;
+
+        /* 32 and 24bit color and depth, the vector kernels handle nothing else */
+        bool vectorizable;
+    };
+
+    /* A primitive ready to be rasterized. Edges are 0 or positive inside
+       the primitive, with the top-left fill rule already folded in. Every
+       value is given at pixel (0, 0) together with its step per pixel */
+    struct SpanSetup
+    {
+        /* Index into the renderer's queued states */
+        uint32_t state;
+
+        /* Sprites are axis aligned and cover their whole rectangle */
+        bool sprite;
+        int64_t edge[3], edge_dx[3], edge_dy[3];
+
+        float color[4], color_dx[4], color_dy[4];
+        double z, z_dx, z_dy;
+
+        /* Pixels covered, inclusive and already clipped to the scissor */
+        int x0, y0, x1, y1;
+    };
+
+    /* Draws pixels x0 to x1 (inclusive) of row y */
+    using SpanFunction = void (*)(uint8_t* vram, const RasterState& state, const SpanSetup& setup,
+                                  int y, int x0, int x1);
+
+    /* Span kernels. The vector ones need the matching CPU support and pass
+       states that aren't vectorizable on to the scalar one */
+    void draw_span_scalar(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1);
+    void draw_span_sse41(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1);
+    void draw_span_avx2(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1);
+
+    /* The fastest kernel the CPU supports */
+    SpanFunction select_span_function();
+
+    /* Draws into local memory on the CPU. Primitives are queued with the
+       state they were kicked with and binned into tiles, render() then
+       rasterizes the tiles on a pool of worker threads. A batch never mixes
+       frame or Z buffer layouts, changing them draws what's queued first.
+       That way a tile only covers its own addresses, workers never touch
+       the same memory and every tile draws its primitives in submission
+       order */
+    struct SoftwareRenderer : public GSRenderer
+    {
+        constexpr static int TILE_WIDTH = 64;
+        constexpr static int TILE_HEIGHT = 32;
+        constexpr static int TILES_X = 2048 / TILE_WIDTH;
+        constexpr static int TILES_Y = 2048 / TILE_HEIGHT;
+
+        /* 0 uses every hardware thread, the one calling render() included */
+        SoftwareRenderer(uint32_t threads = 0);
+        ~SoftwareRenderer() override;
+
+        void render() override;
+
+        void set_vram(Page* vram) override;
+        void set_draw_state(const GSDrawState& state) override;
+
+        void submit_vertex(GSVertex v1) override;
+        void submit_sprite(GSVertex v1, GSVertex v2) override;
+    private:
+        void setup_triangle(GSVertex v1, GSVertex v2, GSVertex v3);
+        void setup_sprite(GSVertex v1, GSVertex v2);
+        void queue_primitive(const SpanSetup& setup);
+
+        void draw_tiles();
+        void draw_tile(uint32_t tile);
+        void worker_main();
+    private:
+        uint8_t* vram = nullptr;
+        SpanFunction draw_span;
+
+        /* Every state used by the queued primitives, the last one is current */
+        std::vector<RasterState> raster_states;
+        GSDrawState current_state = {};
+        bool state_changed = true;
+
+        GSVertex triangle[3];
+        int vertex_count = 0;
+
+        std::vector<SpanSetup> primitives;
+        std::vector<uint32_t> bins[TILES_X * TILES_Y];
+        std::vector<uint32_t> used_tiles;
+
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable work_ready, work_done;
+        uint64_t generation = 0;
+        uint32_t busy_workers = 0;
+        bool quit = false;
+        std::atomic<uint32_t> next_tile = 0;
+    };
+}
@@ -0,0 +1,138 @@
+/* Compiled for AVX2 whatever the rest of the build targets, only
+   called once the CPU has been checked for it. The target is switched on
+   after the shared headers, so only the kernel in the anonymous namespace
+   below uses AVX2. Inline functions from the headers that end up emitted
+   here stay safe to share with the rest of the build */
+#include <gs/gssoftware.hpp>
+#include <gs/gsvram.h>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <gs/gsspan_kernel.h>
+
+namespace gs
+{
+    namespace
+    {
+        /* 8 pixels at a time */
+        struct AVX2
+        {
+            using I = __m256i;
+            using F = __m256;
+            constexpr static int N = 8;
+
+            /* Edge offsets of each lane from the first, pixels 0-3 and 4-7 */
+            struct Step { __m256i low, high; };
+            struct Edges { Step step[3]; };
+
+            static I set1(int32_t value) { return _mm256_set1_epi32(value); }
+            static I zero() { return _mm256_setzero_si256(); }
+            static I lane_index() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+
+            static I add(I a, I b) { return _mm256_add_epi32(a, b); }
+            static I sub(I a, I b) { return _mm256_sub_epi32(a, b); }
+            static I mullo(I a, I b) { return _mm256_mullo_epi32(a, b); }
+            static I and_(I a, I b) { return _mm256_and_si256(a, b); }
+            static I or_(I a, I b) { return _mm256_or_si256(a, b); }
+            static I xor_(I a, I b) { return _mm256_xor_si256(a, b); }
+            static I andnot(I a, I b) { return _mm256_andnot_si256(a, b); }
+            static I shift_left(I a, int count) { return _mm256_slli_epi32(a, count); }
+            static I shift_right(I a, int count) { return _mm256_srli_epi32(a, count); }
+            static I shift_right_arithmetic(I a, int count) { return _mm256_srai_epi32(a, count); }
+            static I min(I a, I b) { return _mm256_min_epi32(a, b); }
+            static I max(I a, I b) { return _mm256_max_epi32(a, b); }
+            static I min_unsigned(I a, I b) { return _mm256_min_epu32(a, b); }
+            static I cmpeq(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+            static I cmpgt(I a, I b) { return _mm256_cmpgt_epi32(a, b); }
+            static I select(I a, I b, I mask) { return _mm256_blendv_epi8(a, b, mask); }
+            static bool none(I mask) { return _mm256_testz_si256(mask, mask); }
+
+            static F fset1(float value) { return _mm256_set1_ps(value); }
+            static F fadd(F a, F b) { return _mm256_add_ps(a, b); }
+            static F fmul(F a, F b) { return _mm256_mul_ps(a, b); }
+            static F to_float(I a) { return _mm256_cvtepi32_ps(a); }
+            static I truncate(F a) { return _mm256_cvttps_epi32(a); }
+
+            static Step edge_steps(int64_t dx)
+            {
+                return { _mm256_setr_epi64x(0, dx, dx * 2, dx * 3),
+                         _mm256_setr_epi64x(dx * 4, dx * 5, dx * 6, dx * 7) };
+            }
+
+            /* Inside where no edge is negative, the sign is in the high dword */
+            static I edges_inside(const int64_t start[3], const Edges& edges)
+            {
+                __m256i low = _mm256_setzero_si256(), high = _mm256_setzero_si256();
+                for (int i = 0; i < 3; i++)
+                {
+                    __m256i edge = _mm256_set1_epi64x(start[i]);
+                    low = _mm256_or_si256(low, _mm256_add_epi64(edge, edges.step[i].low));
+                    high = _mm256_or_si256(high, _mm256_add_epi64(edge, edges.step[i].high));
+                }
+
+                __m256 packed = _mm256_shuffle_ps(_mm256_castsi256_ps(low), _mm256_castsi256_ps(high), _MM_SHUFFLE(3, 1, 3, 1));
+                __m256i sign = _mm256_permute4x64_epi64(_mm256_castps_si256(packed), _MM_SHUFFLE(3, 1, 2, 0));
+                return _mm256_andnot_si256(_mm256_srai_epi32(sign, 31), _mm256_set1_epi32(-1));
+            }
+
+            static __m128i depth_half(double z, double z_dx, double z_y, __m128i x)
+            {
+                __m256d value = _mm256_mul_pd(_mm256_set1_pd(z_dx), _mm256_cvtepi32_pd(x));
+                value = _mm256_add_pd(_mm256_add_pd(_mm256_set1_pd(z), value), _mm256_set1_pd(z_y));
+                value = _mm256_min_pd(_mm256_max_pd(value, _mm256_setzero_pd()), _mm256_set1_pd(4294967295.0));
+
+                /* No unsigned conversion, go through the signed range */
+                value = _mm256_sub_pd(_mm256_floor_pd(value), _mm256_set1_pd(2147483648.0));
+                return _mm_xor_si128(_mm256_cvttpd_epi32(value), _mm_set1_epi32(0x80000000));
+            }
+
+            static I depth(double z, double z_dx, double z_y, int x)
+            {
+                __m128i base = _mm_set1_epi32(x);
+                __m128i low = depth_half(z, z_dx, z_y, _mm_add_epi32(base, _mm_setr_epi32(0, 1, 2, 3)));
+                __m128i high = depth_half(z, z_dx, z_y, _mm_add_epi32(base, _mm_setr_epi32(4, 5, 6, 7)));
+                return _mm256_set_m128i(high, low);
+            }
+
+            /* Eight horizontal pixels of a 32bit block are word pairs 4 apart */
+            static I load_pixels(const uint32_t* pixels)
+            {
+                __m128i low = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)pixels),
+                                                 _mm_loadl_epi64((const __m128i*)(pixels + 4)));
+                __m128i high = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)(pixels + 8)),
+                                                  _mm_loadl_epi64((const __m128i*)(pixels + 12)));
+                return _mm256_set_m128i(high, low);
+            }
+
+            static void store_pixels(uint32_t* pixels, I values)
+            {
+                __m128i low = _mm256_castsi256_si128(values);
+                __m128i high = _mm256_extracti128_si256(values, 1);
+                _mm_storel_epi64((__m128i*)pixels, low);
+                _mm_storel_epi64((__m128i*)(pixels + 4), _mm_unpackhi_epi64(low, low));
+                _mm_storel_epi64((__m128i*)(pixels + 8), high);
+                _mm_storel_epi64((__m128i*)(pixels + 12), _mm_unpackhi_epi64(high, high));
+            }
+        };
+    }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+namespace gs
+{
+    void draw_span_avx2(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1)
+    {
+        draw_span_vector<AVX2>(vram, state, setup, y, x0, x1);
+    }
+}
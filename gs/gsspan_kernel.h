@@ -0,0 +1,222 @@
+#pragma once
+
+/* The vectorized span kernel shared by the SSE4.1 and AVX2 builds. Only
+   included by the translation units that enable those instruction sets,
+   inside their target region. gssoftware.hpp and gsvram.h have to be
+   included before the target switch, or the inline functions in them
+   would be compiled for it too. Results match draw_span_scalar bit for
+   bit, tools/gs_span_check compares them on random spans */
+
+namespace gs
+{
+    namespace
+    {
+        /* Unsigned a >= b */
+        template<typename V>
+        inline typename V::I greater_equal_unsigned(typename V::I a, typename V::I b)
+        {
+            auto sign = V::set1(0x80000000);
+            return V::andnot(V::cmpgt(V::xor_(b, sign), V::xor_(a, sign)), V::set1(-1));
+        }
+
+        template<typename V>
+        inline typename V::I alpha_test(const RasterState& state, typename V::I alpha)
+        {
+            auto aref = V::set1(state.aref);
+            auto ones = V::set1(-1);
+            switch (state.atst)
+            {
+            case 0: return V::zero();
+            case 1: return ones;
+            case 2: return V::cmpgt(aref, alpha);
+            case 3: return V::andnot(V::cmpgt(alpha, aref), ones);
+            case 4: return V::cmpeq(alpha, aref);
+            case 5: return V::andnot(V::cmpgt(aref, alpha), ones);
+            case 6: return V::cmpgt(alpha, aref);
+            default: return V::andnot(V::cmpeq(alpha, aref), ones);
+            }
+        }
+
+        template<typename V>
+        inline typename V::I blend_input(uint32_t select, typename V::I source, typename V::I dest)
+        {
+            return select == 0 ? source : select == 1 ? dest : V::zero();
+        }
+
+        template<typename V, PixelFormat frame_layout, PixelFormat depth_layout>
+        void draw_span_simd(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1)
+        {
+            using I = typename V::I;
+            constexpr int N = V::N;
+
+            auto words = (uint32_t*)vram;
+            bool frame24 = state.fpsm & 0x1;
+            bool depth24 = state.zpsm & 0x1;
+            bool depth_access = state.zte || !state.zmsk;
+            const I ones = V::set1(-1);
+            const I byte_mask = V::set1(0xFF);
+
+            /* Values that only depend on the row */
+            typename V::Edges edges;
+            int64_t edge_row[3];
+            for (int i = 0; i < 3; i++)
+            {
+                edge_row[i] = setup.edge[i] + setup.edge_dy[i] * y;
+                edges.step[i] = V::edge_steps(setup.edge_dx[i]);
+            }
+
+            float color_y[4];
+            for (int i = 0; i < 4; i++)
+                color_y[i] = setup.color_dy[i] * y;
+            double z_y = setup.z_dy * y;
+
+            uint32_t z_max = (state.zpsm & 0x1) ? 0xFFFFFF : 0xFFFFFFFF;
+            uint32_t frame_keep = state.fbmsk;
+            uint32_t raw_keep = frame24 ? 0xFF000000 : 0;
+
+            for (int gx = x0 & ~(N - 1); gx <= x1; gx += N)
+            {
+                I x = V::add(V::set1(gx), V::lane_index());
+                I mask = V::and_(V::cmpgt(x, V::set1(x0 - 1)), V::cmpgt(V::set1(x1 + 1), x));
+                if (!setup.sprite)
+                {
+                    int64_t start[3];
+                    for (int i = 0; i < 3; i++)
+                        start[i] = edge_row[i] + setup.edge_dx[i] * gx;
+
+                    mask = V::and_(mask, V::edges_inside(start, edges));
+                }
+
+                if (V::none(mask))
+                    continue;
+
+                /* Interpolated in the same order as the scalar kernel so rounding agrees */
+                auto xf = V::to_float(x);
+                I color = V::zero();
+                for (int i = 0; i < 4; i++)
+                {
+                    auto value = V::fadd(V::fadd(V::fset1(setup.color[i]), V::fmul(V::fset1(setup.color_dx[i]), xf)), V::fset1(color_y[i]));
+                    I channel = V::min(V::max(V::truncate(value), V::zero()), byte_mask);
+                    color = V::or_(color, V::shift_left(channel, i * 8));
+                }
+
+                I alpha = V::shift_right(color, 24);
+                I alpha_pass = state.ate ? alpha_test<V>(state, alpha) : ones;
+
+                I color_mask = mask, depth_mask = state.zmsk ? V::zero() : mask;
+                I keep_alpha = V::zero();
+                switch (state.afail)
+                {
+                case 0:
+                    color_mask = V::and_(color_mask, alpha_pass);
+                    depth_mask = V::and_(depth_mask, alpha_pass);
+                    break;
+                case 1:
+                    depth_mask = V::and_(depth_mask, alpha_pass);
+                    break;
+                case 2:
+                    color_mask = V::and_(color_mask, alpha_pass);
+                    break;
+                case 3:
+                    depth_mask = V::and_(depth_mask, alpha_pass);
+                    keep_alpha = V::andnot(alpha_pass, ones);
+                    break;
+                }
+
+                uint32_t* frame = &words[pixel_address<frame_layout>(gx, y, state.fbp, state.fbw)];
+                I raw = V::load_pixels(frame);
+                I dest = frame24 ? V::or_(V::and_(raw, V::set1(0xFFFFFF)), V::set1(0x80000000)) : raw;
+
+                if (state.date)
+                {
+                    I test = V::cmpeq(V::shift_right(dest, 31), V::set1(state.datm));
+                    color_mask = V::and_(color_mask, test);
+                    depth_mask = V::and_(depth_mask, test);
+                }
+
+                uint32_t* depth_ptr = nullptr;
+                I z = V::zero(), raw_depth = V::zero();
+                if (depth_access)
+                {
+                    z = V::depth(setup.z, setup.z_dx, z_y, gx);
+                    z = V::min_unsigned(z, V::set1(z_max));
+
+                    depth_ptr = &words[pixel_address<depth_layout>(gx, y, state.zbp, state.fbw)];
+                    raw_depth = V::load_pixels(depth_ptr);
+                }
+
+                if (state.zte)
+                {
+                    I depth = V::and_(raw_depth, V::set1(z_max));
+                    I pass;
+                    switch (state.ztst)
+                    {
+                    case 0: pass = V::zero(); break;
+                    case 2: pass = greater_equal_unsigned<V>(z, depth); break;
+                    case 3: pass = V::andnot(greater_equal_unsigned<V>(depth, z), ones); break;
+                    default: pass = ones; break;
+                    }
+
+                    color_mask = V::and_(color_mask, pass);
+                    depth_mask = V::and_(depth_mask, pass);
+                }
+
+                if (!V::none(color_mask))
+                {
+                    I result = V::and_(color, V::set1(0xFFFFFF));
+                    if (state.abe)
+                    {
+                        I coefficient = state.blend_c == 0 ? alpha : state.blend_c == 1 ? V::shift_right(dest, 24) : V::set1(state.fix);
+                        I blended = V::zero();
+                        for (int i = 0; i < 24; i += 8)
+                        {
+                            I source = V::and_(V::shift_right(color, i), byte_mask);
+                            I target = V::and_(V::shift_right(dest, i), byte_mask);
+                            I a = blend_input<V>(state.blend_a, source, target);
+                            I b = blend_input<V>(state.blend_b, source, target);
+                            I d = blend_input<V>(state.blend_d, source, target);
+
+                            I value = V::add(V::shift_right_arithmetic(V::mullo(V::sub(a, b), coefficient), 7), d);
+                            value = state.clamp ? V::min(V::max(value, V::zero()), byte_mask) : V::and_(value, byte_mask);
+                            blended = V::or_(blended, V::shift_left(value, i));
+                        }
+
+                        /* PABE only blends pixels with the alpha MSB set */
+                        I selected = state.pabe ? V::cmpgt(alpha, V::set1(0x7F)) : ones;
+                        result = V::select(result, blended, selected);
+                    }
+
+                    I out_alpha = state.fba ? V::or_(alpha, V::set1(0x80)) : alpha;
+                    out_alpha = V::select(out_alpha, V::shift_right(dest, 24), keep_alpha);
+                    result = V::or_(result, V::shift_left(out_alpha, 24));
+
+                    result = V::or_(V::andnot(V::set1(frame_keep), result), V::and_(dest, V::set1(frame_keep)));
+                    result = V::or_(V::andnot(V::set1(raw_keep), result), V::and_(raw, V::set1(raw_keep)));
+                    V::store_pixels(frame, V::select(raw, result, color_mask));
+                }
+
+                if (!V::none(depth_mask))
+                {
+                    I value = depth24 ? V::or_(V::and_(raw_depth, V::set1(0xFF000000)), z) : z;
+                    V::store_pixels(depth_ptr, V::select(raw_depth, value, depth_mask));
+                }
+            }
+        }
+
+        /* Picks the memory layouts, the rest of the state is handled at runtime */
+        template<typename V>
+        void draw_span_vector(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1)
+        {
+            if (!state.vectorizable)
+            {
+                draw_span_scalar(vram, state, setup, y, x0, x1);
+                return;
+            }
+
+            if (state.fpsm & 0x30)
+                draw_span_simd<V, PSMZ32, PSMZ32>(vram, state, setup, y, x0, x1);
+            else
+                draw_span_simd<V, PSMCT32, PSMZ32>(vram, state, setup, y, x0, x1);
+        }
+    }
+}
@@ -0,0 +1,126 @@
+/* Compiled for SSE4.1 whatever the rest of the build targets, only
+   called once the CPU has been checked for it. The target is switched on
+   after the shared headers, so only the kernel in the anonymous namespace
+   below uses SSE4.1. Inline functions from the headers that end up emitted
+   here stay safe to share with the rest of the build */
+#include <gs/gssoftware.hpp>
+#include <gs/gsvram.h>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+#include <gs/gsspan_kernel.h>
+
+namespace gs
+{
+    namespace
+    {
+        /* 4 pixels at a time */
+        struct SSE41
+        {
+            using I = __m128i;
+            using F = __m128;
+            constexpr static int N = 4;
+
+            /* Edge offsets of each lane from the first, pixels 0-1 and 2-3 */
+            struct Step { __m128i low, high; };
+            struct Edges { Step step[3]; };
+
+            static I set1(int32_t value) { return _mm_set1_epi32(value); }
+            static I zero() { return _mm_setzero_si128(); }
+            static I lane_index() { return _mm_setr_epi32(0, 1, 2, 3); }
+
+            static I add(I a, I b) { return _mm_add_epi32(a, b); }
+            static I sub(I a, I b) { return _mm_sub_epi32(a, b); }
+            static I mullo(I a, I b) { return _mm_mullo_epi32(a, b); }
+            static I and_(I a, I b) { return _mm_and_si128(a, b); }
+            static I or_(I a, I b) { return _mm_or_si128(a, b); }
+            static I xor_(I a, I b) { return _mm_xor_si128(a, b); }
+            static I andnot(I a, I b) { return _mm_andnot_si128(a, b); }
+            static I shift_left(I a, int count) { return _mm_slli_epi32(a, count); }
+            static I shift_right(I a, int count) { return _mm_srli_epi32(a, count); }
+            static I shift_right_arithmetic(I a, int count) { return _mm_srai_epi32(a, count); }
+            static I min(I a, I b) { return _mm_min_epi32(a, b); }
+            static I max(I a, I b) { return _mm_max_epi32(a, b); }
+            static I min_unsigned(I a, I b) { return _mm_min_epu32(a, b); }
+            static I cmpeq(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+            static I cmpgt(I a, I b) { return _mm_cmpgt_epi32(a, b); }
+            static I select(I a, I b, I mask) { return _mm_blendv_epi8(a, b, mask); }
+            static bool none(I mask) { return _mm_testz_si128(mask, mask); }
+
+            static F fset1(float value) { return _mm_set1_ps(value); }
+            static F fadd(F a, F b) { return _mm_add_ps(a, b); }
+            static F fmul(F a, F b) { return _mm_mul_ps(a, b); }
+            static F to_float(I a) { return _mm_cvtepi32_ps(a); }
+            static I truncate(F a) { return _mm_cvttps_epi32(a); }
+
+            static Step edge_steps(int64_t dx)
+            {
+                return { _mm_set_epi64x(dx, 0), _mm_set_epi64x(dx * 3, dx * 2) };
+            }
+
+            /* Inside where no edge is negative, the sign is in the high dword */
+            static I edges_inside(const int64_t start[3], const Edges& edges)
+            {
+                __m128i low = _mm_setzero_si128(), high = _mm_setzero_si128();
+                for (int i = 0; i < 3; i++)
+                {
+                    __m128i edge = _mm_set1_epi64x(start[i]);
+                    low = _mm_or_si128(low, _mm_add_epi64(edge, edges.step[i].low));
+                    high = _mm_or_si128(high, _mm_add_epi64(edge, edges.step[i].high));
+                }
+
+                __m128 sign = _mm_shuffle_ps(_mm_castsi128_ps(low), _mm_castsi128_ps(high), _MM_SHUFFLE(3, 1, 3, 1));
+                return _mm_andnot_si128(_mm_srai_epi32(_mm_castps_si128(sign), 31), _mm_set1_epi32(-1));
+            }
+
+            static __m128i depth_half(double z, double z_dx, double z_y, int x)
+            {
+                __m128d value = _mm_mul_pd(_mm_set1_pd(z_dx), _mm_setr_pd(x, x + 1));
+                value = _mm_add_pd(_mm_add_pd(_mm_set1_pd(z), value), _mm_set1_pd(z_y));
+                value = _mm_min_pd(_mm_max_pd(value, _mm_setzero_pd()), _mm_set1_pd(4294967295.0));
+
+                /* No unsigned conversion, go through the signed range */
+                value = _mm_sub_pd(_mm_floor_pd(value), _mm_set1_pd(2147483648.0));
+                return _mm_xor_si128(_mm_cvttpd_epi32(value), _mm_set1_epi32(0x80000000));
+            }
+
+            static I depth(double z, double z_dx, double z_y, int x)
+            {
+                return _mm_unpacklo_epi64(depth_half(z, z_dx, z_y, x), depth_half(z, z_dx, z_y, x + 2));
+            }
+
+            /* Four horizontal pixels of a 32bit block are word pairs 4 apart */
+            static I load_pixels(const uint32_t* pixels)
+            {
+                return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)pixels),
+                                          _mm_loadl_epi64((const __m128i*)(pixels + 4)));
+            }
+
+            static void store_pixels(uint32_t* pixels, I values)
+            {
+                _mm_storel_epi64((__m128i*)pixels, values);
+                _mm_storel_epi64((__m128i*)(pixels + 4), _mm_unpackhi_epi64(values, values));
+            }
+        };
+    }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+namespace gs
+{
+    void draw_span_sse41(uint8_t* vram, const RasterState& state, const SpanSetup& setup, int y, int x0, int x1)
+    {
+        draw_span_vector<SSE41>(vram, state, setup, y, x0, x1);
+    }
+}
@@ -1,100 +1,422 @@
 #include <gs/gsvram.h>
+#include <emmintrin.h>
+#include <cstring>
 
 namespace gs
 {
-    template<>
-    struct FormatInfo<PSMCT32>
-    {
-        constexpr static uint16_t PAGE_PIXEL_WIDTH = 64;
-		constexpr static uint16_t PAGE_PIXEL_HEIGHT = 32;
-		constexpr static uint16_t PAGE_BLOCK_WIDTH = 8;
-		constexpr static uint16_t PAGE_BLOCK_HEIGHT = 4;
-		constexpr static uint16_t BLOCK_PIXEL_WIDTH = 8;
-		constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 8;
-		constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 2;
-        constexpr static int block_layout[4][8] =
-        {
-            {0 , 1 , 4 , 5 , 16, 17, 20, 21},
-            {2 , 3 , 6 , 7 , 18, 19, 22, 23},
-            {8 , 9 , 12, 13, 24, 25, 28, 29},
-            {10, 11, 14, 15, 26, 27, 30, 31}
-        };
-    };
-
-    template <>
-	struct FormatInfo<PSMCT16>
+	namespace
 	{
-		constexpr static uint16_t PAGE_PIXEL_WIDTH = 64;
-		constexpr static uint16_t PAGE_PIXEL_HEIGHT = 64;
-		constexpr static uint16_t PAGE_BLOCK_WIDTH = 4;
-		constexpr static uint16_t PAGE_BLOCK_HEIGHT = 8;
-		constexpr static uint16_t BLOCK_PIXEL_WIDTH = 16;
-		constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 8;
-		constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 2;
-		constexpr static int block_layout[8][4] =
-		{
-			{  0,  2,  8, 10 },
-			{  1,  3,  9, 11 },
-			{  4,  6, 12, 14 },
-			{  5,  7, 13, 15 },
-			{ 16, 18, 24, 26 },
-			{ 17, 19, 25, 27 },
-			{ 20, 22, 28, 30 },
-			{ 21, 23, 29, 31 }
-		};
-	};
-
-    constexpr int FormatInfo<PSMCT16>::block_layout[8][4];
-    constexpr int FormatInfo<PSMCT32>::block_layout[4][8];
-
-	void Page::write_psmct32(uint16_t x, uint16_t y, uint32_t value)
-	{
-		using Info = FormatInfo<PSMCT32>;
+		/* A column holds two rows of 32bit words. Its 64bit units alternate
+		   between the rows, which is COLUMN_LAYOUT32. Masked stores keep
+		   the bits the format doesn't own */
+		template<bool masked>
+		inline void store_column(__m128i* dest, __m128i mask, __m128i row0_lo, __m128i row0_hi, __m128i row1_lo, __m128i row1_hi)
+		{
+			__m128i columns[4] =
+			{
+				_mm_unpacklo_epi64(row0_lo, row1_lo), _mm_unpackhi_epi64(row0_lo, row1_lo),
+				_mm_unpacklo_epi64(row0_hi, row1_hi), _mm_unpackhi_epi64(row0_hi, row1_hi)
+			};
+
+			for (int i = 0; i < 4; i++)
+			{
+				if constexpr (masked)
+					columns[i] = _mm_or_si128(_mm_and_si128(columns[i], mask), _mm_andnot_si128(mask, _mm_loadu_si128(dest + i)));
+
+				_mm_storeu_si128(dest + i, columns[i]);
+			}
+		}
+
+		inline void load_column(const __m128i* src, __m128i& row0_lo, __m128i& row0_hi, __m128i& row1_lo, __m128i& row1_hi)
+		{
+			__m128i c0 = _mm_loadu_si128(src), c1 = _mm_loadu_si128(src + 1);
+			__m128i c2 = _mm_loadu_si128(src + 2), c3 = _mm_loadu_si128(src + 3);
+			row0_lo = _mm_unpacklo_epi64(c0, c1);
+			row1_lo = _mm_unpackhi_epi64(c0, c1);
+			row0_hi = _mm_unpacklo_epi64(c2, c3);
+			row1_hi = _mm_unpackhi_epi64(c2, c3);
+		}
+
+		template<bool masked>
+		void write_block32(uint8_t* block, const uint32_t* src, uint32_t stride, uint32_t mask = 0)
+		{
+			auto dest = (__m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				auto row0 = (const __m128i*)src;
+				auto row1 = (const __m128i*)(src + stride);
+				store_column<masked>(dest, _mm_set1_epi32(mask), _mm_loadu_si128(row0), _mm_loadu_si128(row0 + 1),
+									 _mm_loadu_si128(row1), _mm_loadu_si128(row1 + 1));
+
+				src += stride * 2;
+				dest += 4;
+			}
+		}
+
+		void read_block32(const uint8_t* block, uint32_t* dst, uint32_t stride)
+		{
+			auto src = (const __m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				auto row0 = (__m128i*)dst;
+				auto row1 = (__m128i*)(dst + stride);
+				__m128i row0_lo, row0_hi, row1_lo, row1_hi;
+				load_column(src, row0_lo, row0_hi, row1_lo, row1_hi);
+				_mm_storeu_si128(row0, row0_lo);
+				_mm_storeu_si128(row0 + 1, row0_hi);
+				_mm_storeu_si128(row1, row1_lo);
+				_mm_storeu_si128(row1 + 1, row1_hi);
+
+				dst += stride * 2;
+				src += 4;
+			}
+		}
+
+		/* Moves a row of 8 pixels of a format stored inside 32bit words
+		   between its packed form and its bits in the words */
+		template<PixelFormat fmt>
+		inline void expand_row(const uint8_t* src, uint32_t* words)
+		{
+			using Info = FormatInfo<fmt>;
+			if constexpr (Info::BITS == 24)
+			{
+				for (int x = 0; x < 8; x++)
+					words[x] = src[x * 3] | (src[x * 3 + 1] << 8) | (src[x * 3 + 2] << 16);
+			}
+			else if constexpr (Info::BITS == 8)
+			{
+				/* Unpacking with zeros below moves every byte to the top of its word */
+				static_assert(Info::SHIFT == 24);
+				__m128i halves = _mm_unpacklo_epi8(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i*)src));
+				_mm_storeu_si128((__m128i*)words, _mm_unpacklo_epi16(_mm_setzero_si128(), halves));
+				_mm_storeu_si128((__m128i*)words + 1, _mm_unpackhi_epi16(_mm_setzero_si128(), halves));
+			}
+			else
+			{
+				uint32_t nibbles;
+				std::memcpy(&nibbles, src, sizeof(nibbles));
+				for (int x = 0; x < 8; x++)
+					words[x] = ((nibbles >> (x * 4)) & 0xF) << Info::SHIFT;
+			}
+		}
+
+		template<PixelFormat fmt>
+		inline void pack_row(const uint32_t* words, uint8_t* dst)
+		{
+			using Info = FormatInfo<fmt>;
+			if constexpr (Info::BITS == 24)
+			{
+				for (int x = 0; x < 8; x++)
+				{
+					dst[x * 3] = words[x];
+					dst[x * 3 + 1] = words[x] >> 8;
+					dst[x * 3 + 2] = words[x] >> 16;
+				}
+			}
+			else if constexpr (Info::BITS == 8)
+			{
+				__m128i lo = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)words), 24);
+				__m128i hi = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)words + 1), 24);
+				__m128i halves = _mm_packs_epi32(lo, hi);
+				_mm_storel_epi64((__m128i*)dst, _mm_packus_epi16(halves, halves));
+			}
+			else
+			{
+				uint32_t nibbles = 0;
+				for (int x = 0; x < 8; x++)
+					nibbles |= ((words[x] >> Info::SHIFT) & 0xF) << (x * 4);
+				std::memcpy(dst, &nibbles, sizeof(nibbles));
+			}
+		}
+
+		/* COLUMN_LAYOUT16 is the 32bit layout once pixel x is paired with pixel x + 8 */
+		void write_block16(uint8_t* block, const uint16_t* src, uint32_t stride)
+		{
+			auto dest = (__m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				auto row0 = (const __m128i*)src;
+				auto row1 = (const __m128i*)(src + stride);
+				__m128i left0 = _mm_loadu_si128(row0), right0 = _mm_loadu_si128(row0 + 1);
+				__m128i left1 = _mm_loadu_si128(row1), right1 = _mm_loadu_si128(row1 + 1);
+				store_column<false>(dest, __m128i(), _mm_unpacklo_epi16(left0, right0), _mm_unpackhi_epi16(left0, right0),
+									_mm_unpacklo_epi16(left1, right1), _mm_unpackhi_epi16(left1, right1));
+
+				src += stride * 2;
+				dest += 4;
+			}
+		}
+
+		/* Splits the pairs back into pixels x and x + 8 */
+		inline void split_pairs(__m128i lo, __m128i hi, __m128i& left, __m128i& right)
+		{
+			left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16), _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+			right = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+		}
+
+		void read_block16(const uint8_t* block, uint16_t* dst, uint32_t stride)
+		{
+			auto src = (const __m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				auto row0 = (__m128i*)dst;
+				auto row1 = (__m128i*)(dst + stride);
+				__m128i row0_lo, row0_hi, row1_lo, row1_hi, left, right;
+				load_column(src, row0_lo, row0_hi, row1_lo, row1_hi);
+
+				split_pairs(row0_lo, row0_hi, left, right);
+				_mm_storeu_si128(row0, left);
+				_mm_storeu_si128(row0 + 1, right);
+				split_pairs(row1_lo, row1_hi, left, right);
+				_mm_storeu_si128(row1, left);
+				_mm_storeu_si128(row1 + 1, right);
+
+				dst += stride * 2;
+				src += 4;
+			}
+		}
+
+		/* Rotates every group of 8 pixels by 4, for 8bit rows */
+		inline __m128i rotate8(__m128i row)
+		{
+			return _mm_shuffle_epi32(row, 0xB1);
+		}
+
+		/* Same for packed 4bit rows */
+		inline __m128i rotate4(__m128i row)
+		{
+			return _mm_shufflehi_epi16(_mm_shufflelo_epi16(row, 0xB1), 0xB1);
+		}
+
+		/* Words made of bytes (a[i], b[i], a[i + 8], b[i + 8]), i = 0..7 */
+		inline void interleave_words(__m128i a, __m128i b, __m128i& lo, __m128i& hi)
+		{
+			__m128i first = _mm_unpacklo_epi8(a, b), second = _mm_unpackhi_epi8(a, b);
+			lo = _mm_unpacklo_epi16(first, second);
+			hi = _mm_unpackhi_epi16(first, second);
+		}
+
+		/* Transposes 8 words into their bytes 0 and 1 and their bytes 2 and 3 */
+		inline void transpose_words(__m128i lo, __m128i hi, __m128i& bytes01, __m128i& bytes23)
+		{
+			__m128i first = _mm_unpacklo_epi8(lo, hi), second = _mm_unpackhi_epi8(lo, hi);
+			__m128i even = _mm_unpacklo_epi8(first, second), odd = _mm_unpackhi_epi8(first, second);
+			bytes01 = _mm_unpacklo_epi8(even, odd);
+			bytes23 = _mm_unpackhi_epi8(even, odd);
+		}
 
-		/* Get the coords of the curerent block inside the page */
-		uint16_t block_x = (x / Info::BLOCK_PIXEL_WIDTH) % Info::PAGE_BLOCK_WIDTH;
-		uint16_t block_y = (y / Info::BLOCK_PIXEL_HEIGHT) % Info::PAGE_BLOCK_HEIGHT;
+		/* Undoes interleave_words */
+		inline void deinterleave_words(__m128i lo, __m128i hi, __m128i& a, __m128i& b)
+		{
+			__m128i bytes01, bytes23;
+			transpose_words(lo, hi, bytes01, bytes23);
+			a = _mm_unpacklo_epi64(bytes01, bytes23);
+			b = _mm_unpackhi_epi64(bytes01, bytes23);
+		}
+
+		/* Even columns rotate their last two rows, odd ones the first two. Rows 0
+		   and 2 then make up the even words of the column, rows 1 and 3 the odd ones */
+		void write_block8(uint8_t* block, const uint8_t* src, uint32_t stride)
+		{
+			auto dest = (__m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				__m128i rows[4];
+				for (int i = 0; i < 4; i++)
+					rows[i] = _mm_loadu_si128((const __m128i*)(src + i * stride));
+
+				int rotated = (column & 0x1) ? 0 : 2;
+				rows[rotated] = rotate8(rows[rotated]);
+				rows[rotated + 1] = rotate8(rows[rotated + 1]);
+
+				__m128i even_lo, even_hi, odd_lo, odd_hi;
+				interleave_words(rows[0], rows[2], even_lo, even_hi);
+				interleave_words(rows[1], rows[3], odd_lo, odd_hi);
+				store_column<false>(dest, __m128i(), even_lo, even_hi, odd_lo, odd_hi);
+
+				src += stride * 4;
+				dest += 4;
+			}
+		}
+
+		void read_block8(const uint8_t* block, uint8_t* dst, uint32_t stride)
+		{
+			auto src = (const __m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				__m128i even_lo, even_hi, odd_lo, odd_hi, rows[4];
+				load_column(src, even_lo, even_hi, odd_lo, odd_hi);
+				deinterleave_words(even_lo, even_hi, rows[0], rows[2]);
+				deinterleave_words(odd_lo, odd_hi, rows[1], rows[3]);
+
+				int rotated = (column & 0x1) ? 0 : 2;
+				rows[rotated] = rotate8(rows[rotated]);
+				rows[rotated + 1] = rotate8(rows[rotated + 1]);
 
-		/* Blocks in a page are not stored linearly so use small
-		   lookup table to figure out the offset of the block in memory */
-		uint16_t block = Info::block_layout[block_y][block_x] % BLOCKS_PER_PAGE;
-		uint32_t column = (y / Info::COLUMN_PIXEL_HEIGHT) % COLUMNS_PER_BLOCK;
+				for (int i = 0; i < 4; i++)
+					_mm_storeu_si128((__m128i*)(dst + i * stride), rows[i]);
+
+				dst += stride * 4;
+				src += 4;
+			}
+		}
+
+		/* The 4bit layout is the 8bit one with rows 0 and 1 in the low nibbles
+		   and rows 2 and 3 in the high ones, over 32 pixels instead of 16 */
+		inline void merge_rows4(__m128i low, __m128i high, __m128i& pixels0, __m128i& pixels1)
+		{
+			const __m128i nibble = _mm_set1_epi8(0xF);
+			__m128i low_even = _mm_and_si128(low, nibble), low_odd = _mm_and_si128(_mm_srli_epi16(low, 4), nibble);
+			__m128i high_even = _mm_and_si128(high, nibble), high_odd = _mm_and_si128(_mm_srli_epi16(high, 4), nibble);
+
+			/* One pixel of each row per byte */
+			pixels0 = _mm_or_si128(_mm_unpacklo_epi8(low_even, low_odd), _mm_slli_epi16(_mm_unpacklo_epi8(high_even, high_odd), 4));
+			pixels1 = _mm_or_si128(_mm_unpackhi_epi8(low_even, low_odd), _mm_slli_epi16(_mm_unpackhi_epi8(high_even, high_odd), 4));
+		}
+
+		/* Packs 16 bytes holding a pixel each into 8 */
+		inline __m128i pack_nibbles(__m128i pixels0, __m128i pixels1)
+		{
+			const __m128i low_byte = _mm_set1_epi16(0xFF);
+			pixels0 = _mm_or_si128(_mm_and_si128(pixels0, low_byte), _mm_srli_epi16(pixels0, 4));
+			pixels1 = _mm_or_si128(_mm_and_si128(pixels1, low_byte), _mm_srli_epi16(pixels1, 4));
+			return _mm_packus_epi16(_mm_and_si128(pixels0, low_byte), _mm_and_si128(pixels1, low_byte));
+		}
+
+		inline void split_rows4(__m128i pixels0, __m128i pixels1, __m128i& low, __m128i& high)
+		{
+			const __m128i nibble = _mm_set1_epi8(0xF);
+			low = pack_nibbles(_mm_and_si128(pixels0, nibble), _mm_and_si128(pixels1, nibble));
+			high = pack_nibbles(_mm_and_si128(_mm_srli_epi16(pixels0, 4), nibble), _mm_and_si128(_mm_srli_epi16(pixels1, 4), nibble));
+		}
 
-		constexpr static int pixels[2][8]
+		/* Words made of bytes (p0[i], p0[i + 8], p1[i], p1[i + 8]), i = 0..7 */
+		inline void interleave_words4(__m128i pixels0, __m128i pixels1, __m128i& lo, __m128i& hi)
 		{
-			{ 0, 1, 4, 5,  8,  9, 12, 13 },
-			{ 2, 3, 6, 7, 10, 11, 14, 15 }
-		};
-		/* Pixels in columns are not stored linearly either... */
-		uint32_t pixel = pixels[y & 0x1][x % 8];
-		uint32_t offset = column * COLUMN_SIZE + pixel * 4;
+			__m128i first = _mm_unpacklo_epi8(pixels0, _mm_srli_si128(pixels0, 8));
+			__m128i second = _mm_unpacklo_epi8(pixels1, _mm_srli_si128(pixels1, 8));
+			lo = _mm_unpacklo_epi16(first, second);
+			hi = _mm_unpackhi_epi16(first, second);
+		}
 
-		*(uint32_t*)&blocks[block][offset] = value;
+		void write_block4(uint8_t* block, const uint8_t* src, uint32_t stride)
+		{
+			auto dest = (__m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				__m128i rows[4];
+				for (int i = 0; i < 4; i++)
+					rows[i] = _mm_loadu_si128((const __m128i*)(src + i * stride));
+
+				int rotated = (column & 0x1) ? 0 : 2;
+				rows[rotated] = rotate4(rows[rotated]);
+				rows[rotated + 1] = rotate4(rows[rotated + 1]);
+
+				__m128i pixels0, pixels1, even_lo, even_hi, odd_lo, odd_hi;
+				merge_rows4(rows[0], rows[2], pixels0, pixels1);
+				interleave_words4(pixels0, pixels1, even_lo, even_hi);
+				merge_rows4(rows[1], rows[3], pixels0, pixels1);
+				interleave_words4(pixels0, pixels1, odd_lo, odd_hi);
+				store_column<false>(dest, __m128i(), even_lo, even_hi, odd_lo, odd_hi);
+
+				src += stride * 4;
+				dest += 4;
+			}
+		}
+
+		void read_block4(const uint8_t* block, uint8_t* dst, uint32_t stride)
+		{
+			auto src = (const __m128i*)block;
+			for (int column = 0; column < COLUMNS_PER_BLOCK; column++)
+			{
+				__m128i even_lo, even_hi, odd_lo, odd_hi, pixels0, pixels1, rows[4];
+				load_column(src, even_lo, even_hi, odd_lo, odd_hi);
+				transpose_words(even_lo, even_hi, pixels0, pixels1);
+				split_rows4(pixels0, pixels1, rows[0], rows[2]);
+				transpose_words(odd_lo, odd_hi, pixels0, pixels1);
+				split_rows4(pixels0, pixels1, rows[1], rows[3]);
+
+				int rotated = (column & 0x1) ? 0 : 2;
+				rows[rotated] = rotate4(rows[rotated]);
+				rows[rotated + 1] = rotate4(rows[rotated + 1]);
+
+				for (int i = 0; i < 4; i++)
+					_mm_storeu_si128((__m128i*)(dst + i * stride), rows[i]);
+
+				dst += stride * 4;
+				src += 4;
+			}
+		}
 	}
 
-	void Page::write_psmct16(uint16_t x, uint16_t y, uint16_t value)
+	template<PixelFormat fmt>
+	void write_block(uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width,
+					 const void* src, uint32_t stride)
 	{
-		using Info = FormatInfo<PSMCT16>;
+		using Info = FormatInfo<fmt>;
+
+		/* Blocks are contiguous and start with their top left pixel */
+		uint8_t* block = vram + pixel_address<fmt>(x, y, base, width) * Info::UNIT_BITS / 8;
+		if constexpr (Info::UNIT_BITS == 32 && Info::BITS == 32)
+			write_block32<false>(block, (const uint32_t*)src, stride);
+		else if constexpr (Info::UNIT_BITS == 32)
+		{
+			/* Widened to words first, the store keeps the other bits */
+			uint32_t words[64];
+			for (uint32_t y = 0; y < 8; y++)
+				expand_row<fmt>((const uint8_t*)src + y * stride * Info::BITS / 8, &words[y * 8]);
 
-		/* Get the coords of the curerent block inside the page */
-		uint16_t block_x = (x / Info::BLOCK_PIXEL_WIDTH) % Info::PAGE_BLOCK_WIDTH;
-		uint16_t block_y = (y / Info::BLOCK_PIXEL_HEIGHT) % Info::PAGE_BLOCK_HEIGHT;
+			write_block32<true>(block, words, 8, Info::MASK << Info::SHIFT);
+		}
+		else if constexpr (Info::UNIT_BITS == 16)
+			write_block16(block, (const uint16_t*)src, stride);
+		else if constexpr (Info::UNIT_BITS == 8)
+			write_block8(block, (const uint8_t*)src, stride);
+		else
+			write_block4(block, (const uint8_t*)src, stride / 2);
+	}
 
-		/* Blocks in a page are not stored linearly so use small
-		   lookup table to figure out the offset of the block in memory */
-		uint16_t block = Info::block_layout[block_y][block_x] % BLOCKS_PER_PAGE;
-		uint32_t column = (y / Info::COLUMN_PIXEL_HEIGHT) % COLUMNS_PER_BLOCK;
+	template<PixelFormat fmt>
+	void read_block(const uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width,
+					void* dst, uint32_t stride)
+	{
+		using Info = FormatInfo<fmt>;
 
-		constexpr static int pixels[2][8] =
+		const uint8_t* block = vram + pixel_address<fmt>(x, y, base, width) * Info::UNIT_BITS / 8;
+		if constexpr (Info::UNIT_BITS == 32 && Info::BITS == 32)
+			read_block32(block, (uint32_t*)dst, stride);
+		else if constexpr (Info::UNIT_BITS == 32)
 		{
-			{ 0, 1, 4, 5,  8,  9, 12, 13 },
-			{ 2, 3, 6, 7, 10, 11, 14, 15 }
-		};
+			uint32_t words[64];
+			read_block32(block, words, 8);
+			for (uint32_t y = 0; y < 8; y++)
+				pack_row<fmt>(&words[y * 8], (uint8_t*)dst + y * stride * Info::BITS / 8);
+		}
+		else if constexpr (Info::UNIT_BITS == 16)
+			read_block16(block, (uint16_t*)dst, stride);
+		else if constexpr (Info::UNIT_BITS == 8)
+			read_block8(block, (uint8_t*)dst, stride);
+		else
+			read_block4(block, (uint8_t*)dst, stride / 2);
+	}
 
-		/* Pixels in columns are not stored linearly either... */
-		uint32_t pixel = pixels[y & 0x1][(x >> 1) % 8];
-		uint32_t offset = column * COLUMN_SIZE + pixel * 2;
+#define INSTANTIATE_BLOCK_FUNCTIONS(fmt) \
+	template void write_block<fmt>(uint8_t*, uint32_t, uint32_t, uint32_t, uint32_t, const void*, uint32_t); \
+	template void read_block<fmt>(const uint8_t*, uint32_t, uint32_t, uint32_t, uint32_t, void*, uint32_t);
 
-		*(uint16_t*)&blocks[block][offset] = value;
-	}
-}
\ No newline at end of file
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT32)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT24)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT16)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT16S)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT8)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT4)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT8H)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT4HL)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMCT4HH)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMZ32)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMZ24)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMZ16)
+	INSTANTIATE_BLOCK_FUNCTIONS(PSMZ16S)
+
+#undef INSTANTIATE_BLOCK_FUNCTIONS
+}
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 
 namespace gs
 {
+    constexpr uint32_t VRAM_SIZE = 4 * 1024 * 1024;
     constexpr uint16_t PAGE_SIZE = 8192;
     constexpr uint16_t BLOCKS_PER_PAGE = 32;
     constexpr uint16_t BLOCK_SIZE = 256;
@@ -30,20 +32,390 @@ namespace gs
     template<PixelFormat fmt>
     struct FormatInfo;
 
-    struct Page
+    /* Layout of pixels inside a block for the 32bit formats, in words */
+    constexpr uint8_t COLUMN_LAYOUT32[8][8] =
+    {
+        {  0,  1,  4,  5,  8,  9, 12, 13 },
+        {  2,  3,  6,  7, 10, 11, 14, 15 },
+        { 16, 17, 20, 21, 24, 25, 28, 29 },
+        { 18, 19, 22, 23, 26, 27, 30, 31 },
+        { 32, 33, 36, 37, 40, 41, 44, 45 },
+        { 34, 35, 38, 39, 42, 43, 46, 47 },
+        { 48, 49, 52, 53, 56, 57, 60, 61 },
+        { 50, 51, 54, 55, 58, 59, 62, 63 }
+    };
+
+    /* Same for the 16bit formats, in halfwords */
+    constexpr uint8_t COLUMN_LAYOUT16[8][16] =
+    {
+        {   0,   2,   8,  10,  16,  18,  24,  26,   1,   3,   9,  11,  17,  19,  25,  27 },
+        {   4,   6,  12,  14,  20,  22,  28,  30,   5,   7,  13,  15,  21,  23,  29,  31 },
+        {  32,  34,  40,  42,  48,  50,  56,  58,  33,  35,  41,  43,  49,  51,  57,  59 },
+        {  36,  38,  44,  46,  52,  54,  60,  62,  37,  39,  45,  47,  53,  55,  61,  63 },
+        {  64,  66,  72,  74,  80,  82,  88,  90,  65,  67,  73,  75,  81,  83,  89,  91 },
+        {  68,  70,  76,  78,  84,  86,  92,  94,  69,  71,  77,  79,  85,  87,  93,  95 },
+        {  96,  98, 104, 106, 112, 114, 120, 122,  97,  99, 105, 107, 113, 115, 121, 123 },
+        { 100, 102, 108, 110, 116, 118, 124, 126, 101, 103, 109, 111, 117, 119, 125, 127 }
+    };
+
+    /* The 8 and 4bit layouts are the 32bit one with every word split up.
+       Columns are 4 rows high and every other column has one pair of rows
+       rotated by half a word row, in bytes for 8bit and nibbles for 4bit */
+    constexpr uint32_t small_column_unit(int x, int y)
+    {
+        int swap = (((y + 2) >> 2) & 1) * 4;
+        int row = (((y & ~3) >> 1) + (y & 1)) & 7;
+        return COLUMN_LAYOUT32[row][(x + swap) & 7];
+    }
+
+    constexpr auto make_column_layout8()
+    {
+        std::array<std::array<uint8_t, 16>, 16> layout = {};
+        for (int y = 0; y < 16; y++)
+            for (int x = 0; x < 16; x++)
+                layout[y][x] = small_column_unit(x, y) * 4 + ((y >> 1) & 1) + ((x >> 2) & 2);
+        return layout;
+    }
+
+    constexpr auto make_column_layout4()
+    {
+        std::array<std::array<uint16_t, 32>, 16> layout = {};
+        for (int y = 0; y < 16; y++)
+            for (int x = 0; x < 32; x++)
+                layout[y][x] = (small_column_unit(x, y) * 4 + ((x >> 3) & 3)) * 2 + ((y >> 1) & 1);
+        return layout;
+    }
+
+    /* In bytes and nibbles */
+    constexpr auto COLUMN_LAYOUT8 = make_column_layout8();
+    constexpr auto COLUMN_LAYOUT4 = make_column_layout4();
+
+    static_assert(COLUMN_LAYOUT8[0][8] == 2 && COLUMN_LAYOUT8[2][0] == 33 && COLUMN_LAYOUT8[4][0] == 96);
+    static_assert(COLUMN_LAYOUT4[0][8] == 2 && COLUMN_LAYOUT4[2][0] == 65 && COLUMN_LAYOUT4[4][0] == 192);
+
+    /* Page and block geometry shared by the formats of one pixel size.
+       pixel_address counts in units of UNIT_BITS, the unit being stored
+       as Type. Formats own the bits MASK << SHIFT of their unit, and
+       transfers pack their pixels with BITS bits each */
+    struct Layout32
+    {
+        using Type = uint32_t;
+        constexpr static uint32_t UNIT_BITS = 32;
+        constexpr static uint32_t BITS = 32;
+        constexpr static uint32_t MASK = 0xFFFFFFFF;
+        constexpr static uint32_t SHIFT = 0;
+        constexpr static uint16_t PAGE_PIXEL_WIDTH = 64;
+        constexpr static uint16_t PAGE_PIXEL_HEIGHT = 32;
+        constexpr static uint16_t PAGE_BLOCK_WIDTH = 8;
+        constexpr static uint16_t PAGE_BLOCK_HEIGHT = 4;
+        constexpr static uint16_t BLOCK_PIXEL_WIDTH = 8;
+        constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 8;
+        constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 2;
+        constexpr static auto& pixel_layout = COLUMN_LAYOUT32;
+    };
+
+    struct Layout16
+    {
+        using Type = uint16_t;
+        constexpr static uint32_t UNIT_BITS = 16;
+        constexpr static uint32_t BITS = 16;
+        constexpr static uint32_t MASK = 0xFFFF;
+        constexpr static uint32_t SHIFT = 0;
+        constexpr static uint16_t PAGE_PIXEL_WIDTH = 64;
+        constexpr static uint16_t PAGE_PIXEL_HEIGHT = 64;
+        constexpr static uint16_t PAGE_BLOCK_WIDTH = 4;
+        constexpr static uint16_t PAGE_BLOCK_HEIGHT = 8;
+        constexpr static uint16_t BLOCK_PIXEL_WIDTH = 16;
+        constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 8;
+        constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 2;
+        constexpr static auto& pixel_layout = COLUMN_LAYOUT16;
+    };
+
+    struct Layout8
+    {
+        using Type = uint8_t;
+        constexpr static uint32_t UNIT_BITS = 8;
+        constexpr static uint32_t BITS = 8;
+        constexpr static uint32_t MASK = 0xFF;
+        constexpr static uint32_t SHIFT = 0;
+        constexpr static uint16_t PAGE_PIXEL_WIDTH = 128;
+        constexpr static uint16_t PAGE_PIXEL_HEIGHT = 64;
+        constexpr static uint16_t PAGE_BLOCK_WIDTH = 8;
+        constexpr static uint16_t PAGE_BLOCK_HEIGHT = 4;
+        constexpr static uint16_t BLOCK_PIXEL_WIDTH = 16;
+        constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 16;
+        constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 4;
+        constexpr static auto& pixel_layout = COLUMN_LAYOUT8;
+    };
+
+    /* Two pixels share a byte, the even one in the low nibble */
+    struct Layout4
+    {
+        using Type = uint8_t;
+        constexpr static uint32_t UNIT_BITS = 4;
+        constexpr static uint32_t BITS = 4;
+        constexpr static uint32_t MASK = 0xF;
+        constexpr static uint32_t SHIFT = 0;
+        constexpr static uint16_t PAGE_PIXEL_WIDTH = 128;
+        constexpr static uint16_t PAGE_PIXEL_HEIGHT = 128;
+        constexpr static uint16_t PAGE_BLOCK_WIDTH = 4;
+        constexpr static uint16_t PAGE_BLOCK_HEIGHT = 8;
+        constexpr static uint16_t BLOCK_PIXEL_WIDTH = 32;
+        constexpr static uint16_t BLOCK_PIXEL_HEIGHT = 16;
+        constexpr static uint16_t COLUMN_PIXEL_HEIGHT = 4;
+        constexpr static auto& pixel_layout = COLUMN_LAYOUT4;
+    };
+
+    /* The formats only differ in the order of blocks inside a page */
+    template<>
+    struct FormatInfo<PSMCT32> : Layout32
+    {
+        constexpr static uint8_t block_layout[4][8] =
+        {
+            {  0,  1,  4,  5, 16, 17, 20, 21 },
+            {  2,  3,  6,  7, 18, 19, 22, 23 },
+            {  8,  9, 12, 13, 24, 25, 28, 29 },
+            { 10, 11, 14, 15, 26, 27, 30, 31 }
+        };
+    };
+
+    template<>
+    struct FormatInfo<PSMZ32> : Layout32
+    {
+        constexpr static uint8_t block_layout[4][8] =
+        {
+            { 24, 25, 28, 29,  8,  9, 12, 13 },
+            { 26, 27, 30, 31, 10, 11, 14, 15 },
+            { 16, 17, 20, 21,  0,  1,  4,  5 },
+            { 18, 19, 22, 23,  2,  3,  6,  7 }
+        };
+    };
+
+    template<>
+    struct FormatInfo<PSMCT16> : Layout16
+    {
+        constexpr static uint8_t block_layout[8][4] =
+        {
+            {  0,  2,  8, 10 },
+            {  1,  3,  9, 11 },
+            {  4,  6, 12, 14 },
+            {  5,  7, 13, 15 },
+            { 16, 18, 24, 26 },
+            { 17, 19, 25, 27 },
+            { 20, 22, 28, 30 },
+            { 21, 23, 29, 31 }
+        };
+    };
+
+    template<>
+    struct FormatInfo<PSMCT16S> : Layout16
+    {
+        constexpr static uint8_t block_layout[8][4] =
+        {
+            {  0,  2, 16, 18 },
+            {  1,  3, 17, 19 },
+            {  8, 10, 24, 26 },
+            {  9, 11, 25, 27 },
+            {  4,  6, 20, 22 },
+            {  5,  7, 21, 23 },
+            { 12, 14, 28, 30 },
+            { 13, 15, 29, 31 }
+        };
+    };
+
+    template<>
+    struct FormatInfo<PSMZ16> : Layout16
+    {
+        constexpr static uint8_t block_layout[8][4] =
+        {
+            { 24, 26, 16, 18 },
+            { 25, 27, 17, 19 },
+            { 28, 30, 20, 22 },
+            { 29, 31, 21, 23 },
+            {  8, 10,  0,  2 },
+            {  9, 11,  1,  3 },
+            { 12, 14,  4,  6 },
+            { 13, 15,  5,  7 }
+        };
+    };
+
+    template<>
+    struct FormatInfo<PSMZ16S> : Layout16
     {
-        constexpr static uint16_t PIXEL_WIDTH = 64;
-		constexpr static uint16_t PIXEL_HEIGHT = 32;
-		constexpr static uint16_t BLOCK_WIDTH = 8;
-		constexpr static uint16_t BLOCK_HEIGHT = 4;
+        constexpr static uint8_t block_layout[8][4] =
+        {
+            { 24, 26,  8, 10 },
+            { 25, 27,  9, 11 },
+            { 16, 18,  0,  2 },
+            { 17, 19,  1,  3 },
+            { 28, 30, 12, 14 },
+            { 29, 31, 13, 15 },
+            { 20, 22,  4,  6 },
+            { 21, 23,  5,  7 }
+        };
+    };
+
+    /* The 24bit and upper bits formats live inside 32bit words */
+    template<>
+    struct FormatInfo<PSMCT24> : FormatInfo<PSMCT32>
+    {
+        constexpr static uint32_t BITS = 24;
+        constexpr static uint32_t MASK = 0xFFFFFF;
+    };
+
+    template<>
+    struct FormatInfo<PSMZ24> : FormatInfo<PSMZ32>
+    {
+        constexpr static uint32_t BITS = 24;
+        constexpr static uint32_t MASK = 0xFFFFFF;
+    };
+
+    template<>
+    struct FormatInfo<PSMCT8H> : FormatInfo<PSMCT32>
+    {
+        constexpr static uint32_t BITS = 8;
+        constexpr static uint32_t MASK = 0xFF;
+        constexpr static uint32_t SHIFT = 24;
+    };
+
+    template<>
+    struct FormatInfo<PSMCT4HL> : FormatInfo<PSMCT32>
+    {
+        constexpr static uint32_t BITS = 4;
+        constexpr static uint32_t MASK = 0xF;
+        constexpr static uint32_t SHIFT = 24;
+    };
+
+    template<>
+    struct FormatInfo<PSMCT4HH> : FormatInfo<PSMCT32>
+    {
+        constexpr static uint32_t BITS = 4;
+        constexpr static uint32_t MASK = 0xF;
+        constexpr static uint32_t SHIFT = 28;
+    };
+
+    /* PSMT8 orders its blocks like PSMCT32 and PSMT4 like PSMCT16 */
+    template<>
+    struct FormatInfo<PSMCT8> : Layout8
+    {
+        constexpr static auto& block_layout = FormatInfo<PSMCT32>::block_layout;
+    };
+
+    template<>
+    struct FormatInfo<PSMCT4> : Layout4
+    {
+        constexpr static auto& block_layout = FormatInfo<PSMCT16>::block_layout;
+    };
+
+    /* Index of pixel (x, y) of a buffer in local memory, in units of the
+       format's layout. base is in blocks and width in 64 pixel units
+       like in FRAME, ZBUF and BITBLTBUF. Addresses wrap around at 4MB */
+    template<PixelFormat fmt>
+    inline uint32_t pixel_address(uint32_t x, uint32_t y, uint32_t base, uint32_t width)
+    {
+        using Info = FormatInfo<fmt>;
+        constexpr uint32_t PIXELS_PER_BLOCK = BLOCK_SIZE * 8 / Info::UNIT_BITS;
+        constexpr uint32_t VRAM_PIXELS = VRAM_SIZE * 8 / Info::UNIT_BITS;
 
-		/* Write a 32bit value to a PSMCT32 buffer */
-		void write_psmct32(uint16_t x, uint16_t y, uint32_t value);
+        /* The 8 and 4bit pages are twice as wide */
+        uint32_t pages_per_row = width * 64 / Info::PAGE_PIXEL_WIDTH;
+        uint32_t page = (y / Info::PAGE_PIXEL_HEIGHT) * pages_per_row + x / Info::PAGE_PIXEL_WIDTH;
+        uint32_t block_x = (x / Info::BLOCK_PIXEL_WIDTH) % Info::PAGE_BLOCK_WIDTH;
+        uint32_t block_y = (y / Info::BLOCK_PIXEL_HEIGHT) % Info::PAGE_BLOCK_HEIGHT;
+        uint32_t block = base + page * BLOCKS_PER_PAGE + Info::block_layout[block_y][block_x];
 
-		/* Write a 16bit value to a PSMCT16 buffer */
-		void write_psmct16(uint16_t x, uint16_t y, uint16_t value);
+        uint32_t pixel = Info::pixel_layout[y % Info::BLOCK_PIXEL_HEIGHT][x % Info::BLOCK_PIXEL_WIDTH];
+        return (block * PIXELS_PER_BLOCK + pixel) & (VRAM_PIXELS - 1);
+    }
 
-	private:
-		uint8_t blocks[BLOCKS_PER_PAGE][BLOCK_SIZE] = {};
+    /* Value of the pixel at (x, y), the format's bits shifted down */
+    template<PixelFormat fmt>
+    inline uint32_t read_pixel(const uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width)
+    {
+        using Info = FormatInfo<fmt>;
+        uint32_t address = pixel_address<fmt>(x, y, base, width);
+        if constexpr (Info::UNIT_BITS == 4)
+            return (vram[address >> 1] >> ((address & 0x1) * 4)) & 0xF;
+        else
+            return (((const typename Info::Type*)vram)[address] >> Info::SHIFT) & Info::MASK;
+    }
+
+    /* Only touches the bits the format owns */
+    template<PixelFormat fmt>
+    inline void write_pixel(uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width, uint32_t value)
+    {
+        using Info = FormatInfo<fmt>;
+        using Type = typename Info::Type;
+        uint32_t address = pixel_address<fmt>(x, y, base, width);
+        if constexpr (Info::UNIT_BITS == 4)
+        {
+            uint32_t shift = (address & 0x1) * 4;
+            auto& unit = vram[address >> 1];
+            unit = (unit & ~(0xF << shift)) | ((value & 0xF) << shift);
+        }
+        else if constexpr (Info::MASK == Type(~0u))
+            ((Type*)vram)[address] = value;
+        else
+        {
+            auto& unit = ((Type*)vram)[address];
+            unit = (unit & ~(Info::MASK << Info::SHIFT)) | ((value & Info::MASK) << Info::SHIFT);
+        }
+    }
+
+    /* Pixel number index of data packed like in transfers: BITS bits
+       each, 24bit ones in 3 bytes and 4bit ones even pixel first */
+    template<PixelFormat fmt>
+    inline uint32_t unpack_pixel(const uint8_t* data, uint32_t index)
+    {
+        constexpr uint32_t BITS = FormatInfo<fmt>::BITS;
+        if constexpr (BITS == 4)
+            return (data[index >> 1] >> ((index & 0x1) * 4)) & 0xF;
+        else if constexpr (BITS == 8)
+            return data[index];
+        else if constexpr (BITS == 16)
+            return ((const uint16_t*)data)[index];
+        else if constexpr (BITS == 24)
+            return data[index * 3] | (data[index * 3 + 1] << 8) | (data[index * 3 + 2] << 16);
+        else
+            return ((const uint32_t*)data)[index];
+    }
+
+    template<PixelFormat fmt>
+    inline void pack_pixel(uint8_t* data, uint32_t index, uint32_t value)
+    {
+        constexpr uint32_t BITS = FormatInfo<fmt>::BITS;
+        if constexpr (BITS == 4)
+        {
+            uint32_t shift = (index & 0x1) * 4;
+            data[index >> 1] = (data[index >> 1] & ~(0xF << shift)) | ((value & 0xF) << shift);
+        }
+        else if constexpr (BITS == 8)
+            data[index] = value;
+        else if constexpr (BITS == 16)
+            ((uint16_t*)data)[index] = value;
+        else if constexpr (BITS == 24)
+        {
+            data[index * 3] = value;
+            data[index * 3 + 1] = value >> 8;
+            data[index * 3 + 2] = value >> 16;
+        }
+        else
+            ((uint32_t*)data)[index] = value;
+    }
+
+    /* Swizzle a whole block of pixels from packed rows stride pixels
+       apart and back. x and y have to be aligned to the format's block
+       size, for the 4bit formats stride has to be even */
+    template<PixelFormat fmt>
+    void write_block(uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width,
+                     const void* src, uint32_t stride);
+    template<PixelFormat fmt>
+    void read_block(const uint8_t* vram, uint32_t x, uint32_t y, uint32_t base, uint32_t width,
+                    void* dst, uint32_t stride);
+
+    /* Local memory is allocated in pages, pixel_address finds anything inside */
+    struct Page
+    {
+        uint8_t blocks[BLOCKS_PER_PAGE][BLOCK_SIZE] = {};
     };
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+
 namespace util
 {
 	template <typename _Ty, int N>
@@ -30,6 +33,44 @@ namespace util
 			return false;
 		}
 
+		/* Pushes as many whole values as fit, returns how many did */
+		template <typename T>
+		inline int push_block(const T* values, int n)
+		{
+			static_assert(sizeof(T) % sizeof(_Ty) == 0);
+			constexpr int TRATIO = sizeof(T) / sizeof(_Ty);
+
+			n = std::min(n, (N - count) / TRATIO);
+			int words = n * TRATIO;
+			int first = std::min(words, N - rear);
+
+			auto dbuf = (const _Ty*)values;
+			std::memcpy(&buffer[rear], dbuf, first * sizeof(_Ty));
+			std::memcpy(&buffer[0], dbuf + first, (words - first) * sizeof(_Ty));
+
+			rear = (rear + words) % N;
+			count += words;
+			return n;
+		}
+
+		/* Pops n whole values, there have to be that many */
+		template <typename T>
+		inline void pop_block(T* values, int n)
+		{
+			static_assert(sizeof(T) % sizeof(_Ty) == 0);
+			constexpr int TRATIO = sizeof(T) / sizeof(_Ty);
+
+			int words = n * TRATIO;
+			int first = std::min(words, N - front);
+
+			auto dbuf = (_Ty*)values;
+			std::memcpy(dbuf, &buffer[front], first * sizeof(_Ty));
+			std::memcpy(dbuf + first, &buffer[0], (words - first) * sizeof(_Ty));
+
+			front = (front + words) % N;
+			count -= words;
+		}
+
 		template <typename T = _Ty>
 		inline bool pop()
 		{
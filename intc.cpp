@@ -1,5 +1,6 @@
 #include <intc.hpp>
 #include <EE.hpp>
+#include <logger.hpp>
 
 static const char* REGS[2] =
 {
@@ -30,7 +31,7 @@ void INTC::write(uint32_t addr, uint64_t data)
 
     cpu->cop0.cause.ip0_pending = (regs.intc_mask & regs.intc_stat);
 
-    printf("[INTC]: Writing 0x%08lX to %s\n", data, REGS[offset]);
+    LOG(INTC, Debug, "[INTC]: Writing 0x%08lX to %s\n", data, REGS[offset]);
 }
 
 void INTC::trigger(uint32_t intr)
@@ -52,4 +53,17 @@ bool INTC::int_pending()
             (cop0.cause.timer_ip_pending && cop0.status.im7);
     
     return int_enabled && pending;
+}
+
+void INTC::register_mmio(Bus* bus)
+{
+    for (uint32_t addr : { 0x1000F000, 0x1000F010 })
+    {
+        bus->register_mmio(addr, addr + 4,
+        {
+            .read32 = [this](uint32_t addr) -> uint32_t { return read(addr); },
+            .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); },
+            .write64 = [this](uint32_t addr, uint64_t data) { write(addr, data); }
+        });
+    }
 }
\ No newline at end of file
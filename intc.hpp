@@ -28,6 +28,7 @@ struct INTCRegs
 };
 
 class EmotionEngine;
+class Bus;
 
 class INTC
 {
@@ -38,6 +39,8 @@ public:
     uint64_t read(uint32_t addr);
     void write(uint32_t addr, uint64_t data);
 
+    void register_mmio(Bus* bus);
+
     void trigger(uint32_t intr);
     bool int_pending();
 private:
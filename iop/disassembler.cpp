@@ -1,7 +1,6 @@
 #include <iomanip>
 #include <sstream>
 #include <iop/disassembler.hpp>
-#include <iop/iop.hpp>
 
 using namespace std;
 
@@ -14,9 +13,27 @@ using namespace std;
 namespace EmotionDisasm
 {
 
+static const uint32_t* disasm_gpr = nullptr;
 
-string disasm_instr(uint32_t instruction, uint32_t instr_addr)
+const char* reg_name(int id)
 {
+    static const char* names[] =
+    {
+        "zero", "at", "v0", "v1",
+        "a0", "a1", "a2", "a3",
+        "t0", "t1", "t2", "t3",
+        "t4", "t5", "t6", "t7",
+        "s0", "s1", "s2", "s3",
+        "s4", "s5", "s6", "s7",
+        "t8", "t9", "k0", "k1",
+        "gp", "sp", "fp", "ra"
+    };
+    return names[id];
+}
+
+string disasm_instr(uint32_t instruction, uint32_t instr_addr, const uint32_t* gpr)
+{
+    disasm_gpr = gpr;
     if (!instruction)
         return "nop";
     switch (instruction >> 26)
@@ -166,11 +183,11 @@ string disasm_branch_equality(string opcode, uint32_t instruction, uint32_t inst
     uint64_t rs = RS;
     uint64_t rt = RT;
 
-    output << IOP::REG(rs) << ", ";
+    output << reg_name(rs) << ", ";
     if (!rt)
         opcode += "z";
     else
-        output << IOP::REG(rt) << ", ";
+        output << reg_name(rt) << ", ";
     output << "$" << setfill('0') << setw(8) << hex << (instr_addr + offset + 4);
 
     return opcode + " " + output.str();
@@ -220,7 +237,7 @@ string disasm_regimm(uint32_t instruction, uint32_t instr_addr)
     }
     int32_t offset = IMM;
     offset <<= 2;
-    output << IOP::REG(RS) << ", "
+    output << reg_name(RS) << ", "
            << "$" << setfill('0') << setw(8) << hex << (instr_addr + offset + 4);
 
     return opcode + " " + output.str();
@@ -230,14 +247,14 @@ string disasm_regimm(uint32_t instruction, uint32_t instr_addr)
 string disasm_mtsab(uint32_t instruction)
 {
     stringstream output;
-    output << "mtsab " << IOP::REG(RS) << ", " << (uint16_t)IMM;
+    output << "mtsab " << reg_name(RS) << ", " << (uint16_t)IMM;
     return output.str();
 }
 
 string disasm_mtsah(uint32_t instruction)
 {
     stringstream output;
-    output << "mtsah " << IOP::REG(RS) << ", " << (uint16_t)IMM;
+    output << "mtsah " << reg_name(RS) << ", " << (uint16_t)IMM;
     return output.str();
 }
 
@@ -360,9 +377,9 @@ string disasm_sra(uint32_t instruction)
 string disasm_variableshift(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RT) << ", "
-           << IOP::REG(RS);
+    output << reg_name(RD) << ", "
+           << reg_name(RT) << ", "
+           << reg_name(RS);
 
     return opcode + " " + output.str();
 }
@@ -386,7 +403,7 @@ string disasm_jr(uint32_t instruction)
 {
     stringstream output;
     string opcode = "jr";
-    output << IOP::REG(RS);
+    output << reg_name(RS);
 
     return opcode + " " + output.str();
 }
@@ -396,8 +413,8 @@ string disasm_jalr(uint32_t instruction)
     stringstream output;
     string opcode = "jalr";
     if (RD != 31)
-        output << IOP::REG(RD) << ", ";
-    output << IOP::REG(RS);
+        output << reg_name(RD) << ", ";
+    output << reg_name(RS);
 
     return opcode + " " + output.str();
 }
@@ -405,9 +422,9 @@ string disasm_jalr(uint32_t instruction)
 string disasm_conditional_move(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RS) << ", "
-           << IOP::REG(RT);
+    output << reg_name(RD) << ", "
+           << reg_name(RS) << ", "
+           << reg_name(RT);
 
     return opcode + " " + output.str();
 }
@@ -435,7 +452,7 @@ string disasm_syscall_ee(uint32_t instruction)
 string disasm_movereg(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD);
+    output << reg_name(RD);
     return opcode + " " + output.str();
 }
 
@@ -447,7 +464,7 @@ string disasm_mfhi(uint32_t instruction)
 string disasm_moveto(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RS);
+    output << reg_name(RS);
     return opcode + " " + output.str();
 }
 
@@ -494,8 +511,8 @@ string disasm_multu(uint32_t instruction)
 string disasm_division(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RS) << ", "
-           << IOP::REG(RT);
+    output << reg_name(RS) << ", "
+           << reg_name(RT);
 
     return opcode + " " + output.str();
 }
@@ -513,9 +530,9 @@ string disasm_divu(uint32_t instruction)
 string disasm_special_simplemath(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RS) << ", "
-           << IOP::REG(RT);
+    output << reg_name(RD) << ", "
+           << reg_name(RS) << ", "
+           << reg_name(RT);
 
     return opcode + " " + output.str();
 }
@@ -605,8 +622,8 @@ string disasm_dsubu(uint32_t instruction)
 string disasm_special_shift(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RT) << ", "
+    output << reg_name(RD) << ", "
+           << reg_name(RT) << ", "
            << SA;
     return opcode + " " + output.str();
 }
@@ -654,7 +671,7 @@ string disasm_branch_inequality(const std::string opcode, uint32_t instruction,
     int32_t offset = IMM;
     offset <<= 2;
 
-    output << IOP::REG(RS) << ", "
+    output << reg_name(RS) << ", "
            << "$" << setfill('0') << setw(8) << hex << (instr_addr + offset + 4);
 
     return opcode + " " + output.str();
@@ -674,7 +691,7 @@ string disasm_bgtz(uint32_t instruction, uint32_t instr_addr)
 string disasm_math(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RT) << ", " << IOP::REG(RS) << ", "
+    output << reg_name(RT) << ", " << reg_name(RS) << ", "
            << "$" << setfill('0') << setw(4) << hex << IMM;
     return opcode + " " + output.str();
 }
@@ -710,8 +727,8 @@ string disasm_move(uint32_t instruction)
 {
     stringstream output;
     string opcode = "move";
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RS);
+    output << reg_name(RD) << ", "
+           << reg_name(RS);
 
     return opcode + " " + output.str();
 }
@@ -725,7 +742,7 @@ string disasm_lui(uint32_t instruction)
 {
     stringstream output;
     string opcode = "lui";
-    output << IOP::REG(RT) << ", "
+    output << reg_name(RT) << ", "
            << "$" << setfill('0') << setw(4) << hex << IMM;
 
     return opcode + " " + output.str();
@@ -754,10 +771,11 @@ string disasm_daddiu(uint32_t instruction)
 string disasm_loadstore(const std::string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RT) << ", "
+    output << reg_name(RT) << ", "
            << IMM
-           << "{" << IOP::REG(RS) << "}"
-           << " (0x" << std::hex << iop->gpr[RS]+IMM << ")";
+           << "{" << reg_name(RS) << "}";
+    if (disasm_gpr)
+        output << " (0x" << std::hex << disasm_gpr[RS]+IMM << ")";
     return opcode + " " + output.str();
 }
 
@@ -766,7 +784,7 @@ string disasm_cop2_loadstore(const string opcode, uint32_t instruction)
     stringstream output;
     output << "vf" << RT << ", "
            << IMM
-           << "{" << IOP::REG(RS) << "}";
+           << "{" << reg_name(RS) << "}";
     return opcode + " " + output.str();
 }
 
@@ -956,7 +974,7 @@ string disasm_cop_move(string opcode, uint32_t instruction)
 
     int cop_id = (instruction >> 26) & 0x3;
 
-    output << opcode << cop_id << " " << IOP::REG(RT) << ", "
+    output << opcode << cop_id << " " << reg_name(RT) << ", "
            << RD;
 
     return output.str();
@@ -1250,7 +1268,7 @@ string disasm_cop2_qmove(const string opcode, uint32_t instruction)
     output << opcode;
     if (instruction & 1)
         output << ".i";
-    output << " " << IOP::REG(RT) << ", vf" << ((instruction >> 11) & 0x1F);
+    output << " " << reg_name(RT) << ", vf" << ((instruction >> 11) & 0x1F);
     return output.str();
 }
 
@@ -2108,8 +2126,8 @@ string disasm_vrxor(uint32_t instruction)
 string disasm_mmi_copy(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RT);
+    output << reg_name(RD) << ", "
+           << reg_name(RT);
 
     return opcode + " " + output.str();
 }
@@ -2117,7 +2135,7 @@ string disasm_mmi_copy(const string opcode, uint32_t instruction)
 string disasm_mmi_copy_hilo(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RD) << ", hi, lo";
+    output << reg_name(RD) << ", hi, lo";
 
     return opcode + " " + output.str();
 }
@@ -2125,7 +2143,7 @@ string disasm_mmi_copy_hilo(const string opcode, uint32_t instruction)
 string disasm_mmi_copyto_hilo(const string opcode, uint32_t instruction)
 {
     stringstream output;
-    output << IOP::REG(RS) << ", hi, lo";
+    output << reg_name(RS) << ", hi, lo";
 
     return opcode + " " + output.str();
 }
@@ -2184,8 +2202,8 @@ string disasm_plzcw(uint32_t instruction)
 {
     stringstream output;
     string opcode = "plzcw";
-    output << IOP::REG(RD) << ", "
-           << IOP::REG(RS);
+    output << reg_name(RD) << ", "
+           << reg_name(RS);
     return opcode + " " + output.str();
 }
 
@@ -2257,7 +2275,7 @@ string disasm_psubb(uint32_t instruction)
 string disasm_pext5(uint32_t instruction)
 {
     stringstream output;
-    output << "pext5 " << IOP::REG(RD) << ", " << IOP::REG(RT);
+    output << "pext5 " << reg_name(RD) << ", " << reg_name(RT);
     return output.str();
 }
 
@@ -2310,14 +2328,14 @@ string disasm_mmi1(uint32_t instruction)
 string disasm_pabsw(uint32_t instruction)
 {
     stringstream output;
-    output << "pabsw " << IOP::REG(RD) << ", " << IOP::REG(RT);
+    output << "pabsw " << reg_name(RD) << ", " << reg_name(RT);
     return output.str();
 }
 
 string disasm_pabsh(uint32_t instruction)
 {
     stringstream output;
-    output << "pabsh " << IOP::REG(RD) << ", " << IOP::REG(RT);
+    output << "pabsh " << reg_name(RD) << ", " << reg_name(RT);
     return output.str();
 }
 
@@ -3,13 +3,11 @@
 #include <cstdint>
 #include <string>
 
-class IOP;
-
-extern IOP* iop;
-
 namespace EmotionDisasm
 {
-    std::string disasm_instr(uint32_t instruction, uint32_t instr_addr);
+    /* Register values used to show load/store addresses, left out without them */
+    std::string disasm_instr(uint32_t instruction, uint32_t instr_addr, const uint32_t* gpr = nullptr);
+    const char* reg_name(int id);
 
     std::string disasm_special(uint32_t instruction);
     std::string disasm_special_shift(const std::string opcode, uint32_t instruction);
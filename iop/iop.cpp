@@ -3,60 +3,46 @@
 #include <cstdlib>
 #include <cstring>
 #include <iop/iop.hpp>
+#include <iop/disassembler.hpp>
 #include <iop/iop_interpreter.hpp>
+#include <jit/iop_jit.hpp>
 
 #include <Bus.hpp>
-#include <iop/disassembler.hpp>
 
 IOP::IOP(Bus* bus)
 : bus(bus)
 {
-    disasm_log = fopen("disassembly_iop.log", "w");
+    /* Drop decoded blocks when the RAM under them is written */
+    bus->iop_code_written = [this](uint32_t page) { invalidate_page(page); };
+}
+
+IOP::~IOP() = default;
+
+void IOP::enable_jit()
+{
+    jit = std::make_unique<IOPJit>(this, bus);
 }
 
 const char* IOP::REG(int id)
 {
-    static const char* names[] =
-    {
-        "zero", "at", "v0", "v1",
-        "a0", "a1", "a2", "a3",
-        "t0", "t1", "t2", "t3",
-        "t4", "t5", "t6", "t7",
-        "s0", "s1", "s2", "s3",
-        "s4", "s5", "s6", "s7",
-        "t8", "t9", "k0", "k1",
-        "gp", "sp", "fp", "ra"
-    };
-    return names[id];
+    return EmotionDisasm::reg_name(id);
 }
 
 void IOP::reset()
 {
     cop0.reset();
     PC = 0xBFC00000;
-    memset(icache, 0, sizeof(icache));
+    for (auto& line : icache)
+        line.tag = IOP_ICACHE_INVALID;
+    cache_control = 0;
     gpr[0] = 0;
     branch_delay = 0;
     will_branch = false;
-    can_disassemble = false;
     wait_for_IRQ = false;
     muldiv_delay = 0;
     cycles_to_run = 0;
 }
 
-uint32_t IOP::translate_addr(uint32_t addr)
-{
-    //KSEG0
-    if (addr >= 0x80000000 && addr < 0xA0000000)
-        return addr - 0x80000000;
-    //KSEG1
-    if (addr >= 0xA0000000 && addr < 0xC0000000)
-        return addr - 0xA0000000;
-
-    //KUSEG, KSEG2
-    return addr;
-}
-
 void IOP::run(int cycles)
 {
     if (PC == 0x12C48 || PC == 0x1420C || PC == 0x1430C)
@@ -75,37 +61,14 @@ void IOP::run(int cycles)
     if (!wait_for_IRQ)
     {
         cycles_to_run += cycles;
-        while (cycles_to_run > 0)
-        {
-            cycles_to_run--;
-            if (muldiv_delay > 0)
-                muldiv_delay--;
-            uint32_t instr = read_instr(PC);
-            if (can_disassemble)
-            {
-                fprintf(disasm_log, "[IOP] [$%08X] $%08X - %s\n", PC, instr, EmotionDisasm::disasm_instr(instr, PC).c_str());
-                fflush(disasm_log);
-                //print_state();
-            }
-            IOP_Interpreter::interpret(*this, instr);
-
-            PC += 4;
 
-            if (will_branch)
-            {
-                if (!branch_delay)
-                {
-                    will_branch = false;
-                    PC = new_PC;
-                    if (PC & 0x3)
-                    {
-                        printf("[IOP] Invalid PC address $%08X!\n", PC);
-                        exit(1);
-                    }
-                }
-                else
-                    branch_delay--;
-            }
+        /* Tracing needs every instruction to go through the interpreter */
+        if (jit && !trace)
+            jit->run();
+        else
+        {
+            while (cycles_to_run > 0)
+                step();
         }
     }
     else if (muldiv_delay)
@@ -115,6 +78,204 @@ void IOP::run(int cycles)
         interrupt();
 }
 
+void IOP::step()
+{
+    cycles_to_run--;
+    instructions_retired++;
+    if (muldiv_delay > 0)
+        muldiv_delay--;
+    auto& decoded = fetch_decoded();
+    if (trace)
+        trace->record(PC, decoded.value);
+
+    if (decoded.handler)
+        decoded.handler(*this, decoded.value);
+
+    if (trace && trace->has_registers())
+        trace->record_registers(gpr);
+
+    PC += 4;
+
+    if (will_branch)
+    {
+        if (!branch_delay)
+        {
+            will_branch = false;
+            PC = new_PC;
+            if (PC & 0x3)
+            {
+                printf("[IOP] Invalid PC address $%08X!\n", PC);
+                exit(1);
+            }
+        }
+        else
+            branch_delay--;
+    }
+}
+
+const IOPDecodedInstr& IOP::fetch_decoded()
+{
+    uint32_t paddr = PC & 0x1FFFFFFF;
+    bool cacheable = paddr < 0x200000 || (paddr >= 0x1FC00000 && paddr < 0x20000000);
+    if (PC < 0xA0000000 && (cache_control & (1 << 11)) && cacheable)
+    {
+        auto& line = icache[(paddr >> 4) & 0xFF];
+        if (line.tag != paddr >> 12)
+            icache_miss(paddr);
+        return line.instrs[(paddr >> 2) & 0x3];
+    }
+
+    /* Uncached fetches go out to memory every time */
+    cycles_to_run -= 4;
+    muldiv_delay = std::max(muldiv_delay - 4, 0);
+
+    /* Keep walking the current block while execution is sequential */
+    if (!cur_block || PC != cur_pc)
+        cur_block = lookup_block(PC);
+
+    if (!cur_block)
+    {
+        /* Code outside of RAM/BIOS is never cached */
+        uncached.value = bus->iop_read32(PC & 0x1FFFFFFF);
+        uncached.handler = IOP_Interpreter::decode(uncached.value);
+        return uncached;
+    }
+
+    auto& decoded = cur_block->instrs[cur_index++];
+    cur_pc = PC + 4;
+    if (cur_index == cur_block->instrs.size())
+        cur_block = nullptr;
+
+    return decoded;
+}
+
+/* Refills the line holding paddr. The refill starts at the missed word
+   and runs to the end of the line, each word costing as much as an
+   uncached fetch */
+void IOP::icache_miss(uint32_t paddr)
+{
+    auto& line = icache[(paddr >> 4) & 0xFF];
+    uint32_t base = paddr & ~0xF;
+    for (int i = 0; i < 4; i++)
+    {
+        uint32_t value = bus->iop_read32(base + i * 4);
+        line.instrs[i] = { value, IOP_Interpreter::decode(value) };
+    }
+    line.tag = paddr >> 12;
+
+    /* Real hardware keeps stale lines until software flushes them, but
+       code written behind the BIOS's back has to be seen right away */
+    if (paddr < 0x200000)
+        bus->mark_iop_code_page(paddr >> 12);
+
+    int penalty = 4 * (4 - ((paddr >> 2) & 0x3));
+    cycles_to_run -= penalty;
+    muldiv_delay = std::max(muldiv_delay - penalty, 0);
+}
+
+void IOP::icache_invalidate_page(uint32_t page)
+{
+    for (auto& line : icache)
+    {
+        if (line.tag == page)
+            line.tag = IOP_ICACHE_INVALID;
+    }
+}
+
+bool IOP::ends_block(uint32_t value)
+{
+    switch (value >> 26)
+    {
+    case 0x00:
+        /* JR, JALR, SYSCALL */
+        switch (value & 0x3F)
+        {
+        case 0x08: case 0x09: case 0x0C:
+            return true;
+        }
+        return false;
+    case 0x01: /* REGIMM branches */
+    case 0x02 ... 0x07: /* J, JAL, BEQ, BNE, BLEZ, BGTZ */
+        return true;
+    }
+
+    return false;
+}
+
+IOPBlock* IOP::lookup_block(uint32_t vaddr)
+{
+    uint32_t paddr = vaddr & 0x1FFFFFFF;
+    cur_index = 0;
+
+    /* Only RAM and BIOS are cached */
+    bool ram = paddr < 0x200000;
+    bool bios = paddr >= 0x1FC00000 && paddr < 0x20000000;
+    if ((!ram && !bios) || (vaddr & 0x3))
+        return nullptr;
+
+    auto it = blocks.find(paddr);
+    if (it != blocks.end())
+        return it->second.get();
+
+    auto block = std::make_unique<IOPBlock>();
+    block->start = paddr;
+
+    uint32_t page = paddr >> 12;
+    bool delay_slot = false;
+    for (uint32_t addr = paddr; (addr >> 12) == page; addr += 4)
+    {
+        uint32_t value = bus->iop_read32(addr);
+        block->instrs.push_back({ value, IOP_Interpreter::decode(value) });
+
+        if (delay_slot)
+            break;
+        delay_slot = ends_block(value);
+    }
+
+    if (ram)
+    {
+        bus->mark_iop_code_page(page);
+        page_blocks[page].push_back(paddr);
+    }
+
+    auto ptr = block.get();
+    blocks[paddr] = std::move(block);
+    return ptr;
+}
+
+void IOP::invalidate_page(uint32_t page)
+{
+    if (jit)
+        jit->invalidate_page(page);
+    icache_invalidate_page(page);
+
+    auto it = page_blocks.find(page);
+    if (it == page_blocks.end())
+        return;
+
+    for (auto start : it->second)
+    {
+        if (cur_block && cur_block->start == start)
+            cur_block = nullptr;
+        blocks.erase(start);
+    }
+
+    page_blocks.erase(it);
+}
+
+void IOP::invalidate_all()
+{
+    if (jit)
+        jit->flush();
+
+    if (blocks.empty())
+        return;
+
+    cur_block = nullptr;
+    blocks.clear();
+    page_blocks.clear();
+}
+
 void IOP::print_state()
 {
     printf("pc:$%08X\n", PC);
@@ -129,9 +290,14 @@ void IOP::print_state()
     printf("lo:$%08X\thi:$%08X\n", LO, HI);
 }
 
-void IOP::set_disassembly(bool disasm)
+void IOP::start_trace(const char* path, bool registers)
 {
-    can_disassemble = disasm;
+    trace = std::make_unique<IOPTraceWriter>(path, registers, gpr);
+}
+
+void IOP::stop_trace()
+{
+    trace.reset();
 }
 
 void IOP::jp(uint32_t addr)
@@ -216,6 +382,11 @@ void IOP::mtc(int cop_id, int cop_reg, int reg)
     {
         case 0:
             cop0.mtc(cop_reg, bark);
+            if (code_flush_pending && !cop0.status.IsC)
+            {
+                code_flush_pending = false;
+                invalidate_all();
+            }
             break;
         default:
             printf("\n[IOP] MTC: Unknown COP%d", cop_id);
@@ -235,7 +406,7 @@ void IOP::rfe()
 
 uint8_t IOP::read8(uint32_t addr)
 {
-    return bus->iop_read8(translate_addr(addr));
+    return bus->iop_read8(addr);
 }
 
 uint16_t IOP::read16(uint32_t addr)
@@ -245,7 +416,7 @@ uint16_t IOP::read16(uint32_t addr)
         printf("[IOP] Invalid read16 from $%08X\n", addr);
         exit(1);
     }
-    return bus->iop_read16(translate_addr(addr));
+    return bus->iop_read16(addr);
 }
 
 uint32_t IOP::read32(uint32_t addr)
@@ -257,25 +428,14 @@ uint32_t IOP::read32(uint32_t addr)
     }
     if (addr == 0xFFFE0130)
         return cache_control;
-    return bus->iop_read32(translate_addr(addr));
-}
-
-uint32_t IOP::read_instr(uint32_t addr)
-{
-    if (addr >= 0xA0000000 || !(cache_control & (1 << 11)))
-    {
-        cycles_to_run -= 4;
-        muldiv_delay = std::max(muldiv_delay - 4, 0);
-    }
-
-    return bus->iop_read32(addr & 0x1FFFFFFF);
+    return bus->iop_read32(addr);
 }
 
 void IOP::write8(uint32_t addr, uint8_t value)
 {
     if (cop0.status.IsC)
         return;
-    bus->iop_write8(translate_addr(addr), value);
+    bus->iop_write8(addr, value);
 }
 
 void IOP::write16(uint32_t addr, uint16_t value)
@@ -287,14 +447,18 @@ void IOP::write16(uint32_t addr, uint16_t value)
         printf("[IOP] Invalid write16 to $%08X!\n", addr);
         exit(1);
     }
-    bus->iop_write16(translate_addr(addr), value);
+    bus->iop_write16(addr, value);
 }
 
 void IOP::write32(uint32_t addr, uint32_t value)
 {
     if (cop0.status.IsC)
     {
-        icache[(addr >> 4) & 0xFF].valid = false;
+        /* The BIOS clears the instruction cache this way after loading
+           code, the lines are indexed by address bits so just drop everything
+           once it's done */
+        icache[(addr >> 4) & 0xFF].tag = IOP_ICACHE_INVALID;
+        code_flush_pending = true;
         return;
     }
     if (addr & 0x3)
@@ -302,7 +466,10 @@ void IOP::write32(uint32_t addr, uint32_t value)
         printf("[IOP] Invalid write32 to $%08X!\n", addr);
         exit(1);
     }
-    if (addr = 0xFFFE0130)
+    if (addr == 0xFFFE0130)
+    {
         cache_control = value;
-    bus->iop_write32(translate_addr(addr), value);
+        return;
+    }
+    bus->iop_write32(addr, value);
 }
\ No newline at end of file
@@ -4,18 +4,49 @@
 #include <cstdlib>
 #include <cstdio>
 #include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include <iop/iop_cop0.hpp>
+#include <iop/iop_trace.hpp>
 
 class Bus;
+class IOP;
+class IOPJit;
+
+using IOPHandler = void (*)(IOP& cpu, uint32_t instruction);
+
+/* An instruction in the decode cache with its interpreter handler
+   already resolved through the opcode tables */
+struct IOPDecodedInstr
+{
+    uint32_t value;
+    IOPHandler handler;
+};
+
+/* Straight-line code up to the delay slot of the first branch, never
+   crossing a 4KB page. Keyed by the physical address of the first
+   instruction */
+struct IOPBlock
+{
+    uint32_t start;
+    std::vector<IOPDecodedInstr> instrs;
+};
+
+/* 4KB direct mapped instruction cache with 16 byte lines. Lines hold
+   decoded instructions so cached code never goes back through the bus */
+constexpr uint32_t IOP_ICACHE_INVALID = 0xFFFFFFFF;
 
 struct IOP_ICacheLine
 {
-    bool valid;
+    /* Physical address bits 31:12, IOP_ICACHE_INVALID when empty */
     uint32_t tag;
+    IOPDecodedInstr instrs[4];
 };
 
 class IOP
 {
+    friend class IOPJit;
 private:
     Bus* bus;
     IOP_Cop0 cop0;
@@ -25,33 +56,55 @@ private:
     IOP_ICacheLine icache[256];
 
     uint32_t new_PC;
-    uint32_t cache_control;
+    uint32_t cache_control = 0;
     int branch_delay;
-    bool can_disassemble;
     bool will_branch;
     bool wait_for_IRQ;
 
     int muldiv_delay;
     int cycles_to_run;
 
-    FILE* disasm_log;
+    std::unique_ptr<IOPTraceWriter> trace;
+
+    /* Decode cache */
+    const IOPDecodedInstr& fetch_decoded();
+    void icache_miss(uint32_t paddr);
+    void icache_invalidate_page(uint32_t page);
+    static bool ends_block(uint32_t value);
+    IOPBlock* lookup_block(uint32_t vaddr);
+    void invalidate_page(uint32_t page);
+    void invalidate_all();
+
+    std::unordered_map<uint32_t, std::unique_ptr<IOPBlock>> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> page_blocks;
+    IOPBlock* cur_block = nullptr;
+    uint32_t cur_index = 0, cur_pc = 0;
+    IOPDecodedInstr uncached = {};
+    /* Set by writes with the cache isolated, the decoded code is
+       dropped once the cache is reconnected */
+    bool code_flush_pending = false;
+
+    std::unique_ptr<IOPJit> jit;
+
+    void step();
 
-    uint32_t translate_addr(uint32_t addr);
 public:
     uint32_t gpr[32];
+    /* For statistics only */
+    uint64_t instructions_retired = 0;
     IOP(Bus* bus);
-    ~IOP()
-    {
-        fclose(disasm_log);
-    }
+    ~IOP();
     static const char* REG(int id);
 
     void reset();
     void run(int cycles);
+    void enable_jit();
     void halt();
     void unhalt();
     void print_state();
-    void set_disassembly(bool dis);
+    /* Binary trace of every executed instruction, optionally with the GPRs each one changed */
+    void start_trace(const char* path, bool registers);
+    void stop_trace();
     void set_muldiv_delay(int delay);
 
     void jp(uint32_t addr);
@@ -79,7 +132,6 @@ public:
     uint8_t read8(uint32_t addr);
     uint16_t read16(uint32_t addr);
     uint32_t read32(uint32_t addr);
-    uint32_t read_instr(uint32_t addr);
     void write8(uint32_t addr, uint8_t data);
     void write16(uint32_t addr, uint16_t data);
     void write32(uint32_t addr, uint32_t data);
@@ -0,0 +1,217 @@
+#include <iop/iop_dma.hpp>
+#include <iop/iop_intc.hpp>
+#include <Bus.hpp>
+#include <sif.hpp>
+#include <logger.hpp>
+#include <algorithm>
+
+constexpr uint32_t CHCR_START = 1 << 24;
+constexpr uint32_t CHCR_TRANSFER_TAG = 1 << 8;
+/* Set in the first word of an IOP SIF tag to end the chain */
+constexpr uint32_t SIF_TAG_END = 0xC0000000;
+
+IOPDMA::IOPDMA(Bus* bus, IOP_INTC* intc)
+: bus(bus), intc(intc)
+{}
+
+void IOPDMA::reset()
+{
+    for (auto& channel : channels)
+        channel = {};
+
+    dpcr = dicr = 0;
+    dpcr2 = dicr2 = 0;
+    dmacen = dmacinten = 0;
+}
+
+uint32_t* IOPDMA::register_ptr(uint32_t addr)
+{
+    switch (addr)
+    {
+    case 0x1F8010F0: return &dpcr;
+    case 0x1F8010F4: return &dicr;
+    case 0x1F801570: return &dpcr2;
+    case 0x1F801574: return &dicr2;
+    case 0x1F801578: return &dmacen;
+    case 0x1F80157C: return &dmacinten;
+    }
+
+    /* Channels 0-6 and 7-13 live in two separate banks */
+    uint32_t id = addr >= 0x1F801500 ? 7 + ((addr - 0x1F801500) >> 4) : (addr - 0x1F801080) >> 4;
+    return (uint32_t*)&channels[id] + ((addr >> 2) & 0x3);
+}
+
+uint32_t IOPDMA::read(uint32_t addr)
+{
+    return *register_ptr(addr);
+}
+
+void IOPDMA::write(uint32_t addr, uint32_t data)
+{
+    LOG(DMAC, Debug, "[IOP DMA] Writing 0x%X to 0x%X\n", data, addr);
+
+    /* Interrupt flags are cleared by writing ones */
+    if (addr == 0x1F8010F4 || addr == 0x1F801574)
+    {
+        uint32_t& dicr_reg = *register_ptr(addr);
+        dicr_reg = (data & 0x00FFFFFF) | (dicr_reg & ~data & 0x7F000000);
+        return;
+    }
+
+    *register_ptr(addr) = data;
+    if ((addr & 0xF) != 0x8 || !(data & CHCR_START))
+        return;
+
+    uint32_t id = addr >= 0x1F801500 ? 7 + ((addr - 0x1F801500) >> 4) : (addr - 0x1F801080) >> 4;
+    if (id == SIF0_CHANNEL || id == SIF1_CHANNEL)
+    {
+        LOG(DMAC, Info, "[IOP DMA] SIF%d transfer started\n", id - SIF0_CHANNEL);
+        channels[id].word_count = 0;
+        channels[id].end_transfer = false;
+    }
+    else
+    {
+        /* Nothing else is connected yet, complete right away so the IOP doesn't wait forever */
+        LOG(DMAC, Warn, "[IOP DMA] Transfer on unsupported channel %d\n", id);
+        finish_transfer(id);
+    }
+}
+
+void IOPDMA::register_mmio(Bus* bus)
+{
+    MMIOHandler handler =
+    {
+        .read16 = [this](uint32_t addr) -> uint16_t { return read(addr & ~0x3) >> ((addr & 0x2) * 8); },
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write16 = [this](uint32_t addr, uint16_t data)
+        {
+            uint32_t shift = (addr & 0x2) * 8;
+            uint32_t value = read(addr & ~0x3) & ~(0xFFFF << shift);
+            write(addr & ~0x3, value | (data << shift));
+        },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    };
+
+    bus->register_iop_mmio(0x1F801080, 0x1F8010F8, handler);
+    bus->register_iop_mmio(0x1F801500, 0x1F801580, handler);
+}
+
+void IOPDMA::tick()
+{
+    if (channels[SIF0_CHANNEL].control & CHCR_START)
+        process_sif0();
+
+    if (channels[SIF1_CHANNEL].control & CHCR_START)
+        process_sif1();
+}
+
+/* IOP RAM to the EE. Each tag is two words, the packet's IOP address
+   with the end bits and its size in words, followed by the EE DMA tag
+   when tag transfer is enabled */
+void IOPDMA::process_sif0()
+{
+    auto& channel = channels[SIF0_CHANNEL];
+    auto& fifo = bus->sif->sif0_fifo;
+
+    while (true)
+    {
+        if (channel.word_count)
+        {
+            uint32_t address = channel.address & 0x1FFFFC;
+            uint32_t count = std::min<uint32_t>(channel.word_count, (0x200000 - address) / 4);
+            count = std::min<uint32_t>(count, fifo.free_space());
+            if (!count)
+                return;
+
+            fifo.push_block((uint32_t*)&bus->iopRam[address], count);
+            channel.address += count * 4;
+            channel.word_count -= count;
+            continue;
+        }
+
+        if (channel.end_transfer)
+        {
+            finish_transfer(SIF0_CHANNEL);
+            return;
+        }
+
+        auto tag = (uint32_t*)&bus->iopRam[channel.tag_address & 0x1FFFF0];
+        if (channel.control & CHCR_TRANSFER_TAG)
+        {
+            if (!fifo.push_block(&tag[2], 2))
+                return;
+        }
+
+        LOG(DMAC, Debug, "[IOP DMA] SIF0 tag 0x%X 0x%X\n", tag[0], tag[1]);
+
+        channel.address = tag[0] & 0xFFFFFF;
+        channel.word_count = (tag[1] + 3) & ~0x3;
+        channel.end_transfer = tag[0] & SIF_TAG_END;
+        channel.tag_address += (channel.control & CHCR_TRANSFER_TAG) ? 16 : 8;
+    }
+}
+
+/* The EE to IOP RAM. Packets start with the EE DMA tag whose upper half
+   holds the IOP tag, laid out like the SIF0 one */
+void IOPDMA::process_sif1()
+{
+    auto& channel = channels[SIF1_CHANNEL];
+    auto& fifo = bus->sif->sif1_fifo;
+
+    while (true)
+    {
+        if (channel.word_count)
+        {
+            uint32_t address = channel.address & 0x1FFFFC;
+            uint32_t count = std::min<uint32_t>(channel.word_count, (0x200000 - address) / 4);
+            count = std::min<uint32_t>(count, fifo.size());
+            if (!count)
+                return;
+
+            /* Module loading goes through here, drop anything compiled from the old contents */
+            for (uint32_t page = address >> 12; page <= (address + count * 4 - 1) >> 12; page++)
+                bus->check_iop_code_write(page << 12);
+
+            fifo.pop_block((uint32_t*)&bus->iopRam[address], count);
+            channel.address += count * 4;
+            channel.word_count -= count;
+            continue;
+        }
+
+        if (channel.end_transfer)
+        {
+            finish_transfer(SIF1_CHANNEL);
+            return;
+        }
+
+        uint32_t tag[4];
+        if (!fifo.pop_block(tag, 4))
+            return;
+
+        LOG(DMAC, Debug, "[IOP DMA] SIF1 tag 0x%X 0x%X\n", tag[2], tag[3]);
+
+        channel.address = tag[2] & 0xFFFFFF;
+        channel.word_count = (tag[3] + 3) & ~0x3;
+        channel.end_transfer = tag[2] & SIF_TAG_END;
+    }
+}
+
+void IOPDMA::finish_transfer(uint32_t id)
+{
+    LOG(DMAC, Info, "[IOP DMA] End transfer of channel %d\n", id);
+
+    auto& channel = channels[id];
+    channel.control &= ~CHCR_START;
+    channel.end_transfer = false;
+
+    /* Flag the channel if its interrupt is enabled, the IOP gets IRQ 3
+       when the master enable in DICR is set as well */
+    uint32_t& dicr_reg = id >= 7 ? dicr2 : dicr;
+    uint32_t bit = id >= 7 ? id - 7 : id;
+    if (dicr_reg & (1 << (16 + bit)))
+    {
+        dicr_reg |= 1 << (24 + bit);
+        if (dicr & (1 << 23))
+            intc->assert_irq(3);
+    }
+}
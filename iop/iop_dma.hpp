@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+class Bus;
+class IOP_INTC;
+
+struct IOPDMAChannel
+{
+    uint32_t address;
+    uint32_t block_control;
+    uint32_t control;
+    uint32_t tag_address;
+
+    /* Words left in the current SIF packet */
+    uint32_t word_count = 0;
+    bool end_transfer = false;
+};
+
+/* The IOP side of the DMA controller. Every channel's registers are
+   kept, but only the SIF channels actually move data. They copy whole
+   packets between IOP RAM and the SIF FIFOs, the EE DMAC does the rest */
+class IOPDMA
+{
+public:
+    static constexpr uint32_t SIF0_CHANNEL = 9;
+    static constexpr uint32_t SIF1_CHANNEL = 10;
+
+    IOPDMA(Bus* bus, IOP_INTC* intc);
+
+    void reset();
+    void register_mmio(Bus* bus);
+
+    /* Services the SIF channels, runs on the IOP's side of the scheduler */
+    void tick();
+
+private:
+    uint32_t read(uint32_t addr);
+    void write(uint32_t addr, uint32_t data);
+    uint32_t* register_ptr(uint32_t addr);
+
+    void process_sif0();
+    void process_sif1();
+    void finish_transfer(uint32_t id);
+
+private:
+    Bus* bus;
+    IOP_INTC* intc;
+
+    IOPDMAChannel channels[14] = {};
+    uint32_t dpcr = 0, dicr = 0;
+    uint32_t dpcr2 = 0, dicr2 = 0;
+    uint32_t dmacen = 0, dmacinten = 0;
+};
@@ -105,6 +105,90 @@ void IOP_Interpreter::interpret(IOP &cpu, uint32_t instruction)
     }
 }
 
+IOPHandler IOP_Interpreter::decode(uint32_t instruction)
+{
+    if (!instruction)
+        return nullptr;
+    switch (instruction >> 26)
+    {
+        case 0x00:
+            switch (instruction & 0x3F)
+            {
+                case 0x00: return sll;
+                case 0x02: return srl;
+                case 0x03: return sra;
+                case 0x04: return sllv;
+                case 0x06: return srlv;
+                case 0x07: return srav;
+                case 0x08: return jr;
+                case 0x09: return jalr;
+                case 0x0C: return syscall;
+                case 0x10: return mfhi;
+                case 0x11: return mthi;
+                case 0x12: return mflo;
+                case 0x13: return mtlo;
+                case 0x18: return mult;
+                case 0x19: return multu;
+                case 0x1A: return div;
+                case 0x1B: return divu;
+                case 0x20: return add;
+                case 0x21: return addu;
+                case 0x22: return sub;
+                case 0x23: return subu;
+                case 0x24: return and_cpu;
+                case 0x25: return or_cpu;
+                case 0x26: return xor_cpu;
+                case 0x27: return nor;
+                case 0x2A: return slt;
+                case 0x2B: return sltu;
+            }
+            return special;
+        case 0x01:
+            switch ((instruction >> 16) & 0x1F)
+            {
+                case 0x00: return bltz;
+                case 0x01: return bgez;
+                case 0x10: return bltzal;
+                case 0x11: return bgezal;
+            }
+            return regimm;
+        case 0x02: return j;
+        case 0x03: return jal;
+        case 0x04: return beq;
+        case 0x05: return bne;
+        case 0x06: return blez;
+        case 0x07: return bgtz;
+        case 0x08: return addi;
+        case 0x09: return addiu;
+        case 0x0A: return slti;
+        case 0x0B: return sltiu;
+        case 0x0C: return andi;
+        case 0x0D: return ori;
+        case 0x0E: return xori;
+        case 0x0F: return lui;
+        case 0x10:
+        case 0x11:
+        case 0x12:
+        case 0x13:
+            return cop;
+        case 0x20: return lb;
+        case 0x21: return lh;
+        case 0x22: return lwl;
+        case 0x23: return lw;
+        case 0x24: return lbu;
+        case 0x25: return lhu;
+        case 0x26: return lwr;
+        case 0x28: return sb;
+        case 0x29: return sh;
+        case 0x2A: return swl;
+        case 0x2B: return sw;
+        case 0x2E: return swr;
+    }
+
+    /* Let the full interpreter report it when it executes */
+    return interpret;
+}
+
 void IOP_Interpreter::j(IOP &cpu, uint32_t instruction)
 {
     uint32_t addr = (instruction & 0x3FFFFFF) << 2;
@@ -6,6 +6,8 @@
 namespace IOP_Interpreter
 {
     void interpret(IOP& cpu, uint32_t instruction);
+    /* Resolves the final handler through the opcode tables, null for NOP */
+    IOPHandler decode(uint32_t instruction);
 
     void j(IOP& cpu, uint32_t instruction);
     void jal(IOP& cpu, uint32_t instruction);
@@ -0,0 +1,34 @@
+#include <iop/iop_trace.hpp>
+#include <cstdlib>
+
+IOPTraceWriter::IOPTraceWriter(const char* path, bool registers, const uint32_t* gpr)
+: registers(registers), buffer(std::make_unique<uint8_t[]>(BUFFER_SIZE))
+{
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        printf("[IOP]: Unable to open trace file %s\n", path);
+        exit(1);
+    }
+
+    IOPTraceHeader header = {};
+    std::memcpy(header.magic, IOP_TRACE_MAGIC, sizeof(header.magic));
+    header.version = IOP_TRACE_VERSION;
+    header.flags = registers ? IOP_TRACE_REGISTERS : 0;
+    std::memcpy(header.gpr, gpr, sizeof(header.gpr));
+    std::memcpy(shadow, gpr, sizeof(shadow));
+
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+IOPTraceWriter::~IOPTraceWriter()
+{
+    flush();
+    fclose(file);
+}
+
+void IOPTraceWriter::flush()
+{
+    fwrite(buffer.get(), 1, pos, file);
+    pos = 0;
+}
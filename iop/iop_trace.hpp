@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+/* Binary IOP instruction trace, disassembled offline by tools/iop_trace_dump.
+
+   File layout:
+     IOPTraceHeader
+     records, each one being
+       uint32_t pc, uint32_t opcode
+       and when IOP_TRACE_REGISTERS is set
+       uint8_t count, count * { uint8_t reg, uint32_t value }
+   All values are little endian and records are packed */
+constexpr char IOP_TRACE_MAGIC[8] = { 'I', 'O', 'P', 'T', 'R', 'A', 'C', 'E' };
+constexpr uint32_t IOP_TRACE_VERSION = 1;
+constexpr uint32_t IOP_TRACE_REGISTERS = 1 << 0;
+
+struct IOPTraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    /* GPRs when tracing started, register deltas apply on top of these */
+    uint32_t gpr[32];
+};
+
+class IOPTraceWriter
+{
+public:
+    IOPTraceWriter(const char* path, bool registers, const uint32_t* gpr);
+    ~IOPTraceWriter();
+
+    bool has_registers() const { return registers; }
+
+    void record(uint32_t pc, uint32_t opcode)
+    {
+        if (BUFFER_SIZE - pos < MAX_RECORD_SIZE)
+            flush();
+
+        std::memcpy(&buffer[pos], &pc, 4);
+        std::memcpy(&buffer[pos + 4], &opcode, 4);
+        pos += 8;
+    }
+
+    /* Appends every GPR that changed since the last call */
+    void record_registers(const uint32_t* gpr)
+    {
+        size_t count_pos = pos++;
+        uint8_t count = 0;
+        for (uint8_t i = 1; i < 32; i++)
+        {
+            if (gpr[i] != shadow[i])
+            {
+                shadow[i] = gpr[i];
+                buffer[pos] = i;
+                std::memcpy(&buffer[pos + 1], &gpr[i], 4);
+                pos += 5;
+                count++;
+            }
+        }
+
+        buffer[count_pos] = count;
+    }
+
+    void flush();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t MAX_RECORD_SIZE = 8 + 1 + 31 * 5;
+
+    FILE* file;
+    bool registers;
+    uint32_t shadow[32];
+
+    std::unique_ptr<uint8_t[]> buffer;
+    size_t pos = 0;
+};
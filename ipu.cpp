@@ -56,4 +56,21 @@ void IPU::decode_command(IPUCommand cmd)
     }
 }
 
-uint64_t IPU::get_command_result() {return 0;}
\ No newline at end of file
+uint64_t IPU::get_command_result() {return 0;}
+
+void IPU::register_mmio(Bus* bus)
+{
+    bus->register_mmio(0x10002000, 0x10002040,
+    {
+        .read32 = [this](uint32_t addr) -> uint32_t { return read(addr); },
+        .read64 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); },
+        .write64 = [this](uint32_t addr, uint64_t data) { write(addr, data); }
+    });
+
+    /* Input FIFO */
+    bus->register_mmio(0x10007010, 0x10007020,
+    {
+        .write128 = [this](uint32_t addr, uint128_t data) { write_fifo(addr, data); }
+    });
+}
\ No newline at end of file
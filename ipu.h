@@ -56,6 +56,8 @@ public:
     uint128_t read_fifo(uint32_t addr);
     void write_fifo(uint32_t addr, uint128_t data);
 
+    void register_mmio(Bus* bus);
+
     void decode_command(IPUCommand cmd);
     uint64_t get_command_result();
 
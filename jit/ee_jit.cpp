@@ -0,0 +1,610 @@
+#include <jit/ee_jit.hpp>
+#include <EE.hpp>
+#include <Bus.hpp>
+
+using namespace jit;
+
+/* Code cache size, everything is thrown away once it runs low */
+static constexpr size_t CODE_SIZE = 64 * 1024 * 1024;
+static constexpr size_t CODE_MARGIN = 256 * 1024;
+
+/* Blocks only check the cycle budget on exit, keep them short
+   enough that the overshoot stays small next to a time slice */
+static constexpr size_t MAX_BLOCK_INSTRS = 64;
+
+static inline int32_t offset_of(const void* base, const void* field)
+{
+    return (int32_t)((const uint8_t*)field - (const uint8_t*)base);
+}
+
+EEJit::EEJit(EmotionEngine* _cpu, Bus* _bus)
+: cpu(_cpu),
+bus(_bus),
+emitter(CODE_SIZE)
+{
+    regs_offset = offset_of(cpu, &cpu->regs[0]);
+    hi_offset = offset_of(cpu, &cpu->hi0);
+    lo_offset = offset_of(cpu, &cpu->lo0);
+    count_offset = offset_of(cpu, &cpu->cop0.count);
+
+    emit_prologue();
+}
+
+/* Generated code runs with RBX pointing to the EmotionEngine and
+   RBP pointing to the EEJit. Three pushes keep the stack 16 byte
+   aligned for the calls made into the interpreter */
+void EEJit::emit_prologue()
+{
+    enter = (decltype(enter))emitter.get_ptr();
+    emitter.push(RBX);
+    emitter.push(RBP);
+    emitter.push(R12);
+    emitter.mov64_rr(RBX, RDI);
+    emitter.mov64_rr(RBP, RSI);
+    emitter.jmp(RDX);
+
+    exit_code = emitter.get_ptr();
+    emitter.pop(R12);
+    emitter.pop(RBP);
+    emitter.pop(RBX);
+    emitter.ret();
+
+    code_start = emitter.get_ptr();
+}
+
+int32_t EEJit::gpr(int reg, int word)
+{
+    return regs_offset + reg * sizeof(Register) + word * 4;
+}
+
+int EEJit::run(int cycles)
+{
+    cycles_left = cycles;
+
+    auto canonical = [this]()
+    {
+        return !cpu->next_instr.is_delay_slot && cpu->pc == cpu->next_instr.pc + 4;
+    };
+
+    /* The interpreter may have left us in the middle of a branch
+       delay slot, step it until the state lines up with a block start */
+    while (cycles_left > 0 && !canonical())
+    {
+        cpu->step();
+        cycles_left--;
+    }
+
+    next_pc = cpu->next_instr.pc;
+
+    while (cycles_left > 0)
+    {
+        if (emitter.space_left() < CODE_MARGIN)
+            flush();
+
+        Block* block = lookup(next_pc);
+        if (!block || !block->code)
+        {
+            /* Uncached memory or an instruction the JIT doesn't handle */
+            cpu->pc = next_pc;
+            cpu->fetch_next();
+            do
+            {
+                cpu->step();
+                cycles_left--;
+            } while (!canonical());
+
+            next_pc = cpu->next_instr.pc;
+            continue;
+        }
+
+        link_site = nullptr;
+        enter(cpu, this, block->code);
+
+        if (link_site)
+        {
+            Block* target = lookup(next_pc);
+            if (target && target->code)
+                link(link_site, target);
+        }
+    }
+
+    /* Hand a consistent prefetch state back to the interpreter */
+    cpu->pc = next_pc;
+    cpu->fetch_next();
+
+    return cycles - cycles_left;
+}
+
+EEJit::Block* EEJit::lookup(uint32_t pc)
+{
+    auto it = blocks.find(pc);
+    if (it != blocks.end())
+        return it->second.get();
+
+    return compile(pc);
+}
+
+void EEJit::link(uint8_t* site, Block* target)
+{
+    int32_t rel;
+    std::memcpy(&rel, site, 4);
+    uint8_t* stub = site + 4 + rel;
+
+    X64Emitter::patch(site, target->code);
+    target->incoming.push_back({site, stub});
+}
+
+void EEJit::invalidate_page(uint32_t page)
+{
+    auto it = page_blocks.find(page);
+    if (it == page_blocks.end())
+        return;
+
+    for (auto pc : it->second)
+    {
+        auto block = blocks.find(pc);
+        if (block == blocks.end())
+            continue;
+
+        /* Point everything linked to the block back at its exit stub.
+           The code itself stays around until the next flush since it
+           might be the block that performed the write */
+        for (auto& [site, stub] : block->second->incoming)
+            X64Emitter::patch(site, stub);
+
+        blocks.erase(block);
+    }
+
+    page_blocks.erase(it);
+    invalidations++;
+}
+
+void EEJit::flush()
+{
+    blocks.clear();
+    page_blocks.clear();
+    emitter.set_ptr(code_start);
+    link_site = nullptr;
+}
+
+static bool is_jit_branch(const EEDecodedInstr& code)
+{
+    switch (code.value >> 26)
+    {
+    case 0x00:
+        return (code.value & 0x3F) == 0x08 || (code.value & 0x3F) == 0x09;
+    case 0x01:
+        return code.rt == 0x00 || code.rt == 0x01;
+    case 0x02 ... 0x07:
+    case 0x14:
+    case 0x15:
+        return true;
+    }
+
+    return false;
+}
+
+EEJit::Block* EEJit::compile(uint32_t pc)
+{
+    uint32_t paddr = bus->TranslateAddr(pc);
+
+    /* Same cacheable regions as the interpreter's decode cache */
+    bool ram = paddr < 0x2000000;
+    bool bios = paddr >= 0x1FC00000 && paddr < 0x20000000;
+    if ((!ram && !bios) || (pc & 0x3))
+        return nullptr;
+
+    auto block = std::make_unique<Block>();
+    block->pc = pc;
+    block->code = nullptr;
+
+    /* The delay slot is allowed to spill into the next page */
+    bool delay_slot = false;
+    for (uint32_t addr = paddr;; addr += 4)
+    {
+        uint32_t value = bus->Read32(addr, true);
+        block->instrs.push_back(cpu->decode_full(value));
+
+        if (delay_slot)
+            break;
+
+        delay_slot = EmotionEngine::ends_block(value);
+        if (delay_slot)
+            continue;
+        if (((addr + 4) >> 12) != (paddr >> 12) || block->instrs.size() >= MAX_BLOCK_INSTRS)
+            break;
+    }
+
+    /* Stop in front of anything that changes control flow in a
+       way the JIT doesn't model, the interpreter will take it */
+    size_t count = block->instrs.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        auto& code = block->instrs[i];
+        if (EmotionEngine::ends_block(code.value) && !is_jit_branch(code))
+        {
+            count = i;
+            break;
+        }
+    }
+
+    uint32_t first_page = paddr >> 12;
+    uint32_t last_page = (paddr + (block->instrs.size() - 1) * 4) >> 12;
+    block->pages.push_back(first_page);
+    if (last_page != first_page)
+        block->pages.push_back(last_page);
+
+    for (auto page : block->pages)
+    {
+        bus->mark_code_page(page);
+        page_blocks[page].push_back(pc);
+    }
+
+    if (count != 0)
+    {
+        block->code = emitter.get_ptr();
+
+        uint32_t executed = 0;
+        for (size_t i = 0; i < count; i++)
+            executed += block->instrs[i].value != 0;
+
+        emitter.alu32_mi(SUB, RBP, offset_of(this, &cycles_left), count);
+        if (executed)
+            emitter.alu32_mi(ADD, RBX, count_offset, executed);
+
+        bool ended = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto& code = block->instrs[i];
+            if (EmotionEngine::ends_block(code.value))
+            {
+                emit_branch(block.get(), i);
+                ended = true;
+                break;
+            }
+
+            if (code.value && !emit_native(code))
+                emit_fallback(&code, pc + i * 4, false);
+        }
+
+        if (!ended)
+            emit_exit(pc + count * 4);
+    }
+
+    auto ptr = block.get();
+    blocks[pc] = std::move(block);
+    return ptr;
+}
+
+void EEJit::emit_branch(Block* block, size_t index)
+{
+    auto& code = block->instrs[index];
+    auto& delay = block->instrs[index + 1];
+    uint32_t pc = block->pc + index * 4;
+    uint32_t target = pc + 4 + (code.imm << 2);
+
+    auto emit_delay = [&]()
+    {
+        if (delay.value && !emit_native(delay))
+            emit_fallback(&delay, pc + 4, true);
+    };
+
+    uint8_t opcode = code.value >> 26;
+    switch (opcode)
+    {
+    case 0x00:
+    {
+        /* JR/JALR, the target is read before the delay slot runs */
+        emitter.mov32_rm(RAX, RBX, gpr(code.rs));
+        emitter.mov32_mr(RBP, offset_of(this, &branch_target), RAX);
+        if ((code.value & 0x3F) == 0x09 && code.rd)
+        {
+            emitter.mov32_ri(RAX, pc + 8);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+        }
+
+        emit_delay();
+
+        emitter.mov32_rm(RAX, RBP, offset_of(this, &branch_target));
+        emitter.mov32_mr(RBP, offset_of(this, &next_pc), RAX);
+        emit_exit_dynamic();
+        return;
+    }
+    case 0x02:
+    case 0x03:
+    {
+        uint32_t dest = ((pc + 4) & 0xF0000000) | ((code.value & 0x3FFFFFF) << 2);
+        if (opcode == 0x03)
+        {
+            emitter.mov32_ri(RAX, pc + 8);
+            emitter.mov64_mr(RBX, gpr(31), RAX);
+        }
+
+        emit_delay();
+        emit_exit(dest);
+        return;
+    }
+    }
+
+    /* Conditional branches, all comparisons are on the full 64 bits */
+    Cond cc;
+    emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+    switch (opcode)
+    {
+    case 0x01:
+        emitter.alu64_ri(CMP, RAX, 0);
+        cc = code.rt == 0x00 ? CC_L : CC_GE;
+        break;
+    case 0x04:
+    case 0x05:
+    case 0x14:
+    case 0x15:
+        emitter.mov64_rm(RCX, RBX, gpr(code.rt));
+        emitter.alu64_rr(CMP, RAX, RCX);
+        cc = (opcode == 0x04 || opcode == 0x14) ? CC_E : CC_NE;
+        break;
+    case 0x06:
+        emitter.alu64_ri(CMP, RAX, 0);
+        cc = CC_LE;
+        break;
+    default:
+        emitter.alu64_ri(CMP, RAX, 0);
+        cc = CC_G;
+        break;
+    }
+
+    Cond not_taken = (Cond)(cc ^ 1);
+
+    if (opcode == 0x14 || opcode == 0x15)
+    {
+        /* Branch likely nullifies the delay slot when not taken */
+        uint8_t* skip = emitter.jcc(not_taken);
+        emit_delay();
+        emit_exit(target);
+
+        /* The nullified slot takes no cycle, like in the interpreter */
+        X64Emitter::patch(skip, emitter.get_ptr());
+        emitter.alu32_mi(ADD, RBP, offset_of(this, &cycles_left), 1);
+        if (delay.value)
+            emitter.alu32_mi(SUB, RBX, count_offset, 1);
+        emit_exit(pc + 8);
+        return;
+    }
+
+    uint8_t* skip;
+    if (!delay.value)
+    {
+        skip = emitter.jcc(not_taken);
+    }
+    else
+    {
+        /* The delay slot may overwrite the operands, keep the outcome */
+        emitter.setcc(cc, RAX);
+        emitter.movzx8(RAX, RAX);
+        emitter.mov32_mr(RBP, offset_of(this, &branch_cond), RAX);
+
+        emit_delay();
+
+        emitter.mov32_rm(RAX, RBP, offset_of(this, &branch_cond));
+        emitter.test32(RAX, RAX);
+        skip = emitter.jcc(CC_E);
+    }
+
+    emit_exit(target);
+    X64Emitter::patch(skip, emitter.get_ptr());
+    emit_exit(pc + 8);
+}
+
+/* Leaves the block for a known address. The jump is initially aimed at
+   a stub that reports the address back to the dispatcher along with
+   the location of the jump, which then gets patched to the target */
+void EEJit::emit_exit(uint32_t target)
+{
+    emitter.alu32_mi(CMP, RBP, offset_of(this, &cycles_left), 0);
+    uint8_t* out_of_cycles = emitter.jcc(CC_LE);
+    uint8_t* site = emitter.jmp();
+
+    X64Emitter::patch(site, emitter.get_ptr());
+    emitter.mov64_ri(RAX, (uint64_t)site);
+    uint8_t* done = emitter.jmp();
+
+    /* Running out of cycles says nothing about whether the jump is
+       linked already, so it never asks for it to be linked */
+    X64Emitter::patch(out_of_cycles, emitter.get_ptr());
+    emitter.alu32_rr(XOR, RAX, RAX);
+
+    X64Emitter::patch(done, emitter.get_ptr());
+    emitter.mov64_mr(RBP, offset_of(this, &link_site), RAX);
+    emitter.mov32_mi(RBP, offset_of(this, &next_pc), target);
+    emitter.jmp(exit_code);
+}
+
+void EEJit::emit_exit_dynamic()
+{
+    emitter.alu32_rr(XOR, RAX, RAX);
+    emitter.mov64_mr(RBP, offset_of(this, &link_site), RAX);
+    emitter.jmp(exit_code);
+}
+
+void EEJit::emit_fallback(const EEDecodedInstr* code, uint32_t pc, bool delay_slot)
+{
+    emitter.mov64_rr(RDI, RBP);
+    emitter.mov64_ri(RSI, (uint64_t)code);
+    emitter.mov32_ri(RDX, pc);
+    emitter.mov32_ri(RCX, delay_slot);
+    emitter.call((const void*)&EEJit::fallback);
+    emitter.test32(RAX, RAX);
+    emitter.jcc(CC_NE, exit_code);
+}
+
+/* Runs a single instruction through the interpreter. Returns non-zero
+   when the block has to be left right away, either because an exception
+   was raised or because the instruction overwrote translated code */
+int EEJit::fallback(EEJit* jit, const EEDecodedInstr* code, uint32_t pc, uint32_t delay_slot)
+{
+    EmotionEngine* cpu = jit->cpu;
+    uint64_t invalidations = jit->invalidations;
+
+    cpu->instr = {};
+    cpu->instr.value = code->value;
+    cpu->instr.pc = pc;
+    cpu->instr.is_delay_slot = delay_slot;
+    cpu->decoded = *code;
+
+    /* exception() refetches, which replaces this impossible PC */
+    cpu->next_instr.pc = 1;
+
+    (cpu->*code->handler)();
+    cpu->regs[0].ud[0] = 0;
+
+    if (cpu->next_instr.pc != 1)
+    {
+        jit->next_pc = cpu->next_instr.pc;
+        jit->link_site = nullptr;
+        return 1;
+    }
+
+    if (jit->invalidations != invalidations && !delay_slot)
+    {
+        jit->next_pc = pc + 4;
+        jit->link_site = nullptr;
+        return 1;
+    }
+
+    return 0;
+}
+
+bool EEJit::emit_native(const EEDecodedInstr& code)
+{
+    uint8_t opcode = code.value >> 26;
+
+    if (opcode == 0x00)
+    {
+        uint8_t funct = code.value & 0x3F;
+        switch (funct)
+        {
+        case 0x00: case 0x02: case 0x03: /* SLL, SRL, SRA */
+            if (!code.rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(code.rt));
+            if (funct == 0x00)
+                emitter.shl32(RAX, code.sa);
+            else if (funct == 0x02)
+                emitter.shr32(RAX, code.sa);
+            else
+                emitter.sar32(RAX, code.sa);
+            emitter.movsxd(RAX, RAX);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x0A: case 0x0B: /* MOVZ, MOVN */
+            if (!code.rd)
+                return true;
+            emitter.mov64_rm(RAX, RBX, gpr(code.rd));
+            emitter.mov64_rm(RCX, RBX, gpr(code.rs));
+            emitter.mov64_rm(RDX, RBX, gpr(code.rt));
+            emitter.test64(RDX, RDX);
+            emitter.cmov64(funct == 0x0A ? CC_E : CC_NE, RAX, RCX);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x0F: /* SYNC */
+            return true;
+        case 0x10: case 0x12: /* MFHI, MFLO */
+            if (!code.rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, funct == 0x10 ? hi_offset : lo_offset);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x21: case 0x23: /* ADDU, SUBU */
+            if (!code.rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(code.rs));
+            emitter.mov32_rm(RCX, RBX, gpr(code.rt));
+            emitter.alu32_rr(funct == 0x21 ? ADD : SUB, RAX, RCX);
+            emitter.movsxd(RAX, RAX);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x24: case 0x25: case 0x27: case 0x2D: /* AND, OR, NOR, DADDU */
+            if (!code.rd)
+                return true;
+            emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+            emitter.mov64_rm(RCX, RBX, gpr(code.rt));
+            emitter.alu64_rr(funct == 0x24 ? AND : funct == 0x2D ? ADD : OR, RAX, RCX);
+            if (funct == 0x27)
+                emitter.not64(RAX);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x2A: case 0x2B: /* SLT, SLTU */
+            if (!code.rd)
+                return true;
+            emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+            emitter.mov64_rm(RCX, RBX, gpr(code.rt));
+            emitter.alu64_rr(CMP, RAX, RCX);
+            emitter.setcc(funct == 0x2A ? CC_L : CC_B, RAX);
+            emitter.movzx8(RAX, RAX);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        case 0x3A: case 0x3C: case 0x3E: case 0x3F: /* DSRL, DSLL32, DSRL32, DSRA32 */
+            if (!code.rd)
+                return true;
+            emitter.mov64_rm(RAX, RBX, gpr(code.rt));
+            if (funct == 0x3A)
+                emitter.shr64(RAX, code.sa);
+            else if (funct == 0x3C)
+                emitter.shl64(RAX, code.sa + 32);
+            else if (funct == 0x3E)
+                emitter.shr64(RAX, code.sa + 32);
+            else
+                emitter.sar64(RAX, code.sa + 32);
+            emitter.mov64_mr(RBX, gpr(code.rd), RAX);
+            return true;
+        }
+
+        return false;
+    }
+
+    switch (opcode)
+    {
+    case 0x09: /* ADDIU */
+        if (!code.rt)
+            return true;
+        emitter.mov32_rm(RAX, RBX, gpr(code.rs));
+        emitter.alu32_ri(ADD, RAX, code.imm);
+        emitter.movsxd(RAX, RAX);
+        emitter.mov64_mr(RBX, gpr(code.rt), RAX);
+        return true;
+    case 0x0A: case 0x0B: /* SLTI, SLTIU */
+        if (!code.rt)
+            return true;
+        emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+        emitter.alu64_ri(CMP, RAX, code.imm);
+        emitter.setcc(opcode == 0x0A ? CC_L : CC_B, RAX);
+        emitter.movzx8(RAX, RAX);
+        emitter.mov64_mr(RBX, gpr(code.rt), RAX);
+        return true;
+    case 0x0C: case 0x0D: case 0x0E: /* ANDI, ORI, XORI */
+        if (!code.rt)
+            return true;
+        emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+        emitter.alu64_ri(opcode == 0x0C ? AND : opcode == 0x0D ? OR : XOR, RAX, code.imm & 0xFFFF);
+        emitter.mov64_mr(RBX, gpr(code.rt), RAX);
+        return true;
+    case 0x0F: /* LUI */
+        if (!code.rt)
+            return true;
+        emitter.mov32_ri(RAX, (uint32_t)code.imm << 16);
+        emitter.movsxd(RAX, RAX);
+        emitter.mov64_mr(RBX, gpr(code.rt), RAX);
+        return true;
+    case 0x19: /* DADDIU */
+        if (!code.rt)
+            return true;
+        emitter.mov64_rm(RAX, RBX, gpr(code.rs));
+        emitter.alu64_ri(ADD, RAX, code.imm);
+        emitter.mov64_mr(RBX, gpr(code.rt), RAX);
+        return true;
+    case 0x2F: /* CACHE */
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <jit/x64_emitter.hpp>
+
+class Bus;
+class EmotionEngine;
+struct EEDecodedInstr;
+
+/* Block recompiler for the EE. Straight-line code up to and including the
+   delay slot of the first branch is translated to x86-64; simple ALU ops
+   and branches are emitted inline, everything else calls back into the
+   interpreter handler for that instruction. Blocks are keyed by their
+   virtual start address since the generated code embeds virtual PCs */
+class EEJit
+{
+public:
+    EEJit(EmotionEngine* cpu, Bus* bus);
+
+    /* Returns the number of cycles actually executed, blocks may overshoot */
+    int run(int cycles);
+    void invalidate_page(uint32_t page);
+
+private:
+    struct Block
+    {
+        uint32_t pc;
+        uint8_t* code;
+        std::vector<EEDecodedInstr> instrs;
+        std::vector<uint32_t> pages;
+        /* Jumps patched to branch straight here, paired with
+           the exit stub each one falls back to when unlinked */
+        std::vector<std::pair<uint8_t*, uint8_t*>> incoming;
+    };
+
+    Block* lookup(uint32_t pc);
+    Block* compile(uint32_t pc);
+    void link(uint8_t* site, Block* target);
+    void flush();
+
+    void emit_prologue();
+    bool emit_native(const EEDecodedInstr& code);
+    void emit_fallback(const EEDecodedInstr* code, uint32_t pc, bool delay_slot);
+    void emit_branch(Block* block, size_t index);
+    void emit_exit(uint32_t target);
+    void emit_exit_dynamic();
+
+    static int fallback(EEJit* jit, const EEDecodedInstr* code, uint32_t pc, uint32_t delay_slot);
+
+    int32_t gpr(int reg, int word = 0);
+
+private:
+    EmotionEngine* cpu;
+    Bus* bus;
+    jit::X64Emitter emitter;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> page_blocks;
+
+    void (*enter)(EmotionEngine* cpu, EEJit* jit, uint8_t* code);
+    uint8_t* exit_code;
+    uint8_t* code_start;
+
+    /* Offsets of the EmotionEngine fields the generated code touches */
+    int32_t regs_offset, hi_offset, lo_offset, count_offset;
+
+    /* Accessed from generated code through RBP */
+    int32_t cycles_left = 0;
+    uint32_t next_pc = 0;
+    uint8_t* link_site = nullptr;
+    uint32_t branch_cond = 0;
+    uint32_t branch_target = 0;
+    uint64_t invalidations = 0;
+};
@@ -0,0 +1,664 @@
+#include <algorithm>
+#include <jit/iop_jit.hpp>
+#include <iop/iop.hpp>
+#include <iop/iop_interpreter.hpp>
+#include <Bus.hpp>
+
+using namespace jit;
+
+/* Code cache size, everything is thrown away once it runs low */
+static constexpr size_t CODE_SIZE = 16 * 1024 * 1024;
+static constexpr size_t CODE_MARGIN = 64 * 1024;
+
+/* Blocks only check the cycle budget on exit, the IOP runs
+   in small slices so keep the overshoot well below one */
+static constexpr size_t MAX_BLOCK_INSTRS = 32;
+
+/* Both the uncached fetch penalty and the multiplier delay are counted
+   in instructions, the fallback takes how many to apply before and
+   after the instruction it runs packed in one argument */
+static constexpr uint32_t MULDIV_AFTER_SHIFT = 16;
+
+static inline int32_t offset_of(const void* base, const void* field)
+{
+    return (int32_t)((const uint8_t*)field - (const uint8_t*)base);
+}
+
+IOPJit::IOPJit(IOP* _cpu, Bus* _bus)
+: cpu(_cpu),
+bus(_bus),
+emitter(CODE_SIZE)
+{
+    gpr_offset = offset_of(cpu, &cpu->gpr[0]);
+    cycles_offset = offset_of(cpu, &cpu->cycles_to_run);
+    retired_offset = offset_of(cpu, &cpu->instructions_retired);
+    muldiv_offset = offset_of(cpu, &cpu->muldiv_delay);
+    cache_control_offset = offset_of(cpu, &cpu->cache_control);
+    icache_offset = offset_of(cpu, &cpu->icache[0].tag);
+
+    emit_prologue();
+}
+
+/* Generated code runs with RBX pointing to the IOP and RBP pointing to
+   the IOPJit, same register assignment as the EE recompiler */
+void IOPJit::emit_prologue()
+{
+    enter = (decltype(enter))emitter.get_ptr();
+    emitter.push(RBX);
+    emitter.push(RBP);
+    emitter.push(R12);
+    emitter.mov64_rr(RBX, RDI);
+    emitter.mov64_rr(RBP, RSI);
+    emitter.jmp(RDX);
+
+    exit_code = emitter.get_ptr();
+    emitter.pop(R12);
+    emitter.pop(RBP);
+    emitter.pop(RBX);
+    emitter.ret();
+
+    code_start = emitter.get_ptr();
+}
+
+int32_t IOPJit::gpr(int reg)
+{
+    return gpr_offset + reg * 4;
+}
+
+void IOPJit::run()
+{
+    /* Let the interpreter finish a branch it was in the middle of */
+    while (cpu->cycles_to_run > 0 && cpu->will_branch)
+        cpu->step();
+
+    next_pc = cpu->PC;
+
+    while (cpu->cycles_to_run > 0)
+    {
+        if (emitter.space_left() < CODE_MARGIN)
+            flush();
+
+        Block* block = lookup(next_pc);
+        if (!block || !block->code)
+        {
+            /* Uncached memory or an instruction the JIT doesn't handle */
+            cpu->PC = next_pc;
+            do
+            {
+                cpu->step();
+            } while (cpu->will_branch);
+
+            next_pc = cpu->PC;
+            continue;
+        }
+
+        uint64_t invalidations_before = invalidations;
+        link_site = nullptr;
+        enter(cpu, this, block->code);
+
+        if (next_pc & 0x3)
+        {
+            printf("[IOP] Invalid PC address $%08X!\n", next_pc);
+            exit(1);
+        }
+
+        /* The exit stub may belong to a block that was just thrown away */
+        if (link_site && invalidations == invalidations_before)
+        {
+            Block* target = lookup(next_pc);
+            if (target && target->code)
+                link(link_site, target);
+        }
+    }
+
+    cpu->PC = next_pc;
+}
+
+IOPJit::Block* IOPJit::lookup(uint32_t pc)
+{
+    auto it = blocks.find(pc);
+    if (it != blocks.end())
+        return it->second.get();
+
+    return compile(pc);
+}
+
+void IOPJit::link(uint8_t* site, Block* target)
+{
+    int32_t rel;
+    std::memcpy(&rel, site, 4);
+    uint8_t* stub = site + 4 + rel;
+
+    X64Emitter::patch(site, target->code);
+    target->incoming.push_back({site, stub});
+}
+
+void IOPJit::invalidate_page(uint32_t page)
+{
+    auto it = page_blocks.find(page);
+    if (it == page_blocks.end())
+        return;
+
+    for (auto pc : it->second)
+    {
+        auto block = blocks.find(pc);
+        if (block == blocks.end())
+            continue;
+
+        for (auto& [site, stub] : block->second->incoming)
+            X64Emitter::patch(site, stub);
+
+        blocks.erase(block);
+    }
+
+    page_blocks.erase(it);
+    invalidations++;
+}
+
+/* The code buffer is only reused once control is back in run(),
+   so this is safe to call from a fallback */
+void IOPJit::flush()
+{
+    blocks.clear();
+    page_blocks.clear();
+    emitter.set_ptr(code_start);
+    link_site = nullptr;
+    invalidations++;
+}
+
+bool IOPJit::is_jit_branch(const IOPDecodedInstr* code, uint32_t pc)
+{
+    uint32_t value = code[0].value;
+    switch (value >> 26)
+    {
+    case 0x00:
+        return (value & 0x3F) == 0x08 || (value & 0x3F) == 0x09;
+    case 0x01:
+        switch ((value >> 16) & 0x1F)
+        {
+        case 0x00: case 0x01: case 0x10: case 0x11:
+            return true;
+        }
+        return false;
+    case 0x02:
+    {
+        /* Module calls get logged and jumps to self halt the IOP,
+           both of which only the interpreter does */
+        uint32_t dest = ((pc + 4) & 0xF0000000) | ((value & 0x3FFFFFF) << 2);
+        return (code[1].value & 0xFFFF0000) != 0x24000000 && dest != pc;
+    }
+    case 0x03 ... 0x07:
+        return true;
+    }
+
+    return false;
+}
+
+/* Instructions that read or restart the multiplier delay */
+bool IOPJit::uses_muldiv(uint32_t value)
+{
+    if (value >> 26)
+        return false;
+
+    switch (value & 0x3F)
+    {
+    case 0x10: case 0x12: /* MFHI, MFLO */
+    case 0x18: case 0x19: case 0x1A: case 0x1B: /* MULT, MULTU, DIV, DIVU */
+        return true;
+    }
+
+    return false;
+}
+
+IOPJit::Block* IOPJit::compile(uint32_t pc)
+{
+    uint32_t paddr = pc & 0x1FFFFFFF;
+
+    /* Same cacheable regions as the interpreter's decode cache */
+    bool ram = paddr < 0x200000;
+    bool bios = paddr >= 0x1FC00000 && paddr < 0x20000000;
+    if ((!ram && !bios) || (pc & 0x3))
+        return nullptr;
+
+    auto block = std::make_unique<Block>();
+    block->pc = pc;
+    block->code = nullptr;
+
+    /* The delay slot is allowed to spill into the next page */
+    bool delay_slot = false;
+    for (uint32_t addr = paddr;; addr += 4)
+    {
+        uint32_t value = bus->iop_read32(addr);
+        block->instrs.push_back({ value, IOP_Interpreter::decode(value) });
+
+        if (delay_slot)
+            break;
+
+        delay_slot = IOP::ends_block(value);
+        if (delay_slot)
+            continue;
+        if (((addr + 4) >> 12) != (paddr >> 12) || block->instrs.size() >= MAX_BLOCK_INSTRS)
+            break;
+    }
+
+    /* Leave SYSCALL, branches in delay slots and the like to the interpreter */
+    size_t count = block->instrs.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!IOP::ends_block(block->instrs[i].value))
+            continue;
+
+        if (i + 1 >= block->instrs.size() ||
+            !is_jit_branch(&block->instrs[i], pc + i * 4) ||
+            IOP::ends_block(block->instrs[i + 1].value))
+            count = i;
+        break;
+    }
+
+    uint32_t first_page = paddr >> 12;
+    uint32_t last_page = (paddr + (block->instrs.size() - 1) * 4) >> 12;
+    block->pages.push_back(first_page);
+    if (last_page != first_page)
+        block->pages.push_back(last_page);
+
+    for (auto page : block->pages)
+    {
+        if (ram)
+            bus->mark_iop_code_page(page);
+        page_blocks[page].push_back(pc);
+    }
+
+    if (count != 0)
+    {
+        block->code = emitter.get_ptr();
+
+        emit_charge(pc, count);
+
+        /* Multiplier delay bookkeeping. Without a MULT/DIV/MFHI/MFLO
+           the whole block just counts it down up front, otherwise each
+           of those catches up on the instructions before it and the
+           last one also applies the rest of the block */
+        size_t last_muldiv = count;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (uses_muldiv(block->instrs[i].value))
+                last_muldiv = i;
+        }
+
+        if (last_muldiv == count)
+        {
+            emitter.mov32_rm(RAX, RBX, muldiv_offset);
+            emitter.test32(RAX, RAX);
+            uint8_t* skip = emitter.jcc(CC_E);
+            emitter.mov64_rr(RDI, RBP);
+            emitter.mov32_ri(RSI, count);
+            emitter.call((const void*)&IOPJit::decay_muldiv);
+            X64Emitter::patch(skip, emitter.get_ptr());
+        }
+
+        auto muldiv_arg = [&](size_t i, size_t& synced) -> uint32_t
+        {
+            if (!uses_muldiv(block->instrs[i].value))
+                return 0;
+
+            uint32_t before = i + 1 - synced;
+            uint32_t after = i == last_muldiv ? count - (i + 1) : 0;
+            synced = i + 1;
+            return before | (after << MULDIV_AFTER_SHIFT);
+        };
+
+        size_t synced = 0;
+        bool ended = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            auto& code = block->instrs[i];
+            if (IOP::ends_block(code.value))
+            {
+                emit_branch(block.get(), i, muldiv_arg(i + 1, synced));
+                ended = true;
+                break;
+            }
+
+            emit_instr(code, pc + i * 4, false, muldiv_arg(i, synced));
+        }
+
+        if (!ended)
+            emit_exit(pc + count * 4);
+    }
+
+    auto ptr = block.get();
+    blocks[pc] = std::move(block);
+    return ptr;
+}
+
+/* Charges the whole block against the cycle budget. Outside of KSEG1
+   the fetch cost depends on the cache control register at runtime,
+   and with the cache enabled on the tags of the lines the block covers */
+void IOPJit::emit_charge(uint32_t pc, uint32_t count)
+{
+    emitter.alu64_mi(ADD, RBX, retired_offset, count);
+
+    if (pc >= 0xA0000000)
+    {
+        emitter.mov32_mi(RBP, offset_of(this, &fetch_cost), 5);
+        emitter.alu32_mi(SUB, RBX, cycles_offset, count * 5);
+        return;
+    }
+
+    emitter.mov32_rm(RAX, RBX, cache_control_offset);
+    emitter.alu32_ri(AND, RAX, 1 << 11);
+    uint8_t* cached = emitter.jcc(CC_NE);
+    emitter.mov32_mi(RBP, offset_of(this, &fetch_cost), 5);
+    emitter.alu32_mi(SUB, RBX, cycles_offset, count * 5);
+    uint8_t* done = emitter.jmp();
+
+    /* Cached, only the lines that miss cost extra */
+    X64Emitter::patch(cached, emitter.get_ptr());
+    emitter.mov32_mi(RBP, offset_of(this, &fetch_cost), 1);
+    emitter.alu32_mi(SUB, RBX, cycles_offset, count);
+
+    uint32_t paddr = pc & 0x1FFFFFFF;
+    uint32_t end = paddr + count * 4;
+    for (uint32_t addr = paddr; addr < end; addr = (addr & ~0xF) + 16)
+    {
+        emitter.alu32_mi(CMP, RBX, icache_offset + ((addr >> 4) & 0xFF) * sizeof(IOP_ICacheLine), addr >> 12);
+        uint8_t* hit = emitter.jcc(CC_E);
+        emitter.mov64_rr(RDI, RBP);
+        emitter.mov32_ri(RSI, addr);
+        emitter.call((const void*)&IOPJit::icache_miss);
+        X64Emitter::patch(hit, emitter.get_ptr());
+    }
+
+    X64Emitter::patch(done, emitter.get_ptr());
+}
+
+void IOPJit::icache_miss(IOPJit* jit, uint32_t paddr)
+{
+    jit->cpu->icache_miss(paddr);
+}
+
+void IOPJit::emit_instr(const IOPDecodedInstr& code, uint32_t pc, bool delay_slot, uint32_t muldiv)
+{
+    if (!code.value)
+        return;
+
+    if (!muldiv && emit_native(code))
+        return;
+
+    /* Loads never touch code or control flow, call their handler directly */
+    uint8_t opcode = code.value >> 26;
+    if (!muldiv && opcode >= 0x20 && opcode <= 0x26)
+    {
+        emitter.mov64_rr(RDI, RBX);
+        emitter.mov32_ri(RSI, code.value);
+        emitter.call((const void*)code.handler);
+        return;
+    }
+
+    emitter.mov64_rr(RDI, RBP);
+    emitter.mov64_ri(RSI, (uint64_t)&code);
+    emitter.mov32_ri(RDX, pc);
+    emitter.mov32_ri(RCX, delay_slot);
+    emitter.mov32_ri(R8, muldiv);
+    emitter.call((const void*)&IOPJit::fallback);
+    emitter.test32(RAX, RAX);
+    emitter.jcc(CC_NE, exit_code);
+}
+
+void IOPJit::emit_branch(Block* block, size_t index, uint32_t muldiv)
+{
+    auto& code = block->instrs[index];
+    auto& delay = block->instrs[index + 1];
+    uint32_t pc = block->pc + index * 4;
+    uint32_t value = code.value;
+    uint8_t opcode = value >> 26;
+    uint8_t rs = (value >> 21) & 0x1F;
+    uint8_t rt = (value >> 16) & 0x1F;
+    uint8_t rd = (value >> 11) & 0x1F;
+    uint32_t target = pc + 4 + ((int32_t)(int16_t)(value & 0xFFFF) << 2);
+
+    auto emit_delay = [&]()
+    {
+        emit_instr(delay, pc + 4, true, muldiv);
+    };
+
+    switch (opcode)
+    {
+    case 0x00:
+    {
+        /* JR/JALR, the target is read before the delay slot runs */
+        emitter.mov32_rm(RAX, RBX, gpr(rs));
+        emitter.mov32_mr(RBP, offset_of(this, &branch_target), RAX);
+        if ((value & 0x3F) == 0x09 && rd)
+            emitter.mov32_mi(RBX, gpr(rd), pc + 8);
+
+        emit_delay();
+
+        emitter.mov32_rm(RAX, RBP, offset_of(this, &branch_target));
+        emitter.mov32_mr(RBP, offset_of(this, &next_pc), RAX);
+        emit_exit_dynamic();
+        return;
+    }
+    case 0x02:
+    case 0x03:
+    {
+        uint32_t dest = ((pc + 4) & 0xF0000000) | ((value & 0x3FFFFFF) << 2);
+        if (opcode == 0x03)
+            emitter.mov32_mi(RBX, gpr(31), pc + 8);
+
+        emit_delay();
+        emit_exit(dest);
+        return;
+    }
+    }
+
+    /* Conditional branches, all comparisons are signed 32 bit */
+    Cond cc;
+    emitter.mov32_rm(RAX, RBX, gpr(rs));
+    switch (opcode)
+    {
+    case 0x01:
+        /* BLTZAL/BGEZAL link whether or not the branch is taken */
+        if (rt & 0x10)
+            emitter.mov32_mi(RBX, gpr(31), pc + 8);
+        emitter.alu32_ri(CMP, RAX, 0);
+        cc = (rt & 0x1) ? CC_GE : CC_L;
+        break;
+    case 0x04:
+    case 0x05:
+        emitter.mov32_rm(RCX, RBX, gpr(rt));
+        emitter.alu32_rr(CMP, RAX, RCX);
+        cc = opcode == 0x04 ? CC_E : CC_NE;
+        break;
+    case 0x06:
+        emitter.alu32_ri(CMP, RAX, 0);
+        cc = CC_LE;
+        break;
+    default:
+        emitter.alu32_ri(CMP, RAX, 0);
+        cc = CC_G;
+        break;
+    }
+
+    uint8_t* skip;
+    if (!delay.value)
+    {
+        skip = emitter.jcc((Cond)(cc ^ 1));
+    }
+    else
+    {
+        /* The delay slot may overwrite the operands, keep the outcome */
+        emitter.setcc(cc, RAX);
+        emitter.movzx8(RAX, RAX);
+        emitter.mov32_mr(RBP, offset_of(this, &branch_cond), RAX);
+
+        emit_delay();
+
+        emitter.mov32_rm(RAX, RBP, offset_of(this, &branch_cond));
+        emitter.test32(RAX, RAX);
+        skip = emitter.jcc(CC_E);
+    }
+
+    emit_exit(target);
+    X64Emitter::patch(skip, emitter.get_ptr());
+    emit_exit(pc + 8);
+}
+
+/* Same linking scheme as the EE recompiler */
+void IOPJit::emit_exit(uint32_t target)
+{
+    emitter.alu32_mi(CMP, RBX, cycles_offset, 0);
+    uint8_t* out_of_cycles = emitter.jcc(CC_LE);
+    uint8_t* site = emitter.jmp();
+
+    X64Emitter::patch(site, emitter.get_ptr());
+    emitter.mov64_ri(RAX, (uint64_t)site);
+    uint8_t* done = emitter.jmp();
+
+    /* Running out of cycles says nothing about whether the jump is
+       linked already, so it never asks for it to be linked */
+    X64Emitter::patch(out_of_cycles, emitter.get_ptr());
+    emitter.alu32_rr(XOR, RAX, RAX);
+
+    X64Emitter::patch(done, emitter.get_ptr());
+    emitter.mov64_mr(RBP, offset_of(this, &link_site), RAX);
+    emitter.mov32_mi(RBP, offset_of(this, &next_pc), target);
+    emitter.jmp(exit_code);
+}
+
+void IOPJit::emit_exit_dynamic()
+{
+    emitter.alu32_rr(XOR, RAX, RAX);
+    emitter.mov64_mr(RBP, offset_of(this, &link_site), RAX);
+    emitter.jmp(exit_code);
+}
+
+void IOPJit::decay_muldiv(IOPJit* jit, uint32_t instrs)
+{
+    IOP* cpu = jit->cpu;
+    cpu->muldiv_delay = std::max(cpu->muldiv_delay - (int)(instrs * jit->fetch_cost), 0);
+}
+
+/* Runs a single instruction through the interpreter. Returns non-zero
+   when the instruction overwrote translated code and the block has to
+   be left right away */
+int IOPJit::fallback(IOPJit* jit, const IOPDecodedInstr* code, uint32_t pc,
+                     uint32_t delay_slot, uint32_t muldiv)
+{
+    IOP* cpu = jit->cpu;
+    uint64_t invalidations = jit->invalidations;
+
+    if (muldiv)
+        decay_muldiv(jit, muldiv & ((1 << MULDIV_AFTER_SHIFT) - 1));
+
+    cpu->PC = pc;
+    code->handler(*cpu, code->value);
+
+    if (muldiv >> MULDIV_AFTER_SHIFT)
+        decay_muldiv(jit, muldiv >> MULDIV_AFTER_SHIFT);
+
+    if (jit->invalidations != invalidations && !delay_slot)
+    {
+        jit->next_pc = pc + 4;
+        jit->link_site = nullptr;
+        return 1;
+    }
+
+    return 0;
+}
+
+bool IOPJit::emit_native(const IOPDecodedInstr& code)
+{
+    uint32_t value = code.value;
+    uint8_t opcode = value >> 26;
+    uint8_t rs = (value >> 21) & 0x1F;
+    uint8_t rt = (value >> 16) & 0x1F;
+    uint8_t rd = (value >> 11) & 0x1F;
+    uint8_t sa = (value >> 6) & 0x1F;
+    uint32_t imm = (uint32_t)(int32_t)(int16_t)(value & 0xFFFF);
+
+    if (opcode == 0x00)
+    {
+        uint8_t funct = value & 0x3F;
+        switch (funct)
+        {
+        case 0x00: case 0x02: case 0x03: /* SLL, SRL, SRA */
+            if (!rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(rt));
+            if (funct == 0x00)
+                emitter.shl32(RAX, sa);
+            else if (funct == 0x02)
+                emitter.shr32(RAX, sa);
+            else
+                emitter.sar32(RAX, sa);
+            emitter.mov32_mr(RBX, gpr(rd), RAX);
+            return true;
+        case 0x20: case 0x21: case 0x22: case 0x23: /* ADD, ADDU, SUB, SUBU */
+            /* The interpreter doesn't raise overflow exceptions either */
+            if (!rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(rs));
+            emitter.mov32_rm(RCX, RBX, gpr(rt));
+            emitter.alu32_rr(funct <= 0x21 ? ADD : SUB, RAX, RCX);
+            emitter.mov32_mr(RBX, gpr(rd), RAX);
+            return true;
+        case 0x24: case 0x25: case 0x26: case 0x27: /* AND, OR, XOR, NOR */
+            if (!rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(rs));
+            emitter.mov32_rm(RCX, RBX, gpr(rt));
+            emitter.alu32_rr(funct == 0x24 ? AND : funct == 0x26 ? XOR : OR, RAX, RCX);
+            if (funct == 0x27)
+                emitter.not64(RAX);
+            emitter.mov32_mr(RBX, gpr(rd), RAX);
+            return true;
+        case 0x2A: case 0x2B: /* SLT, SLTU */
+            if (!rd)
+                return true;
+            emitter.mov32_rm(RAX, RBX, gpr(rs));
+            emitter.mov32_rm(RCX, RBX, gpr(rt));
+            emitter.alu32_rr(CMP, RAX, RCX);
+            emitter.setcc(funct == 0x2A ? CC_L : CC_B, RAX);
+            emitter.movzx8(RAX, RAX);
+            emitter.mov32_mr(RBX, gpr(rd), RAX);
+            return true;
+        }
+
+        return false;
+    }
+
+    switch (opcode)
+    {
+    case 0x08: case 0x09: /* ADDI, ADDIU */
+        if (!rt)
+            return true;
+        emitter.mov32_rm(RAX, RBX, gpr(rs));
+        emitter.alu32_ri(ADD, RAX, imm);
+        emitter.mov32_mr(RBX, gpr(rt), RAX);
+        return true;
+    case 0x0A: case 0x0B: /* SLTI, SLTIU */
+        if (!rt)
+            return true;
+        emitter.mov32_rm(RAX, RBX, gpr(rs));
+        emitter.alu32_ri(CMP, RAX, imm);
+        emitter.setcc(opcode == 0x0A ? CC_L : CC_B, RAX);
+        emitter.movzx8(RAX, RAX);
+        emitter.mov32_mr(RBX, gpr(rt), RAX);
+        return true;
+    case 0x0C: case 0x0D: case 0x0E: /* ANDI, ORI, XORI */
+        if (!rt)
+            return true;
+        emitter.mov32_rm(RAX, RBX, gpr(rs));
+        emitter.alu32_ri(opcode == 0x0C ? AND : opcode == 0x0D ? OR : XOR, RAX, value & 0xFFFF);
+        emitter.mov32_mr(RBX, gpr(rt), RAX);
+        return true;
+    case 0x0F: /* LUI */
+        if (!rt)
+            return true;
+        emitter.mov32_mi(RBX, gpr(rt), value << 16);
+        return true;
+    }
+
+    return false;
+}
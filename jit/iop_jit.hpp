@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <jit/x64_emitter.hpp>
+
+class Bus;
+class IOP;
+struct IOPDecodedInstr;
+
+/* Block recompiler for the IOP, built the same way as the EE one.
+   Blocks end with the delay slot of the first branch, which is always
+   resolved inside the block so the interpreter's branch_delay/will_branch
+   state is never live between blocks. Cycles, including uncached fetches
+   and instruction cache misses, are charged up front when a block is
+   entered */
+class IOPJit
+{
+public:
+    IOPJit(IOP* cpu, Bus* bus);
+
+    /* Runs until the IOP's cycle budget is used up */
+    void run();
+    void invalidate_page(uint32_t page);
+    void flush();
+
+private:
+    struct Block
+    {
+        uint32_t pc;
+        uint8_t* code;
+        std::vector<IOPDecodedInstr> instrs;
+        std::vector<uint32_t> pages;
+        std::vector<std::pair<uint8_t*, uint8_t*>> incoming;
+    };
+
+    Block* lookup(uint32_t pc);
+    Block* compile(uint32_t pc);
+    void link(uint8_t* site, Block* target);
+
+    void emit_prologue();
+    void emit_charge(uint32_t pc, uint32_t count);
+    void emit_instr(const IOPDecodedInstr& code, uint32_t pc, bool delay_slot, uint32_t muldiv);
+    bool emit_native(const IOPDecodedInstr& code);
+    void emit_branch(Block* block, size_t index, uint32_t muldiv);
+    void emit_exit(uint32_t target);
+    void emit_exit_dynamic();
+
+    static bool is_jit_branch(const IOPDecodedInstr* code, uint32_t pc);
+    static bool uses_muldiv(uint32_t value);
+    static int fallback(IOPJit* jit, const IOPDecodedInstr* code, uint32_t pc,
+                        uint32_t delay_slot, uint32_t muldiv);
+    static void decay_muldiv(IOPJit* jit, uint32_t instrs);
+    static void icache_miss(IOPJit* jit, uint32_t paddr);
+
+    int32_t gpr(int reg);
+
+private:
+    IOP* cpu;
+    Bus* bus;
+    jit::X64Emitter emitter;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> page_blocks;
+
+    void (*enter)(IOP* cpu, IOPJit* jit, uint8_t* code);
+    uint8_t* exit_code;
+    uint8_t* code_start;
+
+    /* Offsets of the IOP fields the generated code touches */
+    int32_t gpr_offset, cycles_offset, retired_offset, muldiv_offset, cache_control_offset;
+    int32_t icache_offset;
+
+    /* Accessed from generated code through RBP */
+    uint32_t next_pc = 0;
+    uint8_t* link_site = nullptr;
+    uint32_t branch_cond = 0;
+    uint32_t branch_target = 0;
+    /* Cycles per instruction in the running block, 5 when fetches are uncached */
+    uint32_t fetch_cost = 1;
+    uint64_t invalidations = 0;
+};
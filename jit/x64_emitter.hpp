@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace jit
+{
+    enum Reg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    enum Cond : uint8_t
+    {
+        CC_O = 0x0, CC_NO = 0x1,
+        CC_B = 0x2, CC_AE = 0x3,
+        CC_E = 0x4, CC_NE = 0x5,
+        CC_BE = 0x6, CC_A = 0x7,
+        CC_S = 0x8, CC_NS = 0x9,
+        CC_L = 0xC, CC_GE = 0xD,
+        CC_LE = 0xE, CC_G = 0xF
+    };
+
+    /* The /digit used by the 0x81 group and the opcodes of the
+       register forms, both in the same order as the x86 manual */
+    enum ALUOp : uint8_t
+    {
+        ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7
+    };
+
+    /* Minimal x86-64 code emitter. All memory operands are [base + disp32]
+       and the base must not be RSP/R12 (no SIB byte is ever emitted) */
+    class X64Emitter
+    {
+    public:
+        X64Emitter(size_t size)
+        : capacity(size)
+        {
+            buffer = (uint8_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (buffer == MAP_FAILED)
+            {
+                printf("[JIT]: Failed to allocate %zu bytes of code memory\n", size);
+                exit(1);
+            }
+            ptr = buffer;
+        }
+
+        ~X64Emitter()
+        {
+            munmap(buffer, capacity);
+        }
+
+        uint8_t* get_ptr() const { return ptr; }
+        void set_ptr(uint8_t* p) { ptr = p; }
+        size_t space_left() const { return capacity - (ptr - buffer); }
+
+        /* Raw bytes */
+        void emit8(uint8_t value) { *ptr++ = value; }
+        void emit32(uint32_t value) { std::memcpy(ptr, &value, 4); ptr += 4; }
+        void emit64(uint64_t value) { std::memcpy(ptr, &value, 8); ptr += 8; }
+
+        /* mov r64, [base + disp] */
+        void mov64_rm(Reg dst, Reg base, int32_t disp) { rex(true, dst, base); emit8(0x8B); modrm_disp(dst, base, disp); }
+        /* mov [base + disp], r64 */
+        void mov64_mr(Reg base, int32_t disp, Reg src) { rex(true, src, base); emit8(0x89); modrm_disp(src, base, disp); }
+        /* mov r32, [base + disp] */
+        void mov32_rm(Reg dst, Reg base, int32_t disp) { rex(false, dst, base); emit8(0x8B); modrm_disp(dst, base, disp); }
+        /* mov [base + disp], r32 */
+        void mov32_mr(Reg base, int32_t disp, Reg src) { rex(false, src, base); emit8(0x89); modrm_disp(src, base, disp); }
+
+        /* mov r32, imm32 (zero extends into the full register) */
+        void mov32_ri(Reg dst, uint32_t imm)
+        {
+            if (dst >= R8) emit8(0x41);
+            emit8(0xB8 + (dst & 7));
+            emit32(imm);
+        }
+
+        /* mov r64, imm64 */
+        void mov64_ri(Reg dst, uint64_t imm)
+        {
+            emit8(0x48 | (dst >= R8 ? 1 : 0));
+            emit8(0xB8 + (dst & 7));
+            emit64(imm);
+        }
+
+        /* mov dword [base + disp], imm32 */
+        void mov32_mi(Reg base, int32_t disp, uint32_t imm)
+        {
+            rex(false, RAX, base);
+            emit8(0xC7);
+            modrm_disp(RAX, base, disp);
+            emit32(imm);
+        }
+
+        /* mov r64, r64 */
+        void mov64_rr(Reg dst, Reg src) { rex(true, src, dst); emit8(0x89); modrm_reg(src, dst); }
+
+        /* movsxd r64, r32 */
+        void movsxd(Reg dst, Reg src) { rex(true, dst, src); emit8(0x63); modrm_reg(dst, src); }
+
+        /* movzx r32, r8 (only AL/CL/DL/BL as sources) */
+        void movzx8(Reg dst, Reg src) { rex(false, dst, src); emit8(0x0F); emit8(0xB6); modrm_reg(dst, src); }
+
+        /* op r64, r64 / op r32, r32 */
+        void alu64_rr(ALUOp op, Reg dst, Reg src) { rex(true, src, dst); emit8(op * 8 + 1); modrm_reg(src, dst); }
+        void alu32_rr(ALUOp op, Reg dst, Reg src) { rex(false, src, dst); emit8(op * 8 + 1); modrm_reg(src, dst); }
+
+        /* op r64, simm32 / op r32, imm32 */
+        void alu64_ri(ALUOp op, Reg dst, int32_t imm) { rex(true, RAX, dst); emit8(0x81); modrm_reg((Reg)op, dst); emit32(imm); }
+        void alu32_ri(ALUOp op, Reg dst, uint32_t imm) { rex(false, RAX, dst); emit8(0x81); modrm_reg((Reg)op, dst); emit32(imm); }
+
+        /* op dword [base + disp], imm32 */
+        void alu32_mi(ALUOp op, Reg base, int32_t disp, uint32_t imm)
+        {
+            rex(false, RAX, base);
+            emit8(0x81);
+            modrm_disp((Reg)op, base, disp);
+            emit32(imm);
+        }
+
+        /* op qword [base + disp], simm32 */
+        void alu64_mi(ALUOp op, Reg base, int32_t disp, int32_t imm)
+        {
+            rex(true, RAX, base);
+            emit8(0x81);
+            modrm_disp((Reg)op, base, disp);
+            emit32(imm);
+        }
+
+        /* not r64 */
+        void not64(Reg reg) { rex(true, RAX, reg); emit8(0xF7); modrm_reg((Reg)2, reg); }
+
+        /* test r64, r64 / test r32, r32 */
+        void test64(Reg a, Reg b) { rex(true, b, a); emit8(0x85); modrm_reg(b, a); }
+        void test32(Reg a, Reg b) { rex(false, b, a); emit8(0x85); modrm_reg(b, a); }
+
+        /* Shifts by an immediate */
+        void shl64(Reg reg, uint8_t sa) { shift(true, 4, reg, sa); }
+        void shr64(Reg reg, uint8_t sa) { shift(true, 5, reg, sa); }
+        void sar64(Reg reg, uint8_t sa) { shift(true, 7, reg, sa); }
+        void shl32(Reg reg, uint8_t sa) { shift(false, 4, reg, sa); }
+        void shr32(Reg reg, uint8_t sa) { shift(false, 5, reg, sa); }
+        void sar32(Reg reg, uint8_t sa) { shift(false, 7, reg, sa); }
+
+        /* setcc r8 (only AL/CL/DL/BL) */
+        void setcc(Cond cc, Reg dst) { emit8(0x0F); emit8(0x90 + cc); modrm_reg(RAX, dst); }
+
+        /* cmovcc r64, r64 */
+        void cmov64(Cond cc, Reg dst, Reg src) { rex(true, dst, src); emit8(0x0F); emit8(0x40 + cc); modrm_reg(dst, src); }
+
+        void push(Reg reg) { if (reg >= R8) emit8(0x41); emit8(0x50 + (reg & 7)); }
+        void pop(Reg reg) { if (reg >= R8) emit8(0x41); emit8(0x58 + (reg & 7)); }
+        void ret() { emit8(0xC3); }
+
+        void call(Reg reg) { rex(false, RAX, reg); emit8(0xFF); modrm_reg((Reg)2, reg); }
+        void jmp(Reg reg) { rex(false, RAX, reg); emit8(0xFF); modrm_reg((Reg)4, reg); }
+
+        /* Calls an absolute address through RAX */
+        void call(const void* func)
+        {
+            mov64_ri(RAX, (uint64_t)func);
+            call(RAX);
+        }
+
+        /* Relative jumps. Both return the location of the rel32
+           field so it can be patched once the target is known */
+        uint8_t* jmp(const uint8_t* target = nullptr)
+        {
+            emit8(0xE9);
+            return rel32(target);
+        }
+
+        uint8_t* jcc(Cond cc, const uint8_t* target = nullptr)
+        {
+            emit8(0x0F);
+            emit8(0x80 + cc);
+            return rel32(target);
+        }
+
+        static void patch(uint8_t* site, const uint8_t* target)
+        {
+            int32_t offset = (int32_t)(target - (site + 4));
+            std::memcpy(site, &offset, 4);
+        }
+
+    private:
+        void rex(bool w, Reg reg, Reg rm)
+        {
+            uint8_t value = 0x40 | (w ? 8 : 0) | (reg >= R8 ? 4 : 0) | (rm >= R8 ? 1 : 0);
+            if (value != 0x40)
+                emit8(value);
+        }
+
+        void modrm_reg(Reg reg, Reg rm) { emit8(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+        void modrm_disp(Reg reg, Reg base, int32_t disp)
+        {
+            emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+            emit32(disp);
+        }
+
+        void shift(bool w, uint8_t ext, Reg reg, uint8_t sa)
+        {
+            rex(w, RAX, reg);
+            emit8(0xC1);
+            modrm_reg((Reg)ext, reg);
+            emit8(sa);
+        }
+
+        uint8_t* rel32(const uint8_t* target)
+        {
+            uint8_t* site = ptr;
+            emit32(0);
+            if (target)
+                patch(site, target);
+            return site;
+        }
+
+    private:
+        uint8_t* buffer;
+        uint8_t* ptr;
+        size_t capacity;
+    };
+}
@@ -0,0 +1,193 @@
+#include <logger.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+namespace logging
+{
+    std::atomic<Level> levels[SubsystemCount] =
+    {
+        Level::Info, Level::Info, Level::Info, Level::Info,
+        Level::Info, Level::Info, Level::Info, Level::Info,
+        Level::Info, Level::Info, Level::Info
+    };
+
+    static const char* NAMES[SubsystemCount] =
+    {
+        "ee", "iop", "dmac", "sif", "intc", "gif", "vif", "gs", "bus", "sio2", "timer"
+    };
+
+    /* Bounded multi-producer ring with a sequence number per cell, a cell
+       is free for position p when its sequence equals p and readable
+       once the producer bumps it to p + 1 */
+    class Logger
+    {
+    public:
+        Logger()
+        {
+            for (uint64_t i = 0; i < RING_SIZE; i++)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+
+            thread = std::thread(&Logger::drain, this);
+        }
+
+        ~Logger()
+        {
+            stop.store(true, std::memory_order_release);
+            thread.join();
+        }
+
+        void push(const Record& record)
+        {
+            uint64_t pos = tail.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &cells[pos & (RING_SIZE - 1)];
+                uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+                int64_t diff = (int64_t)sequence - (int64_t)pos;
+
+                if (diff == 0)
+                {
+                    if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    /* Full, wait for the drain thread rather than lose records */
+                    std::this_thread::yield();
+                    pos = tail.load(std::memory_order_relaxed);
+                }
+                else
+                    pos = tail.load(std::memory_order_relaxed);
+            }
+
+            cell->record = record;
+            cell->sequence.store(pos + 1, std::memory_order_release);
+        }
+
+        void flush()
+        {
+            uint64_t target = tail.load(std::memory_order_acquire);
+            while (written.load(std::memory_order_acquire) < target)
+                std::this_thread::yield();
+        }
+
+    private:
+        bool pop(Record& record)
+        {
+            Cell& cell = cells[head & (RING_SIZE - 1)];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+                return false;
+
+            record = cell.record;
+            cell.sequence.store(head + RING_SIZE, std::memory_order_release);
+            head++;
+            return true;
+        }
+
+        void drain()
+        {
+            Record record;
+            while (true)
+            {
+                bool idle = true;
+                while (pop(record))
+                {
+                    record.print(record);
+                    idle = false;
+                }
+
+                if (!idle)
+                {
+                    fflush(stdout);
+                    written.store(head, std::memory_order_release);
+                    continue;
+                }
+
+                if (stop.load(std::memory_order_acquire))
+                    break;
+
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+    private:
+        static constexpr uint64_t RING_SIZE = 1 << 14;
+
+        struct Cell
+        {
+            std::atomic<uint64_t> sequence;
+            Record record;
+        };
+
+        Cell cells[RING_SIZE];
+        alignas(64) std::atomic<uint64_t> tail = 0;
+        alignas(64) uint64_t head = 0;
+        std::atomic<uint64_t> written = 0;
+        std::atomic<bool> stop = false;
+        std::thread thread;
+    };
+
+    static Logger& instance()
+    {
+        static Logger logger;
+        return logger;
+    }
+
+    void set_level(Subsystem subsystem, Level level)
+    {
+        levels[subsystem].store(level, std::memory_order_relaxed);
+    }
+
+    void set_level(Level level)
+    {
+        for (auto& subsystem : levels)
+            subsystem.store(level, std::memory_order_relaxed);
+    }
+
+    bool set_level(const char* subsystems, Level level)
+    {
+        std::string list = subsystems;
+        size_t start = 0;
+        while (start <= list.size())
+        {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos)
+                end = list.size();
+
+            std::string name = list.substr(start, end - start);
+            bool found = false;
+            for (int i = 0; i < SubsystemCount; i++)
+            {
+                if (name == NAMES[i])
+                {
+                    set_level((Subsystem)i, level);
+                    found = true;
+                }
+            }
+
+            if (!found)
+            {
+                printf("[LOG]: Unknown subsystem %s\n", name.c_str());
+                return false;
+            }
+
+            start = end + 1;
+        }
+
+        return true;
+    }
+
+    void push(const Record& record)
+    {
+        instance().push(record);
+    }
+
+    void flush()
+    {
+        instance().flush();
+    }
+}
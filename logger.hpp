@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+/* Asynchronous logger. Call sites store the format string pointer and the
+   arguments into a lock-free ring, a background thread does the actual
+   formatting and output. Because of that the format must be a string
+   literal and arguments can only be integers or pointers to strings with
+   static lifetime (register name tables and the like).
+
+   Levels below LOG_MIN_LEVEL are compiled out entirely, the rest are
+   filtered at runtime against a per-subsystem level */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+namespace logging
+{
+    enum class Level : uint8_t
+    {
+        Trace = 0,
+        Debug = 1,
+        Info = 2,
+        Warn = 3,
+        Error = 4,
+        None = 5
+    };
+
+    enum Subsystem : uint8_t
+    {
+        EE, IOP, DMAC, SIF, INTC, GIF, VIF, GS, BUS, SIO2, Timer,
+        SubsystemCount
+    };
+
+    constexpr int MAX_ARGS = 6;
+
+    struct Record;
+    using PrintFunction = void (*)(const Record& record);
+
+    /* Arguments are kept as the type printf receives them after the default
+       promotions, print is instantiated for those types and passes them on */
+    struct Record
+    {
+        const char* format;
+        PrintFunction print;
+        uint64_t args[MAX_ARGS];
+    };
+
+    /* Minimum level that gets through for each subsystem */
+    extern std::atomic<Level> levels[SubsystemCount];
+
+    /* Whether the level is compiled in at all */
+    constexpr bool enabled(Level level)
+    {
+        return level >= (Level)LOG_MIN_LEVEL;
+    }
+
+    inline bool enabled(Subsystem subsystem, Level level)
+    {
+        return level >= levels[subsystem].load(std::memory_order_relaxed);
+    }
+
+    void set_level(Subsystem subsystem, Level level);
+    void set_level(Level level);
+    /* Takes a comma separated list of subsystem names like "dmac,sif" */
+    bool set_level(const char* subsystems, Level level);
+
+    void push(const Record& record);
+
+    /* Blocks until every record pushed so far has been written out */
+    void flush();
+
+    template<typename T>
+    using Promoted = decltype(+std::declval<T>());
+
+    template<typename T>
+    inline uint64_t to_arg(T value)
+    {
+        static_assert(std::is_integral_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>,
+                      "Only integers and static strings can be logged");
+
+        Promoted<T> promoted = value;
+        uint64_t arg = 0;
+        std::memcpy(&arg, &promoted, sizeof(promoted));
+        return arg;
+    }
+
+    template<typename T>
+    inline T from_arg(uint64_t arg)
+    {
+        T value;
+        std::memcpy(&value, &arg, sizeof(value));
+        return value;
+    }
+
+    template<typename... Args, size_t... I>
+    inline void print_args(const Record& record, std::index_sequence<I...>)
+    {
+        printf(record.format, from_arg<Args>(record.args[I])...);
+    }
+
+    template<typename... Args>
+    void print(const Record& record)
+    {
+        print_args<Args...>(record, std::index_sequence_for<Args...>{});
+    }
+
+    /* Never called, only there so the compiler checks every format against
+       its arguments like it would for printf */
+    __attribute__((format(printf, 1, 2))) inline void check_format(const char*, ...) {}
+
+    template<typename... Args>
+    inline void write(Subsystem subsystem, Level level, const char* format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "Too many log arguments");
+
+        if (!enabled(subsystem, level))
+            return;
+
+        push({ format, &print<Promoted<Args>...>, { to_arg(args)... } });
+
+        /* Errors are usually followed by exit(), make sure they are out first */
+        if (level >= Level::Error)
+            flush();
+    }
+}
+
+#define LOG(subsystem, level, ...) \
+    do \
+    { \
+        if constexpr (logging::enabled(logging::Level::level)) \
+        { \
+            if (false) \
+                logging::check_format(__VA_ARGS__); \
+            logging::write(logging::subsystem, logging::Level::level, __VA_ARGS__); \
+        } \
+    } while (0)
@@ -1,15 +1,15 @@
-#include <Bus.hpp>
+#include <system.hpp>
+#include <logger.hpp>
 #include <getopt.h>
 #include <unistd.h>
-#include <EE.hpp>
 #include <gs/gsrenderer.hpp>
+#include <gs/gssoftware.hpp>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <gs/gs.hpp>
-#include <dmac.hpp>
+#include <cstdlib>
+#include <memory>
 #include <iop/iop.hpp>
-#include <iop/iop_intc.hpp>
 
 void error_callback( int error, const char *msg ) {
     std::string s;
@@ -17,123 +17,179 @@ void error_callback( int error, const char *msg ) {
     std::cerr << s << std::endl;
 }
 
-IOP* iop;
-
 int main(int argc, char** argv)
 {
-    if(!glfwInit())
+    static option long_options[] =
+    {
+        {"jit", no_argument, nullptr, 'j'},
+        {"fastmem", no_argument, nullptr, 'f'},
+        {"headless", no_argument, nullptr, 'H'},
+        {"frames", required_argument, nullptr, 'n'},
+        {"log", required_argument, nullptr, 'l'},
+        {"iop-trace", required_argument, nullptr, 't'},
+        {"iop-trace-regs", no_argument, nullptr, 'r'},
+        {"iop-thread", no_argument, nullptr, 'i'},
+        {"sif-hle", no_argument, nullptr, 's'},
+        {"software", no_argument, nullptr, 'S'},
+        {"gs-thread", no_argument, nullptr, 'g'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    bool use_jit = false;
+    bool use_fastmem = false;
+    bool headless = false;
+    uint64_t max_frames = 0;
+    const char* iop_trace = nullptr;
+    bool iop_trace_regs = false;
+    bool iop_thread = false;
+    bool sif_hle = false;
+    bool software = false;
+    bool gs_thread = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "jfHn:l:t:risSg", long_options, nullptr)) != -1)
     {
-        printf("[Main]: Error initing GLFW\n");
-        return -1;
+        switch (opt)
+        {
+        case 'j':
+            use_jit = true;
+            break;
+        case 'f':
+            use_fastmem = true;
+            break;
+        case 'H':
+            headless = true;
+            break;
+        case 'n':
+            max_frames = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'l':
+            if (!logging::set_level(optarg, logging::Level::Trace))
+                return 1;
+            break;
+        case 't':
+            iop_trace = optarg;
+            break;
+        case 'r':
+            iop_trace_regs = true;
+            break;
+        case 'i':
+            iop_thread = true;
+            break;
+        case 's':
+            sif_hle = true;
+            break;
+        case 'S':
+            software = true;
+            break;
+        case 'g':
+            gs_thread = true;
+            break;
+        default:
+            return 1;
+        }
     }
-    glfwSetErrorCallback(error_callback);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    GLFWwindow* window = glfwCreateWindow(800, 600, "PS2 Emulator", NULL, NULL);
-    if (window == NULL)
+    if (optind >= argc)
     {
-        printf("[MAIN] Error creating main window\n");
-        glfwTerminate();
-        return -1;
+        printf("Usage: %s [--jit] [--fastmem] [--headless] [--frames N] [--log dmac,sif,...] [--iop-trace FILE [--iop-trace-regs]] [--iop-thread] [--sif-hle] [--software] [--gs-thread] [BIOS] {ELF/CDROM}\n", argv[0]);
+        return 1;
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int width, int height)
+
+    /* Nothing presents local memory to a window yet */
+    if (software && !headless)
     {
-        glViewport(0, 0, width, height);
-    });
+        printf("[Main]: --software requires --headless\n");
+        return 1;
+    }
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-        return -1;
-    if (argc < 2)
+    /* The GL context belongs to this thread */
+    if (gs_thread && !headless)
     {
-        printf("Usage: %s [BIOS] {ELF/CDROM}\n", argv[0]);
+        printf("[Main]: --gs-thread requires --headless\n");
         return 1;
     }
 
-    gs::GraphicsSynthesizer GS;
-    Bus* bus = new Bus(argv[1], &GS);
-    EmotionEngine* cpu = new EmotionEngine(bus);
-    GIF* gif = new GIF(&GS);
-    DMAController* dmac = new DMAController(bus, cpu);
-    bus->vu[0] = new VectorUnit(cpu);
-    bus->vu[1] = new VectorUnit(cpu);
-    INTC* intc = cpu->getIntc();
-    Timers* timers = cpu->getTimers();
-    SIO2* sio2 = new SIO2(bus);
-    iop = new IOP(bus);
-    IOP_INTC* iop_intc = new IOP_INTC(iop);
-    bus->vif[0] = new VIF(bus, 0);
-    bus->vif[1] = new VIF(bus, 1);
-    bus->attachIntc(intc);
-    bus->attachTimers(timers);
-    bus->attachGIF(gif);
-    bus->dmac = dmac;
-    bus->sio2 = sio2;
-
-    iop->reset();
-    iop->set_disassembly(true);
-    iop_intc->reset();
-
-    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-    glClearDepth(0.0);
-    glClear(GL_DEPTH_BUFFER_BIT);
-
-    glfwSwapBuffers(window);
-    glfwPollEvents();
-
-    while (!glfwWindowShouldClose(window))
+    /* Headless runs never touch GLFW or GL, frames are produced as fast as possible */
+    GLFWwindow* window = nullptr;
+    if (!headless)
     {
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-            glfwSetWindowShouldClose(window, true);
-        
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClearDepth(0.0);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        
-        uint32_t total_cycles = 0;
-        bool vblank_started = false;
-        while (total_cycles < 4919808)
+        if(!glfwInit())
         {
-            uint32_t cycles = 32;
-            cpu->Clock(cycles);
+            printf("[Main]: Error initing GLFW\n");
+            return -1;
+        }
+        glfwSetErrorCallback(error_callback);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-            cycles /= 2;
-            dmac->tick(cycles);
-            bus->vif[0]->tick(cycles);
-            bus->vif[1]->tick(cycles);
-            gif->tick(cycles);
+        window = glfwCreateWindow(800, 600, "PS2 Emulator", NULL, NULL);
+        if (window == NULL)
+        {
+            printf("[MAIN] Error creating main window\n");
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int width, int height)
+        {
+            glViewport(0, 0, width, height);
+        });
 
-            cycles /= 4;
-            iop->run(cycles);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+            return -1;
+    }
 
-            total_cycles += 32;
+    std::unique_ptr<gs::GSRenderer> renderer;
+    if (software)
+        renderer = std::make_unique<gs::SoftwareRenderer>();
+    else if (headless)
+        renderer = std::make_unique<gs::NullRenderer>();
+    else
+        renderer = std::make_unique<gs::GLRenderer>();
+
+    System system(argv[optind], std::move(renderer), use_jit, use_fastmem);
+    if (iop_trace)
+        system.iop->start_trace(iop_trace, iop_trace_regs);
+    system.set_iop_thread(iop_thread);
+    system.set_sif_hle(sif_hle);
+    system.set_gs_thread(gs_thread);
+
+    if (window)
+    {
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClearDepth(0.0);
+        glClear(GL_DEPTH_BUFFER_BIT);
 
-            if (!vblank_started && total_cycles >= 4498432)
-            {
-                vblank_started = true;
-                GS.priv_regs.csr.vsint = true;
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
 
-                GS.renderer.render();
+    for (uint64_t frame = 0; !max_frames || frame < max_frames; frame++)
+    {
+        if (window)
+        {
+            if (glfwWindowShouldClose(window))
+                break;
 
-                GS.priv_regs.csr.field = !GS.priv_regs.csr.field;
+            if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+                glfwSetWindowShouldClose(window, true);
 
-                if (!(GS.priv_regs.imr & 0x800))
-                    intc->trigger(Interrupt::INT_GS);
-                
-                intc->trigger(Interrupt::INT_VB_ON);
-                iop_intc->assert_irq(0);
-            }
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClearDepth(0.0);
+            glClear(GL_DEPTH_BUFFER_BIT);
         }
 
-	    intc->trigger(Interrupt::INT_VB_OFF);
-        iop_intc->assert_irq(11);
-        vblank_started = false;
-        GS.priv_regs.csr.vsint = false;
+        system.run_frame();
 
-	    glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (window)
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
     }
+
+    if (window)
+        glfwTerminate();
     return 0;
 }
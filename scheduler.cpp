@@ -0,0 +1,70 @@
+#include <scheduler.hpp>
+
+uint32_t Scheduler::register_function(EventFunc func)
+{
+    functions.push_back({ std::move(func) });
+    return functions.size() - 1;
+}
+
+void Scheduler::add_event(uint32_t id, uint64_t delay)
+{
+    auto& function = functions[id];
+
+    /* Any event already in the queue for this function becomes stale */
+    function.generation++;
+    function.pending = true;
+
+    events.push({ time + delay, id, function.generation });
+}
+
+void Scheduler::remove_event(uint32_t id)
+{
+    auto& function = functions[id];
+    function.generation++;
+    function.pending = false;
+}
+
+void Scheduler::drop_stale()
+{
+    while (!events.empty())
+    {
+        auto& event = events.top();
+        if (event.generation == functions[event.id].generation)
+            break;
+
+        events.pop();
+    }
+}
+
+uint32_t Scheduler::cycles_until_next_event(uint32_t limit)
+{
+    drop_stale();
+    if (events.empty())
+        return limit;
+
+    uint64_t deadline = events.top().time;
+    if (deadline <= time)
+        return 0;
+
+    return deadline - time < limit ? deadline - time : limit;
+}
+
+void Scheduler::advance(uint32_t cycles)
+{
+    time += cycles;
+
+    while (true)
+    {
+        drop_stale();
+        if (events.empty() || events.top().time > time)
+            break;
+
+        Event event = events.top();
+        events.pop();
+
+        /* Clear the pending flag first so the callback is free to reschedule itself */
+        auto& function = functions[event.id];
+        function.pending = false;
+        function.func();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/* Global event scheduler. Time is counted in EE cycles since power on.
+   Devices register a callback once and then schedule it whenever they
+   know when they next need attention; every callback has at most one
+   pending event, scheduling it again replaces the previous deadline */
+class Scheduler
+{
+public:
+    using EventFunc = std::function<void()>;
+
+    /* Returned by devices that have nothing to do until someone else acts */
+    static constexpr uint64_t NO_EVENT = UINT64_MAX;
+
+    Scheduler() = default;
+    ~Scheduler() = default;
+
+    uint32_t register_function(EventFunc func);
+
+    void add_event(uint32_t id, uint64_t delay);
+    void remove_event(uint32_t id);
+    bool is_scheduled(uint32_t id) const { return functions[id].pending; }
+
+    uint64_t get_time() const { return time; }
+
+    /* How many cycles can be run before the next event is due, capped to limit */
+    uint32_t cycles_until_next_event(uint32_t limit);
+
+    /* Moves time forward and runs every event that became due, in order */
+    void advance(uint32_t cycles);
+
+private:
+    struct Event
+    {
+        uint64_t time;
+        uint32_t id;
+        uint32_t generation;
+
+        bool operator>(const Event& other) const { return time > other.time; }
+    };
+
+    struct Function
+    {
+        EventFunc func;
+        uint32_t generation = 0;
+        bool pending = false;
+    };
+
+    void drop_stale();
+
+private:
+    uint64_t time = 0;
+    std::vector<Function> functions;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+};
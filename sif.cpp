@@ -1,6 +1,7 @@
 #include <sif.hpp>
 #include <stdio.h>
 #include <Bus.hpp>
+#include <logger.hpp>
 
 constexpr const char* REGS[] =
 {
@@ -21,24 +22,42 @@ uint32_t SIF::read(uint32_t addr)
 {
     auto comp = (addr >> 9) & 0x1;
     uint16_t offset = (addr >> 4) & 0xF;
-    auto ptr = (uint32_t*)&regs + offset;
+    if (offset >= SIF_REGISTER_COUNT)
+        return 0;
 
-    //printf("[SIF][%s]: Read 0x%08X from %s\n", COMP[comp], *ptr, REGS[offset]);
+    //printf("[SIF][%s]: Read 0x%08X from %s\n", COMP[comp], regs[offset].load(), REGS[offset]);
 
-    return *ptr;
+    return regs[offset];
 }
 
 void SIF::write(uint32_t addr, uint32_t data)
 {
     auto comp = (addr >> 9) & 0x1;
     uint16_t offset = (addr >> 4) & 0xF;
-    auto ptr = (uint32_t*)&regs + offset;
+    if (offset >= SIF_REGISTER_COUNT)
+        return;
 
-    printf("[SIF][%s]: Writing 0x%08X to %s\n", COMP[comp], data, REGS[offset]);
+    LOG(SIF, Debug, "[SIF][%s]: Writing 0x%08X to %s\n", COMP[comp], data, REGS[offset]);
 
-    if (offset == 4)
+    /* Each side sets the bits of its own flag register and clears the other one's */
+    switch (offset)
     {
-        auto& control = regs.ctrl;
+    case MSFLG:
+        if (comp == 1)
+            regs[MSFLG] |= data;
+        else
+            regs[MSFLG] &= ~data;
+        break;
+    case SMFLG:
+        if (comp == 0)
+            regs[SMFLG] |= data;
+        else
+            regs[SMFLG] &= ~data;
+        break;
+    case CTRL:
+    {
+        std::lock_guard lock(ctrl_lock);
+        uint32_t control = regs[CTRL];
         if (comp == 0)
         {
             uint8_t temp = data & 0xF0;
@@ -60,9 +79,31 @@ void SIF::write(uint32_t addr, uint32_t data)
             else
                 control |= 0x100;
         }
+
+        regs[CTRL] = control;
+        break;
     }
-    else
-    {
-        *ptr = data;
+    default:
+        regs[offset] = data;
     }
-}
\ No newline at end of file
+}
+
+void SIF::register_mmio(Bus* bus)
+{
+    bus->register_mmio(0x1000F200, 0x1000F240,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
+    bus->register_mmio(0x1000F240, 0x1000F264,
+    {
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
+
+    /* The IOP sees the same registers, bit 9 of the address tells the sides apart */
+    bus->register_iop_mmio(0x1D000000, 0x1D000070,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
+}
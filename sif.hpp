@@ -1,16 +1,28 @@
 #pragma once
 
-#include <queue>
+#include <atomic>
 #include <cstdint>
+#include <mutex>
+#include <spsc_queue.hpp>
 
-struct SIFRegs
+/* FIFO depth in words. The hardware FIFOs only hold 32 qwords, but the
+   DMAC and IOPDMA only meet at slice boundaries here. The DMAC moves a
+   qword every other EE cycle and the IOP may run up to MAX_IOP_SKEW (2048)
+   cycles apart from it, so 1024 qwords cover the most that can pile up
+   before the other side gets to run */
+constexpr size_t SIF_FIFO_SIZE = 0x1000;
+
+/* Register indices, the same for the EE and the IOP window */
+enum SIFRegister : uint32_t
 {
-    uint32_t mscom;
-    uint32_t smcom;
-    uint32_t msflag;
-    uint32_t ctrl;
-    uint32_t padding;
-    uint32_t bd6;
+    MSCOM,
+    SMCOM,
+    MSFLG,
+    SMFLG,
+    CTRL,
+    PADDING,
+    BD6,
+    SIF_REGISTER_COUNT
 };
 
 class Bus;
@@ -22,11 +34,20 @@ public:
 
     uint32_t read(uint32_t addr);
     void write(uint32_t addr, uint32_t data);
+    uint32_t get_register(SIFRegister reg) const { return regs[reg]; }
+
+    void register_mmio(Bus* bus);
 
 private:
     Bus* bus;
-    SIFRegs regs = {};
+
+    /* Both CPUs access these, possibly from different threads */
+    std::atomic<uint32_t> regs[SIF_REGISTER_COUNT] = {};
+    std::mutex ctrl_lock;
 
 public:
-    std::queue<uint32_t> sif0_fifo, sif1_fifo;
+    /* The DMAC produces SIF1 and consumes SIF0, IOPDMA does the opposite.
+       Each FIFO has one endpoint per CPU, so both stay correct with the
+       IOP running on its own thread */
+    SPSCQueue<uint32_t, SIF_FIFO_SIZE> sif0_fifo, sif1_fifo;
 };
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include <sif_hle.hpp>
+#include <Bus.hpp>
+#include <dmac.hpp>
+#include <sif.hpp>
+#include <logger.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Packet layouts from the EE's SIF RPC library, every pointer is 32 bit */
+struct SifCmdHeader
+{
+    uint32_t size;
+    uint32_t dest;
+    uint32_t cid;
+    uint32_t opt;
+};
+
+struct SifRpcBindPkt
+{
+    SifCmdHeader header;
+    uint32_t rec_id, pkt_addr, rpc_id, client;
+    uint32_t sid;
+};
+
+struct SifRpcCallPkt
+{
+    SifCmdHeader header;
+    uint32_t rec_id, pkt_addr, rpc_id, client;
+    uint32_t rpc_number, send_size, receive, recv_size, rmode, server;
+};
+
+struct SifRpcRendPkt
+{
+    SifCmdHeader header;
+    uint32_t rec_id, pkt_addr, rpc_id, client;
+    uint32_t cid, server, buff, cbuff;
+};
+
+/* IOP addresses handed out for the host servers. They lie past the end of
+   IOP RAM, so nothing the real IOP sends or expects can end up there */
+constexpr uint32_t HLE_WINDOW = 0xF00000;
+constexpr uint32_t HLE_SERVER_SIZE = 0x10000;
+constexpr uint32_t HLE_BUFFER_OFFSET = 0x100;
+
+namespace
+{
+    /* FILEIO, only the host: device is backed, by a directory on the host */
+    class FileIOService : public SIFService
+    {
+    public:
+        FileIOService(Bus* bus, std::string root)
+        : bus(bus), root(std::move(root))
+        {}
+
+        ~FileIOService() override
+        {
+            for (int fd : files)
+            {
+                if (fd >= 0)
+                    close(fd);
+            }
+        }
+
+        void call(uint32_t function, uint8_t* buffer, uint32_t) override
+        {
+            auto args = (uint32_t*)buffer;
+            int32_t result = -EINVAL;
+            switch (function)
+            {
+            case 0:
+                buffer[4 + 255] = 0;
+                result = open_file((const char*)&args[1], args[0]);
+                break;
+            case 1:
+                if (int fd = host_fd(args[0]); fd >= 0)
+                {
+                    close(fd);
+                    files[args[0]] = -1;
+                    result = 0;
+                }
+                break;
+            case 2:
+                result = read_file(args[0], args[1], args[2]);
+
+                /* Everything lands in place, leave nothing for the unaligned fixup */
+                if (uint32_t fixup = args[3] & 0x1FFFFFF; args[3] && fixup <= 0x2000000 - 8)
+                {
+                    bus->check_code_write_range(fixup, 8);
+                    std::memset(&bus->eeRam[fixup], 0, 8);
+                }
+                break;
+            case 3:
+                if (int fd = host_fd(args[0]); fd >= 0)
+                {
+                    uint32_t size = std::min(args[2], 0x2000000 - (args[1] & 0x1FFFFFF));
+                    result = write(fd, &bus->eeRam[args[1] & 0x1FFFFFF], size);
+                    if (result < 0)
+                        result = -errno;
+                }
+                break;
+            case 4:
+                if (int fd = host_fd(args[0]); fd >= 0)
+                {
+                    result = lseek(fd, (int32_t)args[1], args[2]);
+                    if (result < 0)
+                        result = -errno;
+                }
+                break;
+            default:
+                LOG(SIF, Warn, "[SIF HLE] Unhandled FILEIO function %d\n", function);
+            }
+
+            args[0] = result;
+        }
+
+    private:
+        int host_fd(uint32_t fd)
+        {
+            return fd < files.size() ? files[fd] : -1;
+        }
+
+        int32_t open_file(const char* name, uint32_t mode)
+        {
+            const char* path = nullptr;
+            if (!std::strncmp(name, "host:", 5))
+                path = name + 5;
+            else if (!std::strncmp(name, "host0:", 6))
+                path = name + 6;
+            else
+                return -ENOENT;
+
+            int flags;
+            switch (mode & 0x3)
+            {
+            case 1: flags = O_RDONLY; break;
+            case 2: flags = O_WRONLY; break;
+            default: flags = O_RDWR; break;
+            }
+
+            if (mode & 0x100) flags |= O_APPEND;
+            if (mode & 0x200) flags |= O_CREAT;
+            if (mode & 0x400) flags |= O_TRUNC;
+
+            int fd = open((root + "/" + path).c_str(), flags, 0644);
+            if (fd < 0)
+                return -errno;
+
+            files.push_back(fd);
+            return files.size() - 1;
+        }
+
+        int32_t read_file(uint32_t file, uint32_t address, uint32_t size)
+        {
+            int fd = host_fd(file);
+            if (fd < 0)
+                return -EBADF;
+
+            address &= 0x1FFFFFF;
+            size = std::min(size, 0x2000000 - address);
+            if (size)
+                bus->check_code_write_range(address, size);
+
+            int32_t result = read(fd, &bus->eeRam[address], size);
+            return result < 0 ? -errno : result;
+        }
+
+    private:
+        Bus* bus;
+        std::string root;
+        /* Indexed by the descriptor the EE sees, -1 once closed */
+        std::vector<int> files = { -1, -1, -1 };
+    };
+
+    /* Answers every request with the fixed value in the first word and zeroes
+       for the rest. Enough for PAD and MCSERV to look present without ports
+       or cards behind them */
+    class StubService : public SIFService
+    {
+    public:
+        StubService(int32_t result)
+        : result(result)
+        {}
+
+        void call(uint32_t, uint8_t* buffer, uint32_t size) override
+        {
+            std::memset(buffer, 0, std::max<uint32_t>(size, 4));
+            *(int32_t*)buffer = result;
+        }
+
+    private:
+        int32_t result;
+    };
+}
+
+SIFHLE::SIFHLE(Bus* bus, DMAController* dmac, std::string host_root)
+: bus(bus), dmac(dmac)
+{
+    auto add = [this](uint32_t sid, std::unique_ptr<SIFService> service)
+    {
+        servers.push_back({ sid, std::move(service), std::vector<uint8_t>(HLE_SERVER_SIZE - HLE_BUFFER_OFFSET) });
+    };
+
+    add(0x80000001, std::make_unique<FileIOService>(bus, std::move(host_root)));
+    for (uint32_t sid : { 0x80000100u, 0x80000101u, 0x8000010Fu, 0x8000011Fu })
+        add(sid, std::make_unique<StubService>(1));
+    add(0x80000400, std::make_unique<StubService>(-1));
+}
+
+SIFHLE::~SIFHLE() = default;
+
+SIFHLE::Server* SIFHLE::find_server(uint32_t address)
+{
+    uint32_t index = (address - HLE_WINDOW) / HLE_SERVER_SIZE;
+    if (address < HLE_WINDOW || index >= servers.size())
+        return nullptr;
+
+    return &servers[index];
+}
+
+bool SIFHLE::intercept(uint64_t iop_tag, const uint8_t* data, uint32_t size)
+{
+    uint32_t dest = iop_tag & 0xFFFFFF;
+    size = std::min<uint32_t>(size, (iop_tag >> 32) * 4);
+
+    /* Arguments sent ahead of a call, they go to the server's buffer */
+    if (Server* server = find_server(dest))
+    {
+        uint32_t offset = (dest - HLE_WINDOW) % HLE_SERVER_SIZE;
+        if (offset >= HLE_BUFFER_OFFSET)
+        {
+            offset -= HLE_BUFFER_OFFSET;
+            size = std::min<uint32_t>(size, server->buffer.size() - offset);
+            std::memcpy(&server->buffer[offset], data, size);
+        }
+
+        return true;
+    }
+
+    /* Commands go to the buffer the IOP published in SMCOM */
+    if (dest != (bus->sif->get_register(SMCOM) & 0xFFFFFF) || size < sizeof(SifCmdHeader))
+        return false;
+
+    auto header = (const SifCmdHeader*)data;
+    if (header->cid == SIF_CMD_RPC_BIND && size >= sizeof(SifRpcBindPkt))
+    {
+        uint32_t sid = ((const SifRpcBindPkt*)data)->sid;
+        if (std::none_of(servers.begin(), servers.end(), [sid](auto& server) { return server.sid == sid; }))
+            return false;
+
+        bind(data);
+        return true;
+    }
+
+    if (header->cid == SIF_CMD_RPC_CALL && size >= sizeof(SifRpcCallPkt))
+    {
+        if (!find_server(((const SifRpcCallPkt*)data)->server))
+            return false;
+
+        call(data);
+        return true;
+    }
+
+    return false;
+}
+
+void SIFHLE::bind(const uint8_t* packet)
+{
+    auto bind = (const SifRpcBindPkt*)packet;
+    for (uint32_t i = 0; i < servers.size(); i++)
+    {
+        if (servers[i].sid != bind->sid)
+            continue;
+
+        LOG(SIF, Info, "[SIF HLE] Bound server 0x%X\n", bind->sid);
+
+        uint32_t server = HLE_WINDOW + i * HLE_SERVER_SIZE;
+        reply(packet, SIF_CMD_RPC_BIND, server, server + HLE_BUFFER_OFFSET);
+        return;
+    }
+}
+
+void SIFHLE::call(const uint8_t* packet)
+{
+    auto call = (const SifRpcCallPkt*)packet;
+    Server* server = find_server(call->server);
+
+    LOG(SIF, Debug, "[SIF HLE] Call %d on server 0x%X\n", call->rpc_number, server->sid);
+
+    uint32_t send_size = std::min<uint32_t>(call->send_size, server->buffer.size());
+    server->service->call(call->rpc_number, server->buffer.data(), send_size);
+
+    /* The reply goes back to where the EE asked for it, as SIF0 DMA would */
+    if (call->receive && call->recv_size)
+    {
+        uint32_t address = call->receive & 0x1FFFFFF;
+        uint32_t size = std::min<uint32_t>({ call->recv_size, (uint32_t)server->buffer.size(), 0x2000000 - address });
+        bus->check_code_write_range(address, size);
+        std::memcpy(&bus->eeRam[address], server->buffer.data(), size);
+    }
+
+    reply(packet, SIF_CMD_RPC_CALL, call->server, call->server + HLE_BUFFER_OFFSET);
+}
+
+void SIFHLE::reply(const uint8_t* request, uint32_t cid, uint32_t server, uint32_t buffer)
+{
+    auto bind = (const SifRpcBindPkt*)request;
+
+    SifRpcRendPkt rend = {};
+    rend.header.size = sizeof(rend);
+    rend.header.cid = SIF_CMD_RPC_END;
+    rend.rec_id = bind->rec_id;
+    rend.pkt_addr = bind->pkt_addr;
+    rend.rpc_id = bind->rpc_id;
+    rend.client = bind->client;
+    rend.cid = cid;
+    rend.server = server;
+    rend.buff = buffer;
+
+    /* Commands for the EE land in the buffer it published in MSCOM */
+    uint32_t address = bus->sif->get_register(MSCOM) & 0x1FFFFF0;
+    bus->check_code_write_range(address, sizeof(rend));
+    std::memcpy(&bus->eeRam[address], &rend, sizeof(rend));
+
+    dmac->raise_interrupt(DMAChannels::SIF0);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Bus;
+class DMAController;
+
+/* SIF command IDs used by the RPC layer */
+constexpr uint32_t SIF_CMD_RPC_END = 0x80000008;
+constexpr uint32_t SIF_CMD_RPC_BIND = 0x80000009;
+constexpr uint32_t SIF_CMD_RPC_CALL = 0x8000000A;
+
+/* An IOP RPC server implemented on the host */
+class SIFService
+{
+public:
+    virtual ~SIFService() = default;
+
+    /* Handles one call. The EE's arguments are in buffer and the
+       reply is written back over them, like an IOP server would */
+    virtual void call(uint32_t function, uint8_t* buffer, uint32_t size) = 0;
+};
+
+/* Services well known SIF RPC servers without the IOP modules behind
+   them. The EE DMAC offers every SIF1 packet before it reaches the FIFO:
+   binds to a known server, calls to it and the argument data sent to
+   its buffer are taken here, everything else goes to the IOP as usual.
+   Replies are written straight into EE RAM and announced with the SIF0
+   channel interrupt, the same way the EE sees an IOP reply arrive */
+class SIFHLE
+{
+public:
+    SIFHLE(Bus* bus, DMAController* dmac, std::string host_root);
+    ~SIFHLE();
+
+    /* Returns true if the packet was consumed. iop_tag is the upper half
+       of the EE DMA tag, data points to the packet in EE memory */
+    bool intercept(uint64_t iop_tag, const uint8_t* data, uint32_t size);
+
+private:
+    struct Server
+    {
+        uint32_t sid;
+        std::unique_ptr<SIFService> service;
+        std::vector<uint8_t> buffer;
+    };
+
+    Server* find_server(uint32_t address);
+    void bind(const uint8_t* packet);
+    void call(const uint8_t* packet);
+    void reply(const uint8_t* request, uint32_t cid, uint32_t server, uint32_t buffer);
+
+private:
+    Bus* bus;
+    DMAController* dmac;
+    std::vector<Server> servers;
+};
@@ -109,4 +109,13 @@ uint8_t SIO2::read_fifo()
     auto data = sio2_fifo.front();
     sio2_fifo.pop();
     return data;
+}
+
+void SIO2::register_mmio(Bus* bus)
+{
+    bus->register_mmio(0x1F808200, 0x1F808280,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
 }
\ No newline at end of file
@@ -30,6 +30,8 @@ public:
     uint32_t read(uint32_t address);
     void write(uint32_t address, uint32_t data);
 
+    void register_mmio(Bus* bus);
+
     void upload_command(uint8_t cmd);
     uint8_t read_fifo();
 private:
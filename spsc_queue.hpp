@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+/* Bounded single producer, single consumer ring buffer. Each side only
+   ever stores to its own index, so push and pop are wait free and safe
+   to call from two different threads. Size has to be a power of two */
+template <typename T, size_t Size>
+class SPSCQueue
+{
+    static_assert((Size & (Size - 1)) == 0, "SPSCQueue size must be a power of two");
+
+public:
+    /* Producer side, fails when the queue is full */
+    bool push(const T& value)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - head_cache == Size)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (pos - head_cache == Size)
+                return false;
+        }
+
+        buffer[pos & (Size - 1)] = value;
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer side, fails when the queue is empty */
+    bool pop(T& value)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tail_cache)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (pos == tail_cache)
+                return false;
+        }
+
+        value = buffer[pos & (Size - 1)];
+        head.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Block versions of the above, all or nothing */
+    bool push_block(const T* values, size_t count)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        if (Size - (pos - head_cache) < count)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (Size - (pos - head_cache) < count)
+                return false;
+        }
+
+        size_t index = pos & (Size - 1);
+        size_t first = std::min(count, Size - index);
+        std::memcpy(&buffer[index], values, first * sizeof(T));
+        std::memcpy(&buffer[0], values + first, (count - first) * sizeof(T));
+        tail.store(pos + count, std::memory_order_release);
+        return true;
+    }
+
+    bool pop_block(T* values, size_t count)
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        if (tail_cache - pos < count)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (tail_cache - pos < count)
+                return false;
+        }
+
+        size_t index = pos & (Size - 1);
+        size_t first = std::min(count, Size - index);
+        std::memcpy(values, &buffer[index], first * sizeof(T));
+        std::memcpy(values + first, &buffer[0], (count - first) * sizeof(T));
+        head.store(pos + count, std::memory_order_release);
+        return true;
+    }
+
+    /* Exact from either side for what that side is about to do: the
+       consumer never sees fewer entries than it can pop and the producer
+       never sees more free space than it can push */
+    size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t free_space() const { return Size - size(); }
+    bool empty() const { return size() == 0; }
+
+private:
+    /* Indices only ever grow, keep each side on its own cache line */
+    alignas(64) std::atomic<size_t> head = 0;
+    size_t tail_cache = 0;
+    alignas(64) std::atomic<size_t> tail = 0;
+    size_t head_cache = 0;
+    alignas(64) T buffer[Size];
+};
@@ -0,0 +1,346 @@
+#include <system.hpp>
+#include <Bus.hpp>
+#include <EE.hpp>
+#include <gs/gif.hpp>
+#include <dmac.hpp>
+#include <vu.hpp>
+#include <vif.h>
+#include <sio2.h>
+#include <iop/iop.hpp>
+#include <iop/iop_intc.hpp>
+#include <iop/iop_dma.hpp>
+#include <sif_hle.hpp>
+#include <algorithm>
+#include <chrono>
+#include <immintrin.h>
+
+IOP* iop;
+
+/* Scheduling constants, all in EE cycles */
+constexpr uint32_t FRAME_CYCLES = 4919808;
+constexpr uint32_t VBLANK_START_CYCLES = 4498432;
+constexpr uint32_t IOP_SLICE = 256;
+constexpr uint32_t PERIPHERAL_SLICE = 64;
+constexpr uint32_t MAX_EE_SLICE = 1024;
+/* How far the IOP thread may drift from the EE in either direction */
+constexpr uint32_t MAX_IOP_SKEW = 8 * IOP_SLICE;
+
+System::System(std::string bios_path, std::unique_ptr<gs::GSRenderer> renderer,
+               bool use_jit, bool use_fastmem)
+: gs(std::move(renderer))
+{
+    bus = std::make_unique<Bus>(bios_path, &gs);
+    if (use_fastmem && !bus->enable_fastmem())
+        printf("[SYSTEM]: Fastmem unavailable, using the page table\n");
+
+    cpu = std::make_unique<EmotionEngine>(bus.get());
+    if (use_jit)
+        cpu->enable_jit();
+
+    gif = std::make_unique<GIF>(&gs);
+    dmac = std::make_unique<DMAController>(bus.get(), cpu.get());
+    vu[0] = std::make_unique<VectorUnit>(cpu.get());
+    vu[1] = std::make_unique<VectorUnit>(cpu.get());
+    sio2 = std::make_unique<SIO2>(bus.get());
+    iop = std::make_unique<IOP>(bus.get());
+    if (use_jit)
+        iop->enable_jit();
+    iop_intc = std::make_unique<IOP_INTC>(iop.get());
+    bus->iop_intc = iop_intc.get();
+    iop_dma = std::make_unique<IOPDMA>(bus.get(), iop_intc.get());
+    vif[0] = std::make_unique<VIF>(bus.get(), 0);
+    vif[1] = std::make_unique<VIF>(bus.get(), 1);
+    ::iop = iop.get();
+
+    bus->vu[0] = vu[0].get();
+    bus->vu[1] = vu[1].get();
+    bus->vif[0] = vif[0].get();
+    bus->vif[1] = vif[1].get();
+    bus->attachIntc(cpu->getIntc());
+    bus->attachTimers(cpu->getTimers());
+    bus->attachGIF(gif.get());
+    bus->dmac = dmac.get();
+    bus->sio2 = sio2.get();
+
+    cpu->getIntc()->register_mmio(bus.get());
+    cpu->getTimers()->register_mmio(bus.get());
+    gif->register_mmio(bus.get());
+    dmac->register_mmio(bus.get());
+    vif[0]->register_mmio(bus.get());
+    vif[1]->register_mmio(bus.get());
+    sio2->register_mmio(bus.get());
+    iop_dma->register_mmio(bus.get());
+
+    iop->reset();
+    iop_intc->reset();
+    iop_dma->reset();
+
+    schedule_events();
+}
+
+System::~System()
+{
+    set_iop_thread(false);
+    if (::iop == iop.get())
+        ::iop = nullptr;
+}
+
+template<typename Func>
+void System::timed(double& total, Func&& func)
+{
+    if (!profiling)
+    {
+        func();
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    func();
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* EE cycles until the DMAC, a VIF or the GIF next need ticking */
+uint64_t System::next_peripheral_event()
+{
+    if (vif[0]->busy() || vif[1]->busy() || gif->busy())
+        return 0;
+
+    return dmac->next_event();
+}
+
+void System::schedule_peripherals()
+{
+    Scheduler& scheduler = bus->scheduler;
+    if (scheduler.is_scheduled(peripheral_event))
+        return;
+
+    uint64_t delay = next_peripheral_event();
+    if (delay != Scheduler::NO_EVENT)
+        scheduler.add_event(peripheral_event, delay);
+}
+
+/* Everything besides the EE runs off the scheduler. The EE executes
+   uninterrupted until the next event is due */
+void System::schedule_events()
+{
+    Scheduler& scheduler = bus->scheduler;
+
+    /* With the IOP on its own thread, its time is what the EE spent waiting on it */
+    iop_event = scheduler.register_function([this, &scheduler]()
+    {
+        if (iop_thread.joinable())
+        {
+            timed(stats.iop_time, [this, &scheduler]() { sync_iop_thread(scheduler.get_time()); });
+        }
+        else
+        {
+            timed(stats.iop_time, [this]() { run_iop_slice(); });
+            stats.iop_cycles += IOP_SLICE / 8;
+        }
+
+        /* SIF channels waiting on the IOP may be able to move again */
+        dmac->wake_sif();
+        schedule_peripherals();
+
+        scheduler.add_event(iop_event, IOP_SLICE);
+    });
+
+    /* DMAC, VIFs and GIF are only ticked while one of them has work */
+    peripheral_event = scheduler.register_function([this, &scheduler]()
+    {
+        uint32_t cycles = PERIPHERAL_SLICE / 2;
+        timed(stats.dmac_time, [this, cycles]() { dmac->tick(cycles); });
+        timed(stats.vif_time, [this, cycles]()
+        {
+            vif[0]->tick(cycles);
+            vif[1]->tick(cycles);
+        });
+        timed(stats.gif_time, [this, cycles]() { gif->tick(cycles); });
+
+        uint64_t delay = next_peripheral_event();
+        if (delay != Scheduler::NO_EVENT)
+            scheduler.add_event(peripheral_event, std::max<uint64_t>(delay, PERIPHERAL_SLICE));
+    });
+
+    vblank_start_event = scheduler.register_function([this]()
+    {
+        timed(stats.vblank_time, [this]()
+        {
+            auto intc = cpu->getIntc();
+            gs.priv_regs.csr.vsint = true;
+
+            gs.render();
+
+            gs.priv_regs.csr.field = !gs.priv_regs.csr.field;
+
+            if (!(gs.priv_regs.imr & 0x800))
+                intc->trigger(Interrupt::INT_GS);
+
+            intc->trigger(Interrupt::INT_VB_ON);
+            assert_iop_irq(0);
+        });
+    });
+
+    vblank_end_event = scheduler.register_function([this, &scheduler]()
+    {
+        cpu->getIntc()->trigger(Interrupt::INT_VB_OFF);
+        assert_iop_irq(11);
+        gs.priv_regs.csr.vsint = false;
+
+        scheduler.add_event(vblank_start_event, VBLANK_START_CYCLES);
+        scheduler.add_event(vblank_end_event, FRAME_CYCLES);
+        frame_done = true;
+    });
+
+    scheduler.add_event(iop_event, IOP_SLICE);
+    scheduler.add_event(vblank_start_event, VBLANK_START_CYCLES);
+    scheduler.add_event(vblank_end_event, FRAME_CYCLES);
+}
+
+void System::run_frame()
+{
+    Scheduler& scheduler = bus->scheduler;
+
+    frame_done = false;
+    while (!frame_done)
+    {
+        uint32_t cycles = scheduler.cycles_until_next_event(MAX_EE_SLICE);
+        if (cycles)
+            timed(stats.ee_time, [this, cycles]() { cpu->Clock(cycles); });
+
+        /* Register writes during the slice may have given the DMAC,
+           a VIF or the GIF something to do */
+        schedule_peripherals();
+
+        scheduler.advance(cycles);
+    }
+
+    stats.frames++;
+}
+
+void System::set_iop_thread(bool enable)
+{
+    if (enable == iop_thread.joinable())
+        return;
+
+    if (enable)
+    {
+        uint64_t now = bus->scheduler.get_time();
+        iop_thread_start = now;
+        iop_progress = now;
+        iop_target = now + MAX_IOP_SKEW;
+        iop_thread_quit = false;
+
+        /* Data lands in IOP RAM before the command is posted, so the
+           IOP thread never recompiles the page from stale words */
+        bus->ee_iop_ram_written = [this](uint32_t addr)
+        {
+            post_iop_command({ IOPCommand::CodeWrite, addr });
+        };
+        iop_thread = std::thread(&System::iop_thread_main, this);
+    }
+    else
+    {
+        iop_thread_quit = true;
+        iop_thread.join();
+        bus->ee_iop_ram_written = nullptr;
+        stats.iop_cycles += (iop_progress - iop_thread_start) / 8;
+    }
+}
+
+void System::run_iop_slice()
+{
+    iop->run(IOP_SLICE / 8);
+    iop_dma->tick();
+}
+
+void System::set_sif_hle(bool enable)
+{
+    if (enable && !sif_hle)
+        sif_hle = std::make_unique<SIFHLE>(bus.get(), dmac.get(), ".");
+    else if (!enable)
+        sif_hle.reset();
+
+    dmac->attach_sif_hle(sif_hle.get());
+}
+
+void System::iop_thread_main()
+{
+    uint64_t time = iop_progress.load(std::memory_order_relaxed);
+    uint32_t idle = 0;
+    while (!iop_thread_quit.load(std::memory_order_acquire))
+    {
+        run_iop_commands();
+
+        if (time + IOP_SLICE <= iop_target.load(std::memory_order_acquire))
+        {
+            run_iop_slice();
+            time += IOP_SLICE;
+            iop_progress.store(time, std::memory_order_release);
+            idle = 0;
+        }
+        else if (++idle < 64)
+            _mm_pause();
+        else
+            std::this_thread::yield();
+    }
+
+    run_iop_commands();
+}
+
+void System::sync_iop_thread(uint64_t now)
+{
+    iop_target.store(now + MAX_IOP_SKEW, std::memory_order_release);
+
+    uint32_t idle = 0;
+    while (iop_progress.load(std::memory_order_acquire) + MAX_IOP_SKEW < now)
+    {
+        if (++idle < 64)
+            _mm_pause();
+        else
+            std::this_thread::yield();
+    }
+}
+
+void System::post_iop_command(IOPCommand command)
+{
+    /* The IOP thread drains the queue even while it waits on the EE */
+    while (!iop_commands.push(command))
+        std::this_thread::yield();
+}
+
+void System::run_iop_commands()
+{
+    IOPCommand command;
+    while (iop_commands.pop(command))
+    {
+        switch (command.type)
+        {
+        case IOPCommand::AssertIRQ:
+            iop_intc->assert_irq(command.value);
+            break;
+        case IOPCommand::CodeWrite:
+            bus->check_iop_code_write(command.value);
+            break;
+        }
+    }
+}
+
+void System::assert_iop_irq(int irq)
+{
+    if (iop_thread.joinable())
+        post_iop_command({ IOPCommand::AssertIRQ, (uint32_t)irq });
+    else
+        iop_intc->assert_irq(irq);
+}
+
+SystemStats System::get_stats() const
+{
+    SystemStats result = stats;
+    if (iop_thread.joinable())
+        result.iop_cycles += (iop_progress - iop_thread_start) / 8;
+    result.ee_cycles = bus->scheduler.get_time();
+    result.ee_instructions = cpu->instructions_retired;
+    result.iop_instructions = iop->instructions_retired;
+    return result;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <gs/gs.hpp>
+#include <spsc_queue.hpp>
+
+class Bus;
+class EmotionEngine;
+class GIF;
+class DMAController;
+class VectorUnit;
+class VIF;
+class SIO2;
+class IOP;
+class IOP_INTC;
+class IOPDMA;
+class SIFHLE;
+
+struct SystemStats
+{
+    uint64_t frames = 0;
+    uint64_t ee_cycles = 0, iop_cycles = 0;
+    uint64_t ee_instructions = 0, iop_instructions = 0;
+
+    /* Host seconds spent in each unit, only collected while profiling */
+    double ee_time = 0, iop_time = 0;
+    double dmac_time = 0, vif_time = 0, gif_time = 0, vblank_time = 0;
+};
+
+/* Owns every emulated component and the event setup that drives them.
+   Frontends only deal with the window (if any) and call run_frame */
+class System
+{
+public:
+    System(std::string bios_path, std::unique_ptr<gs::GSRenderer> renderer,
+           bool use_jit, bool use_fastmem);
+    ~System();
+
+    /* Runs until the end of the next vblank */
+    void run_frame();
+
+    void set_profiling(bool enable) { profiling = enable; }
+
+    /* Moves the IOP to its own host thread. It is kept within a bounded
+       number of cycles of the EE instead of running in lockstep, so
+       emulation is no longer deterministic while this is enabled */
+    void set_iop_thread(bool enable);
+
+    /* Moves GS command processing to its own host thread. The EE only
+       waits for it when reading GS_CSR/SIGLBLID or local memory */
+    void set_gs_thread(bool enable) { gs.set_thread(enable); }
+
+    /* Serves FILEIO, PAD and MCSERV RPCs on the host instead of the IOP.
+       FILEIO's host: device maps to the current directory */
+    void set_sif_hle(bool enable);
+    SystemStats get_stats() const;
+
+    gs::GraphicsSynthesizer gs;
+    std::unique_ptr<Bus> bus;
+    std::unique_ptr<EmotionEngine> cpu;
+    std::unique_ptr<GIF> gif;
+    std::unique_ptr<DMAController> dmac;
+    std::unique_ptr<VectorUnit> vu[2];
+    std::unique_ptr<VIF> vif[2];
+    std::unique_ptr<SIO2> sio2;
+    std::unique_ptr<IOP> iop;
+    std::unique_ptr<IOP_INTC> iop_intc;
+    std::unique_ptr<IOPDMA> iop_dma;
+    std::unique_ptr<SIFHLE> sif_hle;
+
+private:
+    void schedule_events();
+    uint64_t next_peripheral_event();
+    void schedule_peripherals();
+
+    template<typename Func>
+    void timed(double& total, Func&& func);
+
+    /* Everything the EE thread needs done to IOP state goes through
+       the command queue while the IOP thread is running */
+    struct IOPCommand
+    {
+        enum Type : uint32_t { AssertIRQ, CodeWrite } type;
+        uint32_t value;
+    };
+
+    void run_iop_slice();
+    void iop_thread_main();
+    void sync_iop_thread(uint64_t now);
+    void post_iop_command(IOPCommand command);
+    void run_iop_commands();
+    void assert_iop_irq(int irq);
+
+private:
+    bool frame_done = false;
+    bool profiling = false;
+
+    uint32_t iop_event = 0, peripheral_event = 0;
+    uint32_t vblank_start_event = 0, vblank_end_event = 0;
+
+    SystemStats stats;
+
+    std::thread iop_thread;
+    std::atomic<bool> iop_thread_quit = false;
+    /* Both in EE cycles. The IOP thread runs up to the target, the EE
+       thread waits when the IOP's progress falls too far behind */
+    std::atomic<uint64_t> iop_target = 0, iop_progress = 0;
+    uint64_t iop_thread_start = 0;
+    SPSCQueue<IOPCommand, 1024> iop_commands;
+};
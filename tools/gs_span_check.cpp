@@ -0,0 +1,201 @@
+/* Draws random spans with every span kernel the CPU supports and checks
+   that the vector kernels leave local memory exactly as the scalar one
+   does. States cover every frame and depth format the software renderer
+   draws to, so the fallback of the vector kernels is checked as well */
+#include <gs/gssoftware.hpp>
+#include <gs/gsvram.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+#include <getopt.h>
+
+using namespace gs;
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [--primitives N] [--seed N]\n", name);
+}
+
+static RasterState random_state(std::mt19937& rng)
+{
+    static const uint32_t frame_formats[] = { PSMCT32, PSMCT24, PSMCT16, PSMCT16S, PSMZ32, PSMZ24 };
+    static const uint32_t depth_formats[] = { PSMZ32, PSMZ24, PSMZ16, PSMZ16S };
+
+    RasterState state;
+    state.fbp = (rng() % 512) * BLOCKS_PER_PAGE;
+    state.fbw = 1 + rng() % 32;
+    state.fpsm = frame_formats[rng() % 6];
+    state.fbmsk = (rng() % 4) ? 0 : (uint32_t)rng();
+
+    state.zbp = (rng() % 512) * BLOCKS_PER_PAGE;
+    state.zpsm = depth_formats[rng() % 4];
+    state.zmsk = rng() & 0x1;
+
+    state.zte = rng() & 0x1;
+    state.ztst = rng() % 4;
+    state.ate = rng() & 0x1;
+    state.atst = rng() % 8;
+    state.aref = rng() & 0xFF;
+    state.afail = rng() % 4;
+    state.date = rng() & 0x1;
+    state.datm = rng() & 0x1;
+
+    state.abe = rng() & 0x1;
+    state.pabe = rng() & 0x1;
+    state.clamp = rng() & 0x1;
+    state.fba = rng() & 0x1;
+    state.blend_a = rng() % 4;
+    state.blend_b = rng() % 4;
+    state.blend_c = rng() % 4;
+    state.blend_d = rng() % 4;
+    state.fix = rng() & 0xFF;
+
+    /* The same rules the renderer decodes its states with */
+    if (state.fpsm == PSMCT24 || state.fpsm == PSMZ24)
+        state.date = false;
+
+    bool depth_access = state.zte || !state.zmsk;
+    state.vectorizable = !(state.fpsm & 0x2) && (!depth_access || !(state.zpsm & 0x2));
+    return state;
+}
+
+/* Edges come from a triangle in 12.4 fixed point like the renderer sets
+   them up, the planes are random but keep the colors in int range */
+static SpanSetup random_setup(std::mt19937& rng)
+{
+    std::uniform_int_distribution<int64_t> position(-64 * 16, 2112 * 16);
+    std::uniform_real_distribution<float> color(-64.0f, 320.0f), color_step(-4.0f, 4.0f);
+    std::uniform_real_distribution<double> depth(-1e9, 5e9), depth_step(-1e6, 1e6);
+
+    SpanSetup setup = {};
+    setup.sprite = !(rng() % 4);
+
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        x[i] = position(rng);
+        y[i] = position(rng);
+    }
+
+    if ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) < 0)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        int a = (i + 1) % 3, b = (i + 2) % 3;
+        int64_t dx = x[b] - x[a], dy = y[b] - y[a];
+        bool top_left = dy < 0 || (dy == 0 && dx > 0);
+
+        setup.edge_dx[i] = -dy * 16;
+        setup.edge_dy[i] = dx * 16;
+        setup.edge[i] = dy * x[a] - dx * y[a] - (top_left ? 0 : 1);
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        setup.color[i] = color(rng);
+        if (rng() & 0x1)
+        {
+            setup.color_dx[i] = color_step(rng);
+            setup.color_dy[i] = color_step(rng);
+        }
+    }
+
+    setup.z = depth(rng);
+    if (rng() & 0x1)
+    {
+        setup.z_dx = depth_step(rng);
+        setup.z_dy = depth_step(rng);
+    }
+
+    return setup;
+}
+
+int main(int argc, char** argv)
+{
+    static option long_options[] =
+    {
+        {"primitives", required_argument, nullptr, 'p'},
+        {"seed", required_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    uint32_t primitives = 5000;
+    uint32_t seed = 1;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:s:", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            primitives = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 's':
+            seed = std::strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<const char*, SpanFunction>> kernels;
+    if (__builtin_cpu_supports("sse4.1"))
+        kernels.emplace_back("sse41", draw_span_sse41);
+    else
+        printf("[SPAN]: No SSE4.1, skipping draw_span_sse41\n");
+
+    if (__builtin_cpu_supports("avx2"))
+        kernels.emplace_back("avx2", draw_span_avx2);
+    else
+        printf("[SPAN]: No AVX2, skipping draw_span_avx2\n");
+
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> expected(VRAM_SIZE);
+    for (auto& byte : expected)
+        byte = rng();
+
+    std::vector<std::vector<uint8_t>> memory(kernels.size(), expected);
+
+    uint64_t spans = 0;
+    for (uint32_t i = 0; i < primitives; i++)
+    {
+        RasterState state = random_state(rng);
+        SpanSetup setup = random_setup(rng);
+
+        /* A few rows of any length, anywhere in the 2048x2048 window */
+        for (int row = 0; row < 4; row++)
+        {
+            int y = rng() % 2048;
+            int x0 = rng() % 2048;
+            int x1 = std::min<int>(2047, x0 + rng() % 256);
+
+            draw_span_scalar(expected.data(), state, setup, y, x0, x1);
+            for (size_t k = 0; k < kernels.size(); k++)
+                kernels[k].second(memory[k].data(), state, setup, y, x0, x1);
+            spans++;
+        }
+
+        for (size_t k = 0; k < kernels.size(); k++)
+        {
+            if (memory[k] != expected)
+            {
+                printf("[SPAN]: draw_span_%s differs from draw_span_scalar at primitive %u\n", kernels[k].first, i);
+                printf("[SPAN]: fpsm 0x%X zpsm 0x%X zte %d ztst %d ate %d atst %d afail %d date %d abe %d sprite %d\n",
+                       state.fpsm, state.zpsm, state.zte, state.ztst, state.ate, state.atst, state.afail,
+                       state.date, state.abe, setup.sprite);
+                return 1;
+            }
+        }
+    }
+
+    printf("[SPAN]: %lu spans, every kernel matches draw_span_scalar\n", spans);
+    return 0;
+}
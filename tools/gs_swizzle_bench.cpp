@@ -0,0 +1,161 @@
+/* Times GS local memory swizzling for every pixel format and reports it
+   as JSON, in megapixels per second. Pixels go through write_pixel and
+   read_pixel one at a time, blocks through write_block and read_block.
+   Both paths have to agree on the result, or the run fails */
+#include <gs/gsvram.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <getopt.h>
+
+using namespace gs;
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [--size N] [--iterations N] [--output FILE]\n", name);
+}
+
+template<typename Func>
+static double megapixels_per_second(uint64_t pixels, uint32_t iterations, Func&& func)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        func();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return pixels * iterations / seconds / 1e6;
+}
+
+/* Swizzles a size x size image at the start of local memory */
+template<PixelFormat fmt>
+static bool run(FILE* out, const char* name, uint32_t size, uint32_t iterations, bool last)
+{
+    using Info = FormatInfo<fmt>;
+    constexpr uint32_t BLOCK_WIDTH = Info::BLOCK_PIXEL_WIDTH;
+    constexpr uint32_t BLOCK_HEIGHT = Info::BLOCK_PIXEL_HEIGHT;
+
+    uint32_t width = size / 64;
+    uint64_t pixels = (uint64_t)size * size;
+    uint32_t image_size = pixels * Info::BITS / 8;
+
+    std::vector<uint8_t> image(image_size), pixel_result(image_size), block_result(image_size);
+    std::vector<uint8_t> pixel_memory(VRAM_SIZE), block_memory(VRAM_SIZE);
+
+    std::mt19937 rng(fmt);
+    for (auto& byte : image)
+        byte = rng();
+
+    double pixel_write = megapixels_per_second(pixels, iterations, [&]()
+    {
+        for (uint32_t y = 0; y < size; y++)
+            for (uint32_t x = 0; x < size; x++)
+                write_pixel<fmt>(pixel_memory.data(), x, y, 0, width, unpack_pixel<fmt>(image.data(), y * size + x));
+    });
+
+    double block_write = megapixels_per_second(pixels, iterations, [&]()
+    {
+        for (uint32_t y = 0; y < size; y += BLOCK_HEIGHT)
+            for (uint32_t x = 0; x < size; x += BLOCK_WIDTH)
+                write_block<fmt>(block_memory.data(), x, y, 0, width, &image[(y * size + x) * Info::BITS / 8], size);
+    });
+
+    double pixel_read = megapixels_per_second(pixels, iterations, [&]()
+    {
+        for (uint32_t y = 0; y < size; y++)
+            for (uint32_t x = 0; x < size; x++)
+                pack_pixel<fmt>(pixel_result.data(), y * size + x, read_pixel<fmt>(pixel_memory.data(), x, y, 0, width));
+    });
+
+    double block_read = megapixels_per_second(pixels, iterations, [&]()
+    {
+        for (uint32_t y = 0; y < size; y += BLOCK_HEIGHT)
+            for (uint32_t x = 0; x < size; x += BLOCK_WIDTH)
+                read_block<fmt>(block_memory.data(), x, y, 0, width, &block_result[(y * size + x) * Info::BITS / 8], size);
+    });
+
+    if (pixel_memory != block_memory || pixel_result != image || block_result != image)
+    {
+        printf("[BENCH]: Pixel and block swizzling disagree for %s\n", name);
+        return false;
+    }
+
+    fprintf(out, "    { \"format\": \"%s\", \"pixel_write\": %.1f, \"block_write\": %.1f, \"pixel_read\": %.1f, \"block_read\": %.1f }%s\n",
+            name, pixel_write, block_write, pixel_read, block_read, last ? "" : ",");
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    static option long_options[] =
+    {
+        {"size", required_argument, nullptr, 's'},
+        {"iterations", required_argument, nullptr, 'n'},
+        {"output", required_argument, nullptr, 'o'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    uint32_t size = 512;
+    uint32_t iterations = 20;
+    const char* output = nullptr;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:n:o:", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            size = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'n':
+            iterations = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    /* Whole 8 and 4bit pages, and a 32bit image has to fit in local memory */
+    if (!size || size % 128 || size > 1024 || !iterations)
+    {
+        printf("[BENCH]: Size has to be a multiple of 128 up to 1024\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (output && !(out = fopen(output, "w")))
+    {
+        printf("[BENCH]: Unable to open %s\n", output);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"size\": %u,\n", size);
+    fprintf(out, "  \"iterations\": %u,\n", iterations);
+    fprintf(out, "  \"formats\": [\n");
+
+    bool ok = run<PSMCT32>(out, "PSMCT32", size, iterations, false) &&
+              run<PSMCT24>(out, "PSMCT24", size, iterations, false) &&
+              run<PSMCT16>(out, "PSMCT16", size, iterations, false) &&
+              run<PSMCT16S>(out, "PSMCT16S", size, iterations, false) &&
+              run<PSMCT8>(out, "PSMT8", size, iterations, false) &&
+              run<PSMCT4>(out, "PSMT4", size, iterations, false) &&
+              run<PSMCT8H>(out, "PSMT8H", size, iterations, false) &&
+              run<PSMCT4HL>(out, "PSMT4HL", size, iterations, false) &&
+              run<PSMCT4HH>(out, "PSMT4HH", size, iterations, false) &&
+              run<PSMZ32>(out, "PSMZ32", size, iterations, false) &&
+              run<PSMZ24>(out, "PSMZ24", size, iterations, false) &&
+              run<PSMZ16>(out, "PSMZ16", size, iterations, false) &&
+              run<PSMZ16S>(out, "PSMZ16S", size, iterations, true);
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return ok ? 0 : 1;
+}
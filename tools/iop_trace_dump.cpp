@@ -0,0 +1,83 @@
+/* Disassembles a binary IOP trace written by --iop-trace into the same
+   text format the emulator used to log directly */
+#include <iop/iop_trace.hpp>
+#include <iop/disassembler.hpp>
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s TRACE [OUTPUT]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        printf("[TRACE]: Unable to open %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (argc > 2 && !(out = fopen(argv[2], "w")))
+    {
+        printf("[TRACE]: Unable to open %s\n", argv[2]);
+        return 1;
+    }
+
+    IOPTraceHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        std::memcmp(header.magic, IOP_TRACE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        printf("[TRACE]: %s is not an IOP trace\n", argv[1]);
+        return 1;
+    }
+
+    if (header.version != IOP_TRACE_VERSION)
+    {
+        printf("[TRACE]: Unsupported trace version %d\n", header.version);
+        return 1;
+    }
+
+    bool registers = header.flags & IOP_TRACE_REGISTERS;
+    uint32_t gpr[32];
+    std::memcpy(gpr, header.gpr, sizeof(gpr));
+    gpr[0] = 0;
+
+    uint32_t record[2];
+    uint64_t count = 0;
+    while (fread(record, sizeof(record), 1, in) == 1)
+    {
+        uint32_t pc = record[0], opcode = record[1];
+
+        /* Without register deltas there is no way to know load/store addresses */
+        std::string text = EmotionDisasm::disasm_instr(opcode, pc, registers ? gpr : nullptr);
+        fprintf(out, "[IOP] [$%08X] $%08X - %s\n", pc, opcode, text.c_str());
+        count++;
+
+        if (!registers)
+            continue;
+
+        uint8_t changed = 0;
+        if (fread(&changed, 1, 1, in) != 1)
+            break;
+
+        for (int i = 0; i < changed; i++)
+        {
+            uint8_t delta[5];
+            if (fread(delta, sizeof(delta), 1, in) != 1)
+                break;
+
+            std::memcpy(&gpr[delta[0] & 0x1F], &delta[1], 4);
+        }
+    }
+
+    fprintf(stderr, "[TRACE]: %lu instructions\n", count);
+
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
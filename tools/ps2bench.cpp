@@ -0,0 +1,136 @@
+/* Boots a BIOS headlessly for a fixed number of frames and reports
+   throughput as JSON. Emulation is deterministic, so the counters are
+   identical between runs and only the timings should move. The one
+   exception is --iop-thread, where the IOP drifts against the EE */
+#include <system.hpp>
+#include <iop/iop.hpp>
+#include <gs/gssoftware.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+
+static void usage(const char* name)
+{
+    printf("Usage: %s [--frames N] [--jit] [--fastmem] [--iop-thread] [--sif-hle] [--software] [--gs-thread] [--output FILE] BIOS\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    static option long_options[] =
+    {
+        {"frames", required_argument, nullptr, 'n'},
+        {"jit", no_argument, nullptr, 'j'},
+        {"fastmem", no_argument, nullptr, 'f'},
+        {"iop-thread", no_argument, nullptr, 'i'},
+        {"sif-hle", no_argument, nullptr, 's'},
+        {"software", no_argument, nullptr, 'S'},
+        {"gs-thread", no_argument, nullptr, 'g'},
+        {"output", required_argument, nullptr, 'o'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    uint64_t frames = 60;
+    bool use_jit = false;
+    bool use_fastmem = false;
+    bool iop_thread = false;
+    bool sif_hle = false;
+    bool software = false;
+    bool gs_thread = false;
+    const char* output = nullptr;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:jfisSo:g", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            frames = std::strtoull(optarg, nullptr, 10);
+            break;
+        case 'j':
+            use_jit = true;
+            break;
+        case 'f':
+            use_fastmem = true;
+            break;
+        case 'i':
+            iop_thread = true;
+            break;
+        case 's':
+            sif_hle = true;
+            break;
+        case 'S':
+            software = true;
+            break;
+        case 'g':
+            gs_thread = true;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc || !frames)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::unique_ptr<gs::GSRenderer> renderer;
+    if (software)
+        renderer = std::make_unique<gs::SoftwareRenderer>();
+    else
+        renderer = std::make_unique<gs::NullRenderer>();
+
+    System system(argv[optind], std::move(renderer), use_jit, use_fastmem);
+    system.set_profiling(true);
+    system.set_iop_thread(iop_thread);
+    system.set_sif_hle(sif_hle);
+    system.set_gs_thread(gs_thread);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frames; frame++)
+        system.run_frame();
+
+    /* Frames only count once the GS has drawn them */
+    system.gs.sync();
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    /* Stop the IOP so its counters are stable */
+    system.set_iop_thread(false);
+    auto stats = system.get_stats();
+
+    /* The emulator itself prints to stdout, so a file keeps the JSON clean */
+    FILE* out = stdout;
+    if (output && !(out = fopen(output, "w")))
+    {
+        printf("[BENCH]: Unable to open %s\n", output);
+        return 1;
+    }
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"bios\": \"%s\",\n", argv[optind]);
+    fprintf(out, "  \"jit\": %s,\n", use_jit ? "true" : "false");
+    fprintf(out, "  \"fastmem\": %s,\n", use_fastmem ? "true" : "false");
+    fprintf(out, "  \"iop_thread\": %s,\n", iop_thread ? "true" : "false");
+    fprintf(out, "  \"sif_hle\": %s,\n", sif_hle ? "true" : "false");
+    fprintf(out, "  \"software\": %s,\n", software ? "true" : "false");
+    fprintf(out, "  \"gs_thread\": %s,\n", gs_thread ? "true" : "false");
+    fprintf(out, "  \"frames\": %lu,\n", stats.frames);
+    fprintf(out, "  \"wall_seconds\": %.6f,\n", wall);
+    fprintf(out, "  \"fps\": %.3f,\n", stats.frames / wall);
+    fprintf(out, "  \"ee\": { \"cycles\": %lu, \"instructions\": %lu, \"cycles_per_second\": %.0f, \"seconds\": %.6f },\n",
+            stats.ee_cycles, stats.ee_instructions, stats.ee_cycles / wall, stats.ee_time);
+    fprintf(out, "  \"iop\": { \"cycles\": %lu, \"instructions\": %lu, \"cycles_per_second\": %.0f, \"seconds\": %.6f },\n",
+            stats.iop_cycles, stats.iop_instructions, stats.iop_cycles / wall, stats.iop_time);
+    fprintf(out, "  \"devices\": { \"dmac_seconds\": %.6f, \"vif_seconds\": %.6f, \"gif_seconds\": %.6f, \"vblank_seconds\": %.6f }\n",
+            stats.dmac_time, stats.vif_time, stats.gif_time, stats.vblank_time);
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -245,4 +245,20 @@ void VIF::unpack_packet()
     }
     else
         return;
+}
+
+void VIF::register_mmio(Bus* bus)
+{
+    uint32_t regs = 0x10003800 + id * 0x400;
+    bus->register_mmio(regs, regs + 0x400,
+    {
+        .read32 = [this](uint32_t addr) { return read(addr); },
+        .write32 = [this](uint32_t addr, uint32_t data) { write(addr, data); }
+    });
+
+    uint32_t fifo = 0x10004000 + id * 0x1000;
+    bus->register_mmio(fifo, fifo + 0x10,
+    {
+        .write128 = [this](uint32_t addr, uint128_t data) { write_fifo<uint128_t>(addr, data); }
+    });
 }
\ No newline at end of file
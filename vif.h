@@ -137,12 +137,17 @@ public:
 
     void tick(uint32_t cycles);
     void reset();
+    bool busy() const { return !fifo.empty(); }
 
     template<typename T>
     bool write_fifo(uint32_t, T data);
+    /* Returns how many of the qwords fit in the FIFO */
+    int write_fifo_block(const uint128_t* data, int count) { return fifo.push_block(data, count); }
 
     uint32_t read(uint32_t address);
     void write(uint32_t address, uint32_t data);
+
+    void register_mmio(Bus* bus);
 private:
     void process_command();
     void process_unpack();